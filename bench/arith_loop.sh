@@ -0,0 +1,34 @@
+#!/bin/sh
+# Counting loop in the tutorial shell: "i = i + 1" with $((...)) in the
+# shell process against the same loop spawning expr for every step (the
+# way a loop has to count without arithmetic expansion), N iterations each.
+#
+# usage: ./arith_loop.sh [N]   (default 100000; the expr loop runs N/100)
+#
+# build: gcc -O2 ../tutorial/*.c ../shell_official/lineedit.c ../shell_official/complete.c -o tutorial_shell
+set -e
+
+N=${1:-100000}
+SHELL_BIN=./tutorial_shell
+EXPR=$(command -v expr)
+
+if [ ! -x "$SHELL_BIN" ]; then
+    echo "build the tutorial shell first (see the top of this file)" >&2
+    exit 1
+fi
+
+run()
+{
+    start=$(date +%s.%N)
+    echo "$3" | "$SHELL_BIN" > /dev/null 2>&1
+    end=$(date +%s.%N)
+    awk -v name="$1" -v s="$start" -v e="$end" -v n="$2" 'BEGIN {
+        printf "%-26s %8d steps %8.3f s %10.0f ns/step\n", name, n, e - s, (e - s) * 1e9 / n
+    }'
+}
+
+SLOW=$((N / 100))
+run 'i=$((i + 1))' "$N" "i=0; while ((i < $N)); do i=\$((i + 1)); done"
+run '((i++))' "$N" "i=0; while ((i < $N)); do ((i++)); done"
+# no command substitution in the tutorial shell: the step is the expr run
+run 'expr $i + 1 (spawned)' "$SLOW" "i=0; while ((i < $SLOW)); do $EXPR \$i + 1; ((i++)); done"
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Batch script start-up: "wish FILE" (every line tokenized and parsed as it
+# runs) against "wish FILE.wishc" (compiled once with --compile, mapped and
+# run as is). The script is LINES copies of a builtin with a few arguments,
+# so no command is started and the time is that of getting the lines ready.
+#
+# usage: ./compile_run.sh [LINES]   (default 200000)
+#
+# build: gcc -O2 ../shell_official/main.c ../shell_official/wish.c ../shell_official/lineedit.c ../shell_official/complete.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c ../shell_official/frame.c ../shell_official/serve.c -o wish
+set -e
+
+LINES=${1:-200000}
+WISH=./wish
+
+if [ ! -x "$WISH" ]; then
+    echo "build wish first (see the top of this file)" >&2
+    exit 1
+fi
+
+SCRIPT=$(mktemp)
+trap 'rm -f "$SCRIPT" "$SCRIPT.wishc"' EXIT
+yes 'path /bin /usr/bin /usr/local/bin /sbin /usr/sbin /opt/bin' | head -n "$LINES" > "$SCRIPT"
+"$WISH" --compile "$SCRIPT" -o "$SCRIPT.wishc"
+
+run()
+{
+    start=$(date +%s.%N)
+    "$WISH" "$2"
+    end=$(date +%s.%N)
+    awk -v name="$1" -v s="$start" -v e="$end" -v lines="$LINES" -v bytes="$(wc -c < "$2")" 'BEGIN {
+        printf "%-16s %7.3f s  %7.0f ns/line  %6.1f MB\n", name, e - s, (e - s) * 1e9 / lines, bytes / 1e6
+    }'
+}
+
+echo "$LINES lines"
+run "wish FILE" "$SCRIPT"
+run "wish FILE.wishc" "$SCRIPT.wishc"
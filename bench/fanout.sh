@@ -0,0 +1,53 @@
+#!/bin/sh
+# Output fan-out benchmark: wish's "cmd > a > b" (tee()/splice() in a fan-out
+# process) against piping through /usr/bin/tee, on a multi-GB stream.
+#
+# usage: ./fanout.sh [SIZE] [DIR]
+#   SIZE  bytes to write, as taken by head -c (default 4G)
+#   DIR   where the two output files go (default /tmp, needs 2 x SIZE free);
+#         "null" writes both copies to /dev/null, leaving the disk out of it
+#
+# build: gcc -O2 ../shell_official/main.c ../shell_official/wish.c ../shell_official/lineedit.c ../shell_official/complete.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c ../shell_official/frame.c ../shell_official/serve.c -o wish
+set -e
+
+SIZE=${1:-4G}
+DIR=${2:-/tmp}
+WISH=./wish
+TEE=$(command -v tee)
+
+if [ ! -x "$WISH" ]; then
+    echo "build wish first (see the top of this file)" >&2
+    exit 1
+fi
+
+if [ "$DIR" = null ]; then
+    A=/dev/null
+    B=/dev/null
+else
+    A=$DIR/fanout_a.$$
+    B=$DIR/fanout_b.$$
+fi
+BATCH=$(mktemp)
+trap 'rm -f "$BATCH"; [ "$DIR" = null ] || rm -f "$A" "$B"' EXIT
+
+run()
+{
+    echo "$2" > "$BATCH"
+    sync
+    start=$(date +%s.%N)
+    "$WISH" "$BATCH"
+    end=$(date +%s.%N)
+    awk -v name="$1" -v s="$start" -v e="$end" -v size="$SIZE" 'BEGIN {
+        bytes = size + 0
+        unit = substr(size, length(size))
+        if (unit == "K") bytes *= 1024
+        if (unit == "M") bytes *= 1024 * 1024
+        if (unit == "G") bytes *= 1024 * 1024 * 1024
+        printf "%-28s %7.2f s  %8.1f MB/s\n", name, e - s, bytes / (e - s) / 1e6
+    }'
+}
+
+echo "fan-out of $SIZE into $A and $B"
+run "head | tee a > b" "head -c $SIZE /dev/zero | $TEE $A > $B"
+run "head > a > b (wish)" "head -c $SIZE /dev/zero > $A > $B"
+run "head > a (single target)" "head -c $SIZE /dev/zero > $A"
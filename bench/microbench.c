@@ -0,0 +1,247 @@
+// Front-end microbenchmarks: wish's tokenize_input(), parse_tokens(),
+// search_path() and free_command_list(), and the tutorial's
+// parse_simple_command(), each timed on its own over a corpus of typical
+// command lines, so parser changes can be judged without fork/exec noise.
+// Reports ns, heap allocations and heap bytes per line (or per lookup).
+//
+// build: gcc -O2 -I../tutorial microbench.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c ../tutorial/scanner.c ../tutorial/parser.c ../tutorial/node.c ../tutorial/source.c ../tutorial/symtab.c -o microbench
+// usage: ./microbench [ROUNDS]   (default 20000 passes over the corpus)
+#include "../shell_official/wish.c" // libwish itself, for its internal functions
+
+#include <time.h>
+#include "scanner.h"
+#include "parser.h"
+#include "node.h"
+#include "source.h"
+
+// every allocation goes through these while counting is on; they forward
+// to glibc's allocator, which also sees strdup()'s internal mallocs
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t n, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+extern void __libc_free(void *ptr);
+
+static int counting;
+static unsigned long alloc_count;
+static unsigned long alloc_bytes;
+
+void *malloc(size_t size)
+{
+    if (counting)
+    {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __libc_malloc(size);
+}
+
+void *calloc(size_t n, size_t size)
+{
+    if (counting)
+    {
+        alloc_count++;
+        alloc_bytes += n * size;
+    }
+    return __libc_calloc(n, size);
+}
+
+void *realloc(void *ptr, size_t size)
+{
+    if (counting)
+    {
+        alloc_count++;
+        alloc_bytes += size;
+    }
+    return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr)
+{
+    __libc_free(ptr);
+}
+
+static char *corpus[] = {
+    "ls",
+    "ls -la /tmp",
+    "echo hello world",
+    "cat access.log | grep error | sort | uniq -c | sort -rn | head",
+    "ls -l > listing.txt",
+    "sort < data.txt > sorted.txt",
+    "make -j8 all 2>&1 > build.log &",
+    "sleep 1 & echo started & echo again",
+    "grep -rn TODO src include tests docs | wc -l",
+    "timeout -k 1 5 curl -s http://example.com/index.html -o page.html",
+    "pin 0-3 nice 10 ulimit -n 256 ./worker --threads 4 --queue /var/run/q",
+    "diff <(sort a.txt) <(sort b.txt)",
+    "exec 3>>/tmp/shell.log",
+    "echo checkpoint >&3",
+    "wc -l <<EOF",
+    "cd /usr/local/share/doc",
+    "path /bin /usr/bin /usr/local/bin",
+    "gcc -O2 -Wall -Wextra -I../include -DNDEBUG -DVERSION=3 -c main.c lexer.c parser.c "
+    "eval.c builtins.c jobs.c history.c complete.c -o shell",
+    "tar -czf backup-2024-01-01.tar.gz /home/user/projects /home/user/notes > tar.log",
+    "find . -name '*.o' | xargs rm -f",
+};
+#define CORPUS_LINES (int)(sizeof(corpus) / sizeof(corpus[0]))
+
+// commands looked up in "path /bin": hits, a relative path and misses
+static const char *lookups[] = {"ls", "cat", "grep", "sort", "echo", "./worker", "nosuchcmd", "gcc"};
+#define LOOKUPS (int)(sizeof(lookups) / sizeof(lookups[0]))
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// timed region: wall time (less the cost of reading the clock) plus the
+// allocations made inside it
+struct sample
+{
+    double ns;
+    unsigned long allocs;
+    unsigned long bytes;
+};
+
+static double start_time;
+static double clock_cost;
+
+static void begin(void)
+{
+    alloc_count = alloc_bytes = 0;
+    counting = 1;
+    start_time = now_ns();
+}
+
+static void end(struct sample *s)
+{
+    s->ns += now_ns() - start_time - clock_cost;
+    counting = 0;
+    s->allocs += alloc_count;
+    s->bytes += alloc_bytes;
+}
+
+static void calibrate(void)
+{
+    struct sample s = {0};
+    for (int i = 0; i < 100000; i++)
+    {
+        begin();
+        end(&s);
+    }
+    clock_cost = s.ns / 100000;
+}
+
+static void report(const char *name, struct sample *s, double per)
+{
+    printf("%-24s %9.1f ns %8.2f allocs %9.1f bytes\n", name, s->ns / per,
+           s->allocs / per, s->bytes / per);
+}
+
+int main(int argc, char *argv[])
+{
+    int rounds = argc > 1 ? atoi(argv[1]) : 20000;
+    if (rounds < 1)
+    {
+        fprintf(stderr, "usage: %s [ROUNDS]\n", argv[0]);
+        return 1;
+    }
+    struct wish_ctx *ctx = wish_new();
+    if (!ctx)
+    {
+        perror("wish_new");
+        return 1;
+    }
+    calibrate();
+    double lines = (double)rounds * CORPUS_LINES;
+    printf("%d lines x %d rounds, per line (per lookup for search_path)\n", CORPUS_LINES, rounds);
+
+    // tokenize_input: the token array is the context's, the values are strdup()ed
+    struct sample s = {0};
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < CORPUS_LINES; i++)
+        {
+            int count;
+            begin();
+            Token *tokens = tokenize_input(ctx, corpus[i], &count);
+            end(&s);
+            free_tokens(tokens, count);
+        }
+    }
+    report("tokenize_input", &s, lines);
+
+    // parse_tokens / free_command_list over tokens made once up front
+    Token *tokens[CORPUS_LINES];
+    int counts[CORPUS_LINES];
+    for (int i = 0; i < CORPUS_LINES; i++)
+    {
+        Token *t = tokenize_input(ctx, corpus[i], &counts[i]);
+        tokens[i] = malloc(counts[i] * sizeof(Token));
+        memcpy(tokens[i], t, counts[i] * sizeof(Token));
+    }
+
+    struct sample parse = {0}, release = {0};
+    CommandList *lists[CORPUS_LINES];
+    for (int r = 0; r < rounds; r++)
+    {
+        begin();
+        for (int i = 0; i < CORPUS_LINES; i++)
+        {
+            lists[i] = parse_tokens(tokens[i], counts[i]);
+        }
+        end(&parse);
+
+        begin();
+        for (int i = 0; i < CORPUS_LINES; i++)
+        {
+            free_command_list(lists[i]);
+        }
+        end(&release);
+    }
+    report("parse_tokens", &parse, lines);
+    report("free_command_list", &release, lines);
+    for (int i = 0; i < CORPUS_LINES; i++)
+    {
+        free_tokens(tokens[i], counts[i]);
+        free(tokens[i]);
+    }
+
+    struct sample lookup = {0};
+    for (int r = 0; r < rounds; r++)
+    {
+        char path[PATH_MAX];
+        for (int i = 0; i < LOOKUPS; i++)
+        {
+            begin();
+            search_path(ctx, lookups[i], path, sizeof(path));
+            end(&lookup);
+        }
+    }
+    report("search_path", &lookup, (double)rounds * LOOKUPS);
+
+    // the tutorial: its tokenizer feeds parse_simple_command token by token
+    struct sample tutorial = {0};
+    for (int r = 0; r < rounds; r++)
+    {
+        for (int i = 0; i < CORPUS_LINES; i++)
+        {
+            char line[MAX_LINE];
+            size_t len = strlen(corpus[i]);
+            memcpy(line, corpus[i], len);
+            line[len++] = '\n';
+            line[len] = '\0';
+            struct source_s src = {.buffer = line, .bufsize = len, .curpos = INIT_SRC_POS};
+
+            begin();
+            struct node_s *cmd = parse_simple_command(tokenize(&src));
+            end(&tutorial);
+            free_node_tree(cmd);
+        }
+    }
+    report("parse_simple_command", &tutorial, lines);
+    wish_free(ctx);
+    return 0;
+}
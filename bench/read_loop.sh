@@ -0,0 +1,35 @@
+#!/bin/sh
+# "while read" over an N-line file in the tutorial shell: the file on stdin
+# with < (seekable, so read takes 64K at a time and moves the offset back)
+# against the same lines coming down a pipe (read has to go a byte at a
+# time so it never takes more than its line).
+#
+# usage: ./read_loop.sh [N]   (default 1000000)
+#
+# build: gcc -O2 ../tutorial/*.c ../shell_official/lineedit.c ../shell_official/complete.c -o tutorial_shell
+set -e
+
+N=${1:-1000000}
+SHELL_BIN=./tutorial_shell
+DATA=$(mktemp)
+trap 'rm -f "$DATA"' EXIT
+
+if [ ! -x "$SHELL_BIN" ]; then
+    echo "build the tutorial shell first (see the top of this file)" >&2
+    exit 1
+fi
+
+seq "$N" | awk '{ print "line " $1 " some words after it" }' > "$DATA"
+
+run()
+{
+    start=$(date +%s.%N)
+    echo "$2" | "$SHELL_BIN" > /dev/null 2>&1
+    end=$(date +%s.%N)
+    awk -v name="$1" -v s="$start" -v e="$end" -v n="$N" 'BEGIN {
+        printf "%-22s %8d lines %8.3f s %8.0f ns/line\n", name, n, e - s, (e - s) * 1e9 / n
+    }'
+}
+
+run 'read < file' "while read a b c; do ((n++)); done < $DATA"
+run 'cat file | read' "cat $DATA | while read a b c; do ((n++)); done"
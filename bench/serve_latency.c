@@ -0,0 +1,141 @@
+// Per-job latency of "wish --serve" vs. starting a wish per job: the same
+// command line run N times, once as a request to a running server (one
+// connection, one request after the other), once as "wish FILE" with the
+// line in FILE (fork, exec, path setup, then the line itself). Reports
+// p50/p90/p99 round trip times in microseconds.
+//
+// build: gcc -O2 serve_latency.c ../shell_official/frame.c -o serve_latency
+// usage: ./serve_latency WISH SOCKET [JOBS [LINE]]
+//        (start "WISH --serve SOCKET" first; default 2000 jobs of "true")
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include "../shell_official/frame.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static int cmp_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *name, double *us, int n)
+{
+    qsort(us, n, sizeof(double), cmp_double);
+    printf("%-14s p50 %8.1f us  p90 %8.1f us  p99 %8.1f us\n", name, us[n / 2], us[n * 9 / 10],
+           us[n * 99 / 100]);
+}
+
+// one request, its output thrown away; -1 if the connection broke
+static int request(int fd, const char *line)
+{
+    if (frame_write(fd, FRAME_LINE, line, strlen(line)) < 0)
+    {
+        return -1;
+    }
+    while (1)
+    {
+        char type;
+        char *data;
+        uint32_t len;
+        if (frame_read(fd, &type, &data, &len) < 0)
+        {
+            return -1;
+        }
+        free(data);
+        if (type == FRAME_STATUS)
+        {
+            return 0;
+        }
+    }
+}
+
+// the job the other way round: a new wish for the line, output to /dev/null
+static void spawn(const char *wish, const char *file)
+{
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        freopen("/dev/null", "w", stdout);
+        execl(wish, wish, file, (char *)NULL);
+        _exit(127);
+    }
+    waitpid(pid, NULL, 0);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "usage: %s WISH SOCKET [JOBS [LINE]]\n", argv[0]);
+        return 1;
+    }
+    const char *wish = argv[1];
+    int jobs = argc > 3 ? atoi(argv[3]) : 2000;
+    const char *line = argc > 4 ? argv[4] : "true";
+    if (jobs < 1)
+    {
+        fprintf(stderr, "usage: %s WISH SOCKET [JOBS [LINE]]\n", argv[0]);
+        return 1;
+    }
+
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, argv[2], sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        perror("connect");
+        return 1;
+    }
+
+    char file[] = "/tmp/serve_latency.XXXXXX";
+    int tmp = mkstemp(file);
+    if (tmp < 0 || write(tmp, line, strlen(line)) < 0 || write(tmp, "\n", 1) < 0)
+    {
+        perror("mkstemp");
+        return 1;
+    }
+    close(tmp);
+
+    double *us = malloc(jobs * sizeof(double));
+    printf("%d jobs of \"%s\"\n", jobs, line);
+
+    for (int i = 0; i < jobs; i++)
+    {
+        double start = now_us();
+        if (request(fd, line) < 0)
+        {
+            fprintf(stderr, "connection lost\n");
+            unlink(file);
+            return 1;
+        }
+        us[i] = now_us() - start;
+    }
+    report("wish --serve", us, jobs);
+
+    for (int i = 0; i < jobs; i++)
+    {
+        double start = now_us();
+        spawn(wish, file);
+        us[i] = now_us() - start;
+    }
+    report("wish FILE", us, jobs);
+
+    free(us);
+    close(fd);
+    unlink(file);
+    return 0;
+}
@@ -0,0 +1,41 @@
+#!/bin/sh
+# Modular scripts: a main script that runs a module CALLS times, where the
+# module is a few lines of builtins. "wish module" (a new shell started for
+# every call, the only way before source) against "source module" (run in
+# the calling shell) and "( source module )" (one forked subshell per call,
+# still isolated from the caller, but no exec and no start-up).
+#
+# usage: ./source_module.sh [CALLS]   (default 2000)
+#
+# build: gcc -O2 ../shell_official/main.c ../shell_official/wish.c ../shell_official/lineedit.c ../shell_official/complete.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c ../shell_official/frame.c ../shell_official/serve.c -o wish
+set -e
+
+CALLS=${1:-2000}
+WISH=$(pwd)/wish
+
+if [ ! -x "$WISH" ]; then
+    echo "build wish first (see the top of this file)" >&2
+    exit 1
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+yes 'path /bin /usr/bin /usr/local/bin /sbin /usr/sbin /opt/bin' | head -n 10 > "$DIR/module"
+yes "$WISH $DIR/module" | head -n "$CALLS" > "$DIR/spawn"
+yes "source $DIR/module" | head -n "$CALLS" > "$DIR/source"
+yes "( source $DIR/module )" | head -n "$CALLS" > "$DIR/subshell"
+
+run()
+{
+    start=$(date +%s.%N)
+    "$WISH" "$DIR/$2"
+    end=$(date +%s.%N)
+    awk -v name="$1" -v s="$start" -v e="$end" -v calls="$CALLS" 'BEGIN {
+        printf "%-20s %7.3f s  %9.0f ns/call\n", name, e - s, (e - s) * 1e9 / calls
+    }'
+}
+
+echo "$CALLS calls of a 10-line module"
+run "wish module" spawn
+run "source module" source
+run "( source module )" subshell
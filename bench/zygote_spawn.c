@@ -0,0 +1,74 @@
+// Spawn latency as the shell grows: libwish runs "true" with and without a
+// zygote (-z) while the process holds more and more touched heap, standing
+// in for big caches. fork() copies the page tables of the process calling
+// it, so forking from the shell gets slower with its size; the zygote was
+// forked before the heap grew and stays small. Reports the mean per command.
+//
+// build: gcc -O2 -I../shell_official zygote_spawn.c ../shell_official/wish.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c -o zygote_spawn
+// usage: ./zygote_spawn [RUNS]   (default 500 commands per size)
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "wish.h"
+
+static double now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+static double time_spawns(struct wish_ctx *ctx, int runs)
+{
+    static const char line[] = "true";
+    double start = now_us();
+    for (int i = 0; i < runs; i++)
+    {
+        wish_run_line(ctx, line, sizeof(line) - 1);
+    }
+    return (now_us() - start) / runs;
+}
+
+int main(int argc, char *argv[])
+{
+    int runs = argc > 1 ? atoi(argv[1]) : 500;
+    if (runs < 1)
+    {
+        fprintf(stderr, "usage: %s [RUNS]\n", argv[0]);
+        return 1;
+    }
+
+    // both contexts exist before the heap grows; the zygote is forked now
+    struct wish_ctx *forking = wish_new();
+    struct wish_ctx *zygote = wish_new();
+    if (!forking || !zygote || wish_set_zygote(zygote, 1) < 0)
+    {
+        fprintf(stderr, "couldn't set up the contexts\n");
+        return 1;
+    }
+
+    static const size_t sizes_mb[] = {0, 64, 256, 1024};
+    size_t held = 0;
+    printf("%8s %14s %14s\n", "heap", "fork (us)", "zygote (us)");
+    for (size_t i = 0; i < sizeof(sizes_mb) / sizeof(sizes_mb[0]); i++)
+    {
+        size_t grow = (sizes_mb[i] << 20) - held;
+        if (grow > 0)
+        {
+            char *ballast = malloc(grow); // never freed: it's the point
+            if (!ballast)
+            {
+                fprintf(stderr, "out of memory at %zu MB\n", sizes_mb[i]);
+                break;
+            }
+            memset(ballast, 1, grow);
+            held += grow;
+        }
+        printf("%6zuMB %14.1f %14.1f\n", sizes_mb[i], time_spawns(forking, runs), time_spawns(zygote, runs));
+    }
+
+    wish_free(forking);
+    wish_free(zygote);
+    return 0;
+}
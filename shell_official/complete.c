@@ -0,0 +1,496 @@
+#define _DEFAULT_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "complete.h"
+
+// trie nodes live in one array per directory and point at each other by
+// index, so building is a handful of reallocs and a walk stays cache friendly
+struct trie_node
+{
+    char c;
+    char terminal;   // a name ends here
+    uint32_t child;  // first child (0 = none, node 0 is the root)
+    uint32_t sibling; // next child of the same parent, kept sorted by c
+};
+
+struct dir_trie
+{
+    char *dir;
+    int loaded;
+    struct timespec mtime; // dir mtime when the trie was built
+    struct trie_node *nodes;
+    uint32_t count;
+    uint32_t cap;
+};
+
+// readdir snapshot of the current directory
+struct dir_entry
+{
+    char *name;
+    int is_dir;
+};
+
+struct dir_snapshot
+{
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    struct dir_entry *entries; // sorted by name
+    size_t count;
+};
+
+static struct dir_trie *tries = NULL;
+static int trie_count = 0;
+static struct dir_snapshot cwd_snapshot = {0};
+
+// ---------------------------------------------------------------------------
+// command names: one trie per path directory
+// ---------------------------------------------------------------------------
+
+static uint32_t trie_new_node(struct dir_trie *t, char c)
+{
+    if (t->count == t->cap)
+    {
+        uint32_t cap = t->cap ? t->cap * 2 : 256;
+        struct trie_node *nodes = realloc(t->nodes, cap * sizeof(struct trie_node));
+        if (!nodes)
+        {
+            return 0;
+        }
+        t->nodes = nodes;
+        t->cap = cap;
+    }
+    struct trie_node *node = &t->nodes[t->count];
+    node->c = c;
+    node->terminal = 0;
+    node->child = 0;
+    node->sibling = 0;
+    return t->count++;
+}
+
+static void trie_insert(struct dir_trie *t, const char *name)
+{
+    uint32_t node = 0;
+    for (const char *p = name; *p; p++)
+    {
+        // find the child for *p, or the sorted spot to link a new one in
+        uint32_t prev = 0, cur = t->nodes[node].child;
+        while (cur && (unsigned char)t->nodes[cur].c < (unsigned char)*p)
+        {
+            prev = cur;
+            cur = t->nodes[cur].sibling;
+        }
+
+        if (!cur || t->nodes[cur].c != *p)
+        {
+            uint32_t added = trie_new_node(t, *p);
+            if (!added)
+            {
+                return;
+            }
+            t->nodes[added].sibling = cur;
+            if (prev)
+            {
+                t->nodes[prev].sibling = added;
+            }
+            else
+            {
+                t->nodes[node].child = added;
+            }
+            cur = added;
+        }
+        node = cur;
+    }
+    t->nodes[node].terminal = 1;
+}
+
+static void trie_load(struct dir_trie *t)
+{
+    t->count = 0;
+    t->loaded = 1;
+    trie_new_node(t, '\0'); // root
+    if (t->count == 0)
+    {
+        return;
+    }
+
+    DIR *dp = opendir(t->dir);
+    if (!dp)
+    {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dp)))
+    {
+        if (ent->d_name[0] == '.')
+        {
+            continue;
+        }
+        // executables only; the trie is built once per dir change so the
+        // check is paid here and not on every tab
+        if (faccessat(dirfd(dp), ent->d_name, X_OK, 0) != 0)
+        {
+            continue;
+        }
+        struct stat st;
+        if (ent->d_type != DT_REG &&
+            (fstatat(dirfd(dp), ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode)))
+        {
+            continue;
+        }
+        trie_insert(t, ent->d_name);
+    }
+    closedir(dp);
+}
+
+static void trie_revalidate(struct dir_trie *t)
+{
+    struct stat st;
+    if (stat(t->dir, &st) != 0)
+    {
+        t->count = 0;
+        t->loaded = 1;
+        return;
+    }
+    if (!t->loaded || st.st_mtim.tv_sec != t->mtime.tv_sec ||
+        st.st_mtim.tv_nsec != t->mtime.tv_nsec)
+    {
+        trie_load(t);
+        t->mtime = st.st_mtim;
+    }
+}
+
+// depth-first walk below node, emitting names in sorted order
+static void trie_collect(struct dir_trie *t, uint32_t node, char *name, size_t len,
+                         struct le_completions *lc)
+{
+    if (t->nodes[node].terminal)
+    {
+        le_add_completion(lc, name, len);
+    }
+    if (len + 1 >= NAME_MAX)
+    {
+        return;
+    }
+    for (uint32_t c = t->nodes[node].child; c; c = t->nodes[c].sibling)
+    {
+        name[len] = t->nodes[c].c;
+        trie_collect(t, c, name, len + 1, lc);
+    }
+}
+
+static void trie_complete(struct dir_trie *t, const char *prefix, size_t plen,
+                          struct le_completions *lc)
+{
+    if (t->count == 0 || plen >= NAME_MAX)
+    {
+        return;
+    }
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < plen; i++)
+    {
+        uint32_t c = t->nodes[node].child;
+        while (c && t->nodes[c].c != prefix[i])
+        {
+            c = t->nodes[c].sibling;
+        }
+        if (!c)
+        {
+            return;
+        }
+        node = c;
+    }
+
+    char name[NAME_MAX + 1];
+    memcpy(name, prefix, plen);
+    trie_collect(t, node, name, plen, lc);
+}
+
+void complete_set_paths(char **paths, int count)
+{
+    // keep the tries of directories that are still in the path
+    struct dir_trie *next = calloc(count > 0 ? count : 1, sizeof(struct dir_trie));
+    if (!next)
+    {
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < trie_count; j++)
+        {
+            if (tries[j].dir && strcmp(tries[j].dir, paths[i]) == 0)
+            {
+                next[i] = tries[j];
+                tries[j].dir = NULL;
+                tries[j].nodes = NULL;
+                break;
+            }
+        }
+        if (!next[i].dir)
+        {
+            next[i].dir = strdup(paths[i]);
+        }
+    }
+
+    for (int j = 0; j < trie_count; j++)
+    {
+        free(tries[j].dir);
+        free(tries[j].nodes);
+    }
+    free(tries);
+    tries = next;
+    trie_count = count;
+}
+
+static int compare_items(const void *a, const void *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+static void complete_command(const char *word, size_t wlen, struct le_completions *lc)
+{
+    if (wlen == 0)
+    {
+        return; // listing every executable is never what anyone wants
+    }
+
+    int sources = 0;
+    for (int i = 0; i < trie_count; i++)
+    {
+        if (!tries[i].dir)
+        {
+            continue;
+        }
+        size_t before = lc->count;
+        trie_revalidate(&tries[i]);
+        trie_complete(&tries[i], word, wlen, lc);
+        sources += lc->count > before;
+    }
+
+    // each trie yields sorted names; only a mix of directories needs
+    // sorting, since the same name can be in several of them
+    if (sources < 2)
+    {
+        return;
+    }
+    qsort(lc->items, lc->count, sizeof(char *), compare_items);
+    size_t out = 0;
+    for (size_t i = 0; i < lc->count; i++)
+    {
+        if (out > 0 && strcmp(lc->items[out - 1], lc->items[i]) == 0)
+        {
+            free(lc->items[i]);
+            continue;
+        }
+        lc->items[out++] = lc->items[i];
+    }
+    lc->count = out;
+}
+
+// ---------------------------------------------------------------------------
+// file names: the current directory is cached, others are read on demand
+// ---------------------------------------------------------------------------
+
+static int compare_entries(const void *a, const void *b)
+{
+    return strcmp(((const struct dir_entry *)a)->name, ((const struct dir_entry *)b)->name);
+}
+
+static void snapshot_free(struct dir_snapshot *snap)
+{
+    for (size_t i = 0; i < snap->count; i++)
+    {
+        free(snap->entries[i].name);
+    }
+    free(snap->entries);
+    snap->entries = NULL;
+    snap->count = 0;
+    snap->valid = 0;
+}
+
+static void snapshot_load(struct dir_snapshot *snap, const char *dir)
+{
+    snapshot_free(snap);
+
+    DIR *dp = opendir(dir);
+    if (!dp)
+    {
+        return;
+    }
+
+    size_t cap = 0;
+    struct dirent *ent;
+    while ((ent = readdir(dp)))
+    {
+        if (strcmp(ent->d_name, ".") == 0 || strcmp(ent->d_name, "..") == 0)
+        {
+            continue;
+        }
+        if (snap->count == cap)
+        {
+            cap = cap ? cap * 2 : 64;
+            struct dir_entry *entries = realloc(snap->entries, cap * sizeof(struct dir_entry));
+            if (!entries)
+            {
+                break;
+            }
+            snap->entries = entries;
+        }
+
+        int is_dir = ent->d_type == DT_DIR;
+        if (ent->d_type == DT_LNK || ent->d_type == DT_UNKNOWN)
+        {
+            struct stat st;
+            is_dir = fstatat(dirfd(dp), ent->d_name, &st, 0) == 0 && S_ISDIR(st.st_mode);
+        }
+
+        char *name = strdup(ent->d_name);
+        if (!name)
+        {
+            break;
+        }
+        snap->entries[snap->count].name = name;
+        snap->entries[snap->count].is_dir = is_dir;
+        snap->count++;
+    }
+    closedir(dp);
+
+    qsort(snap->entries, snap->count, sizeof(struct dir_entry), compare_entries);
+    snap->valid = 1;
+}
+
+// the cwd snapshot is reused until we change directory or its mtime moves
+static struct dir_snapshot *cwd_entries(void)
+{
+    struct stat st;
+    if (stat(".", &st) != 0)
+    {
+        snapshot_free(&cwd_snapshot);
+        return &cwd_snapshot;
+    }
+    if (!cwd_snapshot.valid || st.st_dev != cwd_snapshot.dev || st.st_ino != cwd_snapshot.ino ||
+        st.st_mtim.tv_sec != cwd_snapshot.mtime.tv_sec ||
+        st.st_mtim.tv_nsec != cwd_snapshot.mtime.tv_nsec)
+    {
+        snapshot_load(&cwd_snapshot, ".");
+        cwd_snapshot.dev = st.st_dev;
+        cwd_snapshot.ino = st.st_ino;
+        cwd_snapshot.mtime = st.st_mtim;
+    }
+    return &cwd_snapshot;
+}
+
+static void complete_file(const char *word, size_t wlen, struct le_completions *lc)
+{
+    // split "some/dir/pre" into the directory part and the name prefix
+    const char *slash = NULL;
+    for (size_t i = 0; i < wlen; i++)
+    {
+        if (word[i] == '/')
+        {
+            slash = word + i;
+        }
+    }
+
+    size_t dlen = slash ? (size_t)(slash - word) + 1 : 0;
+    const char *prefix = word + dlen;
+    size_t plen = wlen - dlen;
+
+    struct dir_snapshot other = {0};
+    struct dir_snapshot *snap;
+    if (dlen == 0)
+    {
+        snap = cwd_entries();
+    }
+    else
+    {
+        char dir[dlen + 1];
+        memcpy(dir, word, dlen);
+        dir[dlen] = '\0';
+        snapshot_load(&other, dir);
+        snap = &other;
+    }
+
+    // entries are sorted: binary search for the first name >= prefix
+    size_t lo = 0, hi = snap->count;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (strncmp(snap->entries[mid].name, prefix, plen) < 0)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    for (size_t i = lo; i < snap->count && strncmp(snap->entries[i].name, prefix, plen) == 0; i++)
+    {
+        struct dir_entry *e = &snap->entries[i];
+        if (e->name[0] == '.' && (plen == 0 || prefix[0] != '.'))
+        {
+            continue; // hidden unless asked for
+        }
+
+        size_t nlen = strlen(e->name);
+        char item[dlen + nlen + 2];
+        memcpy(item, word, dlen);
+        memcpy(item + dlen, e->name, nlen);
+        if (e->is_dir)
+        {
+            item[dlen + nlen++] = '/';
+        }
+        le_add_completion(lc, item, dlen + nlen);
+    }
+
+    snapshot_free(&other);
+}
+
+// ---------------------------------------------------------------------------
+
+static int is_separator(char c)
+{
+    return c == ' ' || c == '\t' || c == '|' || c == '<' || c == '>' || c == '&' || c == ';';
+}
+
+void complete_line(const char *line, size_t pos, struct le_completions *lc)
+{
+    size_t start = pos;
+    while (start > 0 && !is_separator(line[start - 1]))
+    {
+        start--;
+    }
+    lc->word_start = start;
+
+    // command position: first word of the line or right after | & ; ( or {
+    size_t before = start;
+    while (before > 0 && (line[before - 1] == ' ' || line[before - 1] == '\t'))
+    {
+        before--;
+    }
+    int command_pos = before == 0 || strchr("|&;({", line[before - 1]);
+
+    const char *word = line + start;
+    size_t wlen = pos - start;
+    if (command_pos && !memchr(word, '/', wlen))
+    {
+        complete_command(word, wlen, lc);
+    }
+    else
+    {
+        complete_file(word, wlen, lc);
+    }
+}
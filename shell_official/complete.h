@@ -0,0 +1,14 @@
+#ifndef COMPLETE_H
+#define COMPLETE_H
+
+#include <stddef.h>
+#include "lineedit.h"
+
+// tells the completer which directories hold commands (the shell's path)
+void complete_set_paths(char **paths, int count);
+
+// completion callback for the line editor: command names in command
+// position, file names everywhere else
+void complete_line(const char *line, size_t pos, struct le_completions *lc);
+
+#endif
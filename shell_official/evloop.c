@@ -0,0 +1,337 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "evloop.h"
+
+#define EV_MAX_EVENTS 64
+// without pidfd_open (kernels before 5.3) children are polled this often
+#define EV_CHILD_POLL_MS 10
+
+enum watch_type
+{
+    WATCH_FREE,
+    WATCH_FD,
+    WATCH_CHILD,
+    WATCH_TIMER,
+};
+
+struct watch
+{
+    enum watch_type type;
+    uint32_t gen; // bumped on every reuse so stale epoll events are ignored
+    int fd;       // the fd, pidfd or timerfd (-1 for a polled child)
+    pid_t pid;
+    union
+    {
+        ev_fd_cb fd;
+        ev_child_cb child;
+        ev_timer_cb timer;
+    } cb;
+    void *arg;
+};
+
+struct evloop
+{
+    int epfd;
+    struct watch *watches;
+    int count; // slots in use, including free ones below the last used
+    int cap;
+    int active;          // watches that aren't free
+    int children;        // children not reaped yet
+    int polled_children; // children without a pidfd
+};
+
+struct evloop *ev_new(void)
+{
+    struct evloop *loop = calloc(1, sizeof(struct evloop));
+    if (!loop)
+    {
+        return NULL;
+    }
+    loop->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (loop->epfd < 0)
+    {
+        free(loop);
+        return NULL;
+    }
+    return loop;
+}
+
+void ev_free(struct evloop *loop)
+{
+    if (!loop)
+    {
+        return;
+    }
+    for (int i = 0; i < loop->count; i++)
+    {
+        struct watch *w = &loop->watches[i];
+        if ((w->type == WATCH_CHILD || w->type == WATCH_TIMER) && w->fd >= 0)
+        {
+            close(w->fd);
+        }
+    }
+    close(loop->epfd);
+    free(loop->watches);
+    free(loop);
+}
+
+static int new_watch(struct evloop *loop, enum watch_type type, int fd, void *arg)
+{
+    int index = -1;
+    for (int i = 0; i < loop->count; i++)
+    {
+        if (loop->watches[i].type == WATCH_FREE)
+        {
+            index = i;
+            break;
+        }
+    }
+
+    if (index < 0)
+    {
+        if (loop->count == loop->cap)
+        {
+            int cap = loop->cap ? loop->cap * 2 : 32;
+            struct watch *watches = realloc(loop->watches, cap * sizeof(struct watch));
+            if (!watches)
+            {
+                return -1;
+            }
+            memset(watches + loop->cap, 0, (cap - loop->cap) * sizeof(struct watch));
+            loop->watches = watches;
+            loop->cap = cap;
+        }
+        index = loop->count++;
+    }
+
+    struct watch *w = &loop->watches[index];
+    w->type = type;
+    w->gen++;
+    w->fd = fd;
+    w->pid = 0;
+    w->arg = arg;
+
+    if (fd >= 0)
+    {
+        struct epoll_event ev = {.events = EPOLLIN, .data.u64 = (uint64_t)w->gen << 32 | index};
+        if (epoll_ctl(loop->epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+        {
+            w->type = WATCH_FREE;
+            return -1;
+        }
+    }
+    loop->active++;
+    return index;
+}
+
+static void free_watch(struct evloop *loop, int index)
+{
+    struct watch *w = &loop->watches[index];
+    if (w->fd >= 0)
+    {
+        epoll_ctl(loop->epfd, EPOLL_CTL_DEL, w->fd, NULL);
+        if (w->type != WATCH_FD)
+        {
+            close(w->fd); // pidfds and timerfds belong to the loop
+        }
+    }
+    w->type = WATCH_FREE;
+    w->fd = -1;
+    w->gen++;
+    loop->active--;
+}
+
+int ev_add_fd(struct evloop *loop, int fd, ev_fd_cb cb, void *arg)
+{
+    int index = new_watch(loop, WATCH_FD, fd, arg);
+    if (index < 0)
+    {
+        return -1;
+    }
+    loop->watches[index].cb.fd = cb;
+    return 0;
+}
+
+void ev_del_fd(struct evloop *loop, int fd)
+{
+    for (int i = 0; i < loop->count; i++)
+    {
+        if (loop->watches[i].type == WATCH_FD && loop->watches[i].fd == fd)
+        {
+            free_watch(loop, i);
+            return;
+        }
+    }
+}
+
+int ev_add_child(struct evloop *loop, pid_t pid, ev_child_cb cb, void *arg)
+{
+    // a pidfd becomes readable when the process exits
+    int pidfd = syscall(SYS_pidfd_open, pid, 0);
+    int index = new_watch(loop, WATCH_CHILD, pidfd, arg);
+    if (index < 0)
+    {
+        if (pidfd >= 0)
+        {
+            close(pidfd);
+        }
+        return -1;
+    }
+    loop->watches[index].pid = pid;
+    loop->watches[index].cb.child = cb;
+    loop->children++;
+    if (pidfd < 0)
+    {
+        loop->polled_children++;
+    }
+    return 0;
+}
+
+int ev_add_timer(struct evloop *loop, long ms, ev_timer_cb cb, void *arg)
+{
+    int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (tfd < 0)
+    {
+        return -1;
+    }
+
+    struct itimerspec spec = {0};
+    spec.it_value.tv_sec = ms / 1000;
+    spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+    if (ms <= 0)
+    {
+        spec.it_value.tv_nsec = 1; // zero would disarm it
+    }
+    if (timerfd_settime(tfd, 0, &spec, NULL) < 0)
+    {
+        close(tfd);
+        return -1;
+    }
+
+    int index = new_watch(loop, WATCH_TIMER, tfd, arg);
+    if (index < 0)
+    {
+        close(tfd);
+        return -1;
+    }
+    loop->watches[index].cb.timer = cb;
+    return (int)(loop->watches[index].gen & 0x7fff) << 16 | index;
+}
+
+void ev_cancel_timer(struct evloop *loop, int id)
+{
+    int index = id & 0xffff;
+    if (id < 0 || index >= loop->count)
+    {
+        return;
+    }
+    struct watch *w = &loop->watches[index];
+    if (w->type == WATCH_TIMER && (int)(w->gen & 0x7fff) == id >> 16)
+    {
+        free_watch(loop, index);
+    }
+}
+
+// returns 1 if the child was reaped (and its callback made)
+static int reap_child(struct evloop *loop, int index)
+{
+    struct watch *w = &loop->watches[index];
+    int status = 0;
+    pid_t got = waitpid(w->pid, &status, WNOHANG);
+    if (got == 0 || (got < 0 && errno == EINTR))
+    {
+        return 0;
+    }
+    if (got < 0)
+    {
+        // never seen exiting (someone else reaped it): not a success
+        status = EV_LOST_STATUS;
+    }
+
+    pid_t pid = w->pid;
+    ev_child_cb cb = w->cb.child;
+    void *arg = w->arg;
+    if (w->fd < 0)
+    {
+        loop->polled_children--;
+    }
+    loop->children--;
+    free_watch(loop, index);
+
+    cb(loop, pid, status, arg);
+    return 1;
+}
+
+int ev_run_once(struct evloop *loop, int timeout_ms)
+{
+    if (loop->active == 0)
+    {
+        return 0;
+    }
+    if (loop->polled_children > 0 && (timeout_ms < 0 || timeout_ms > EV_CHILD_POLL_MS))
+    {
+        timeout_ms = EV_CHILD_POLL_MS;
+    }
+
+    struct epoll_event events[EV_MAX_EVENTS];
+    int n = epoll_wait(loop->epfd, events, EV_MAX_EVENTS, timeout_ms);
+    int calls = 0;
+
+    for (int i = 0; i < n; i++)
+    {
+        int index = events[i].data.u64 & 0xffffffff;
+        uint32_t gen = events[i].data.u64 >> 32;
+        if (index >= loop->count || loop->watches[index].gen != gen)
+        {
+            continue; // removed by an earlier callback in this batch
+        }
+
+        struct watch *w = &loop->watches[index];
+        if (w->type == WATCH_FD)
+        {
+            w->cb.fd(loop, w->fd, w->arg);
+            calls++;
+        }
+        else if (w->type == WATCH_CHILD)
+        {
+            calls += reap_child(loop, index);
+        }
+        else if (w->type == WATCH_TIMER)
+        {
+            uint64_t expirations;
+            ev_timer_cb cb = w->cb.timer;
+            void *arg = w->arg;
+            if (read(w->fd, &expirations, sizeof(expirations)) < 0 && errno == EAGAIN)
+            {
+                continue;
+            }
+            free_watch(loop, index); // one-shot
+            cb(loop, arg);
+            calls++;
+        }
+    }
+
+    for (int i = 0; loop->polled_children > 0 && i < loop->count; i++)
+    {
+        if (loop->watches[i].type == WATCH_CHILD && loop->watches[i].fd < 0)
+        {
+            calls += reap_child(loop, i);
+        }
+    }
+    return calls;
+}
+
+int ev_children(struct evloop *loop)
+{
+    return loop->children;
+}
@@ -0,0 +1,40 @@
+#ifndef EVLOOP_H
+#define EVLOOP_H
+
+#include <sys/types.h>
+
+// a single-threaded event loop over epoll: file descriptors, child processes
+// (through pidfds) and timers (through timerfds) are all just fds in the
+// same epoll set, so one wait covers every kind of event
+
+struct evloop;
+
+typedef void (*ev_fd_cb)(struct evloop *loop, int fd, void *arg);
+typedef void (*ev_child_cb)(struct evloop *loop, pid_t pid, int status, void *arg);
+typedef void (*ev_timer_cb)(struct evloop *loop, void *arg);
+
+struct evloop *ev_new(void);
+void ev_free(struct evloop *loop);
+
+// calls cb whenever fd is readable (or hung up) until ev_del_fd
+int ev_add_fd(struct evloop *loop, int fd, ev_fd_cb cb, void *arg);
+void ev_del_fd(struct evloop *loop, int fd);
+
+// reaps pid when it exits and calls cb with its raw wait status (once).
+// if waitpid() fails for it (it was reaped elsewhere), the status is
+// EV_LOST_STATUS, an exit with 127
+#define EV_LOST_STATUS (127 << 8) // W_EXITCODE(127, 0)
+int ev_add_child(struct evloop *loop, pid_t pid, ev_child_cb cb, void *arg);
+
+// calls cb once after ms milliseconds; returns an id for ev_cancel_timer
+int ev_add_timer(struct evloop *loop, long ms, ev_timer_cb cb, void *arg);
+void ev_cancel_timer(struct evloop *loop, int id);
+
+// waits for events (up to timeout_ms, -1 = until something happens) and
+// dispatches them; returns the number of callbacks made
+int ev_run_once(struct evloop *loop, int timeout_ms);
+
+// # of children not reaped yet
+int ev_children(struct evloop *loop);
+
+#endif
@@ -0,0 +1,97 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include "frame.h"
+
+// send() with MSG_NOSIGNAL: a client that went away is an error here, not
+// a SIGPIPE (ignoring SIGPIPE instead would carry over to every command)
+static int send_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = send(fd, data, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = read(fd, data, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
+
+int frame_write(int fd, char type, const void *data, uint32_t len)
+{
+    // header and payload in one send for small frames
+    char buf[4096];
+    uint32_t netlen = htonl(len);
+    buf[0] = type;
+    memcpy(buf + 1, &netlen, 4);
+    if (len <= sizeof(buf) - 5)
+    {
+        memcpy(buf + 5, data, len);
+        return send_all(fd, buf, 5 + len);
+    }
+    if (send_all(fd, buf, 5) < 0)
+    {
+        return -1;
+    }
+    return send_all(fd, data, len);
+}
+
+int frame_read(int fd, char *type, char **data, uint32_t *len)
+{
+    char header[5];
+    if (read_all(fd, header, 5) < 0)
+    {
+        return -1;
+    }
+    uint32_t netlen;
+    memcpy(&netlen, header + 1, 4);
+    *type = header[0];
+    *len = ntohl(netlen);
+    if (*len > FRAME_MAX)
+    {
+        return -1;
+    }
+
+    *data = malloc(*len + 1);
+    if (!*data)
+    {
+        return -1;
+    }
+    if (read_all(fd, *data, *len) < 0)
+    {
+        free(*data);
+        *data = NULL;
+        return -1;
+    }
+    (*data)[*len] = '\0';
+    return 0;
+}
@@ -0,0 +1,26 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdint.h>
+
+// the framing "wish --serve" speaks over its socket: a 1-byte type, a
+// 4-byte length in network order, then that many bytes of payload.
+// client -> server: FRAME_LINE, one per command line (here-document bodies
+// may follow its first newline). server -> client: any number of
+// FRAME_STDOUT / FRAME_STDERR chunks as the line runs, then FRAME_STATUS
+// with the exit status as a 4-byte network order integer
+#define FRAME_LINE 'L'
+#define FRAME_STDOUT 'O'
+#define FRAME_STDERR 'E'
+#define FRAME_STATUS 'X'
+
+#define FRAME_MAX (16 << 20) // longest payload accepted
+
+// 0 on success, -1 on error (never raises SIGPIPE)
+int frame_write(int fd, char type, const void *data, uint32_t len);
+
+// reads one frame; *data is malloc()ed and NUL-terminated. 0 on success,
+// -1 on EOF, error or an oversized frame
+int frame_read(int fd, char *type, char **data, uint32_t *len);
+
+#endif
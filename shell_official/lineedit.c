@@ -0,0 +1,977 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/uio.h>
+#include "lineedit.h"
+
+// history file is rewritten at startup once it holds this many stale lines
+#define HISTORY_COMPACT_LINES (2 * LE_HISTORY_MAX)
+// ctrl-r index: trigrams are hashed into this many posting lists
+#define NGRAM_BITS 18
+#define NGRAM_BUCKETS (1 << NGRAM_BITS)
+#define MAX_SEARCH_QUERY 256
+
+#define KEY_CTRL(c) ((c) & 0x1f)
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+static struct termios orig_termios;
+static int raw_enabled = 0;
+static int atexit_registered = 0;
+
+// history ring buffer: entry with sequence number s lives in slot s % MAX
+static char *history[LE_HISTORY_MAX];
+static unsigned long hist_next = 0; // sequence number of the next entry
+static int hist_fd = -1;            // history file, opened with O_APPEND
+
+// one posting list per trigram bucket, holding increasing sequence numbers
+struct posting
+{
+    unsigned long *seqs;
+    size_t start; // entries before start were overwritten in the ring
+    size_t len;
+    size_t cap;
+};
+
+static le_completion_fn completion_fn = NULL;
+
+static struct posting *ngram_index = NULL;
+static unsigned long ngram_indexed = 0; // entries below this are indexed
+
+struct le_state
+{
+    char *buf;
+    size_t len;
+    size_t cap;
+    size_t pos; // cursor position inside buf
+    const char *prompt;
+    size_t plen;
+};
+
+// ---------------------------------------------------------------------------
+// history ring buffer
+// ---------------------------------------------------------------------------
+
+static unsigned long hist_oldest(void)
+{
+    return hist_next > LE_HISTORY_MAX ? hist_next - LE_HISTORY_MAX : 0;
+}
+
+static const char *hist_get(unsigned long seq)
+{
+    return history[seq % LE_HISTORY_MAX];
+}
+
+static int hist_push(const char *line)
+{
+    char *copy = strdup(line);
+    if (!copy)
+    {
+        return 0;
+    }
+
+    size_t slot = hist_next % LE_HISTORY_MAX;
+    free(history[slot]);
+    history[slot] = copy;
+    hist_next++;
+    return 1;
+}
+
+static void compact_history_file(const char *filename)
+{
+    // keep only what is in the ring; write a temp file and swap it in
+    size_t tmplen = strlen(filename) + 5;
+    char tmp[tmplen];
+    snprintf(tmp, tmplen, "%s.tmp", filename);
+
+    FILE *out = fopen(tmp, "w");
+    if (!out)
+    {
+        return;
+    }
+    for (unsigned long s = hist_oldest(); s < hist_next; s++)
+    {
+        fprintf(out, "%s\n", hist_get(s));
+    }
+    if (fclose(out) == 0)
+    {
+        rename(tmp, filename);
+    }
+    else
+    {
+        unlink(tmp);
+    }
+}
+
+void le_history_init(const char *filename)
+{
+    if (!filename)
+    {
+        return;
+    }
+
+    FILE *file = fopen(filename, "r");
+    if (file)
+    {
+        char *line = NULL;
+        size_t cap = 0;
+        ssize_t n;
+        unsigned long lines = 0;
+
+        while ((n = getline(&line, &cap, file)) > 0)
+        {
+            if (line[n - 1] == '\n')
+            {
+                line[n - 1] = '\0';
+            }
+            if (line[0] != '\0')
+            {
+                hist_push(line);
+            }
+            lines++;
+        }
+        free(line);
+        fclose(file);
+
+        if (lines > HISTORY_COMPACT_LINES)
+        {
+            compact_history_file(filename);
+        }
+    }
+
+    hist_fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+}
+
+void le_history_add(const char *line)
+{
+    if (line[0] == '\0')
+    {
+        return;
+    }
+    // skip repeating the same command back to back
+    if (hist_next > 0 && strcmp(hist_get(hist_next - 1), line) == 0)
+    {
+        return;
+    }
+    if (!hist_push(line) || hist_fd < 0)
+    {
+        return;
+    }
+
+    // one append-only write per entry, so concurrent shells don't interleave
+    struct iovec iov[2] = {
+        {.iov_base = (void *)line, .iov_len = strlen(line)},
+        {.iov_base = "\n", .iov_len = 1},
+    };
+    if (writev(hist_fd, iov, 2) < 0)
+    {
+        close(hist_fd);
+        hist_fd = -1;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// ctrl-r search index
+//
+// every history entry is added to the posting list of each trigram it
+// contains. a query looks only at the entries under its rarest trigram and
+// confirms them with strstr, so the search doesn't degrade to a full scan of
+// the ring when the history is large. lists are appended to as entries are
+// added, and entries that fell out of the ring are trimmed lazily.
+// ---------------------------------------------------------------------------
+
+static size_t ngram_bucket(const char *p)
+{
+    uint32_t key = (unsigned char)p[0] | (unsigned char)p[1] << 8 | (unsigned char)p[2] << 16;
+    return (key * 2654435761u) >> (32 - NGRAM_BITS);
+}
+
+static void posting_trim(struct posting *pl, unsigned long oldest)
+{
+    while (pl->start < pl->len && pl->seqs[pl->start] < oldest)
+    {
+        pl->start++;
+    }
+    if (pl->start > pl->len / 2)
+    {
+        memmove(pl->seqs, pl->seqs + pl->start, (pl->len - pl->start) * sizeof(unsigned long));
+        pl->len -= pl->start;
+        pl->start = 0;
+    }
+}
+
+static void ngram_add(unsigned long seq, const char *line, unsigned long oldest)
+{
+    size_t len = strlen(line);
+    for (size_t i = 0; i + 3 <= len; i++)
+    {
+        struct posting *pl = &ngram_index[ngram_bucket(line + i)];
+
+        if (pl->len > pl->start && pl->seqs[pl->len - 1] == seq)
+        {
+            continue; // trigram repeated within the same line
+        }
+        posting_trim(pl, oldest);
+
+        if (pl->len == pl->cap)
+        {
+            size_t cap = pl->cap ? pl->cap * 2 : 4;
+            unsigned long *seqs = realloc(pl->seqs, cap * sizeof(unsigned long));
+            if (!seqs)
+            {
+                return;
+            }
+            pl->seqs = seqs;
+            pl->cap = cap;
+        }
+        pl->seqs[pl->len++] = seq;
+    }
+}
+
+// brings the index up to date with the ring (built on first use)
+static int ngram_sync(void)
+{
+    if (!ngram_index)
+    {
+        ngram_index = calloc(NGRAM_BUCKETS, sizeof(struct posting));
+        if (!ngram_index)
+        {
+            return 0;
+        }
+    }
+
+    unsigned long oldest = hist_oldest();
+    for (unsigned long s = ngram_indexed > oldest ? ngram_indexed : oldest; s < hist_next; s++)
+    {
+        ngram_add(s, hist_get(s), oldest);
+    }
+    ngram_indexed = hist_next;
+    return 1;
+}
+
+// finds the newest entry older than `before` that contains query
+static int hist_search(const char *query, unsigned long before, unsigned long *found)
+{
+    size_t qlen = strlen(query);
+    unsigned long oldest = hist_oldest();
+
+    if (before > hist_next)
+    {
+        before = hist_next;
+    }
+
+    // too short for a trigram (or no memory for the index): plain scan
+    if (qlen < 3 || !ngram_sync())
+    {
+        for (unsigned long s = before; s-- > oldest;)
+        {
+            if (strstr(hist_get(s), query))
+            {
+                *found = s;
+                return 1;
+            }
+        }
+        return 0;
+    }
+
+    // the rarest trigram of the query gives the shortest candidate list
+    struct posting *best = NULL;
+    for (size_t i = 0; i + 3 <= qlen; i++)
+    {
+        struct posting *pl = &ngram_index[ngram_bucket(query + i)];
+        if (!best || pl->len - pl->start < best->len - best->start)
+        {
+            best = pl;
+        }
+    }
+
+    // binary search for the first candidate not older than `before`
+    size_t lo = best->start, hi = best->len;
+    while (lo < hi)
+    {
+        size_t mid = lo + (hi - lo) / 2;
+        if (best->seqs[mid] < before)
+        {
+            lo = mid + 1;
+        }
+        else
+        {
+            hi = mid;
+        }
+    }
+
+    while (lo-- > best->start)
+    {
+        unsigned long s = best->seqs[lo];
+        if (s < oldest)
+        {
+            break;
+        }
+        if (strstr(hist_get(s), query))
+        {
+            *found = s;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// terminal handling
+// ---------------------------------------------------------------------------
+
+static void disable_raw_mode(void)
+{
+    if (raw_enabled)
+    {
+        tcsetattr(STDIN_FILENO, TCSADRAIN, &orig_termios);
+        raw_enabled = 0;
+    }
+}
+
+static int enable_raw_mode(void)
+{
+    if (raw_enabled)
+    {
+        return 1;
+    }
+    if (tcgetattr(STDIN_FILENO, &orig_termios) == -1)
+    {
+        return 0;
+    }
+    if (!atexit_registered)
+    {
+        atexit(disable_raw_mode);
+        atexit_registered = 1;
+    }
+
+    struct termios raw = orig_termios;
+    // no echo, no line buffering, no signals from ctrl-c/ctrl-z, no flow control
+    raw.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    raw.c_oflag &= ~(OPOST);
+    raw.c_cflag |= (CS8);
+    raw.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &raw) == -1)
+    {
+        return 0;
+    }
+    raw_enabled = 1;
+    return 1;
+}
+
+static int terminal_columns(void)
+{
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0)
+    {
+        return 80;
+    }
+    return ws.ws_col;
+}
+
+static void write_all(const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(STDOUT_FILENO, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static int read_key(void)
+{
+    unsigned char c;
+    while (1)
+    {
+        ssize_t n = read(STDIN_FILENO, &c, 1);
+        if (n == 1)
+        {
+            return c;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        return -1;
+    }
+}
+
+// redraws prompt + line, scrolling horizontally when it is wider than the terminal
+static void render(const char *prompt, size_t plen, const char *buf, size_t len, size_t pos)
+{
+    size_t cols = terminal_columns();
+    size_t start = 0;
+
+    if (plen + pos >= cols)
+    {
+        start = plen + pos - cols + 1;
+    }
+    size_t visible = len - start;
+    if (plen + visible > cols - 1)
+    {
+        visible = cols > plen + 1 ? cols - plen - 1 : 0;
+    }
+
+    char seq[32];
+    write_all("\r", 1);
+    write_all(prompt, plen);
+    write_all(buf + start, visible);
+    write_all("\x1b[0K", 4);
+    int n = snprintf(seq, sizeof(seq), "\r\x1b[%zuC", plen + pos - start);
+    write_all(seq, n);
+}
+
+static void refresh_line(struct le_state *st)
+{
+    render(st->prompt, st->plen, st->buf, st->len, st->pos);
+}
+
+// ---------------------------------------------------------------------------
+// editing
+// ---------------------------------------------------------------------------
+
+static int reserve(struct le_state *st, size_t extra)
+{
+    if (st->len + extra + 1 <= st->cap)
+    {
+        return 1;
+    }
+    size_t cap = st->cap ? st->cap : 128;
+    while (cap < st->len + extra + 1)
+    {
+        cap *= 2;
+    }
+    char *buf = realloc(st->buf, cap);
+    if (!buf)
+    {
+        return 0;
+    }
+    st->buf = buf;
+    st->cap = cap;
+    return 1;
+}
+
+static void set_line(struct le_state *st, const char *text)
+{
+    size_t len = strlen(text);
+    st->len = 0;
+    if (!reserve(st, len))
+    {
+        return;
+    }
+    memcpy(st->buf, text, len + 1);
+    st->len = st->pos = len;
+}
+
+static void insert_char(struct le_state *st, char c)
+{
+    if (!reserve(st, 1))
+    {
+        return;
+    }
+    memmove(st->buf + st->pos + 1, st->buf + st->pos, st->len - st->pos + 1);
+    st->buf[st->pos++] = c;
+    st->len++;
+}
+
+static void delete_range(struct le_state *st, size_t from, size_t to)
+{
+    memmove(st->buf + from, st->buf + to, st->len - to + 1);
+    st->len -= to - from;
+    st->pos = from;
+}
+
+// ctrl-r: returns the key that ended the search so the caller can act on it,
+// or 0 when the search was cancelled
+static int reverse_search(struct le_state *st)
+{
+    char query[MAX_SEARCH_QUERY];
+    size_t qlen = 0;
+    unsigned long match = 0;
+    int have_match = 0, failed = 0;
+    size_t match_pos = 0;
+
+    char *saved = strdup(st->buf);
+    query[0] = '\0';
+
+    while (1)
+    {
+        // render "(reverse-i-search)`query': match"
+        char prompt[MAX_SEARCH_QUERY + 32];
+        int plen = snprintf(prompt, sizeof(prompt), "(%sreverse-i-search)`%s': ",
+                            failed ? "failed " : "", query);
+        const char *line = have_match ? hist_get(match) : "";
+        render(prompt, plen, line, strlen(line), have_match ? match_pos : 0);
+
+        int c = read_key();
+        unsigned long before = hist_next;
+        int search = 0;
+
+        if (c == KEY_CTRL('r'))
+        {
+            before = have_match ? match : hist_next; // next older match
+            search = qlen > 0;
+        }
+        else if (c == KEY_BACKSPACE || c == KEY_CTRL('h'))
+        {
+            if (qlen > 0)
+            {
+                query[--qlen] = '\0';
+            }
+            have_match = 0;
+            search = qlen > 0;
+        }
+        else if (c == KEY_CTRL('g') || c == KEY_CTRL('c'))
+        {
+            if (saved)
+            {
+                set_line(st, saved);
+            }
+            free(saved);
+            return 0;
+        }
+        else if (c >= 32 && c < 127 && qlen + 1 < MAX_SEARCH_QUERY)
+        {
+            query[qlen++] = c;
+            query[qlen] = '\0';
+            before = have_match ? match + 1 : hist_next; // current match may still fit
+            search = 1;
+        }
+        else
+        {
+            // any other key accepts the match and is handled by the editor
+            if (have_match)
+            {
+                set_line(st, hist_get(match));
+                st->pos = match_pos;
+            }
+            free(saved);
+            return c;
+        }
+
+        if (search)
+        {
+            unsigned long found;
+            failed = !hist_search(query, before, &found);
+            if (!failed)
+            {
+                match = found;
+                have_match = 1;
+                match_pos = strstr(hist_get(match), query) - hist_get(match);
+            }
+        }
+        else
+        {
+            failed = 0;
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+// tab completion
+// ---------------------------------------------------------------------------
+
+void le_set_completion(le_completion_fn fn)
+{
+    completion_fn = fn;
+}
+
+void le_add_completion(struct le_completions *lc, const char *item, size_t len)
+{
+    if (lc->count == lc->cap)
+    {
+        size_t cap = lc->cap ? lc->cap * 2 : 16;
+        char **items = realloc(lc->items, cap * sizeof(char *));
+        if (!items)
+        {
+            return;
+        }
+        lc->items = items;
+        lc->cap = cap;
+    }
+
+    char *copy = malloc(len + 1);
+    if (!copy)
+    {
+        return;
+    }
+    memcpy(copy, item, len);
+    copy[len] = '\0';
+    lc->items[lc->count++] = copy;
+}
+
+static void free_completions(struct le_completions *lc)
+{
+    for (size_t i = 0; i < lc->count; i++)
+    {
+        free(lc->items[i]);
+    }
+    free(lc->items);
+}
+
+static void list_completions(struct le_completions *lc)
+{
+    size_t width = 0;
+    for (size_t i = 0; i < lc->count; i++)
+    {
+        size_t len = strlen(lc->items[i]);
+        if (len > width)
+        {
+            width = len;
+        }
+    }
+    width += 2;
+
+    size_t per_row = terminal_columns() / width;
+    if (per_row == 0)
+    {
+        per_row = 1;
+    }
+
+    write_all("\r\n", 2);
+    for (size_t i = 0; i < lc->count; i++)
+    {
+        size_t len = strlen(lc->items[i]);
+        write_all(lc->items[i], len);
+        if ((i + 1) % per_row == 0 || i + 1 == lc->count)
+        {
+            write_all("\r\n", 2);
+        }
+        else
+        {
+            for (size_t pad = len; pad < width; pad++)
+            {
+                write_all(" ", 1);
+            }
+        }
+    }
+}
+
+// extends the word under the cursor to the longest prefix shared by all
+// candidates; a second tab with nothing left to add lists them instead
+static void complete_word(struct le_state *st, int repeated)
+{
+    struct le_completions lc = {0};
+    completion_fn(st->buf, st->pos, &lc);
+
+    if (lc.count == 0 || lc.word_start > st->pos)
+    {
+        write_all("\x07", 1);
+        free_completions(&lc);
+        return;
+    }
+
+    size_t common = strlen(lc.items[0]);
+    for (size_t i = 1; i < lc.count; i++)
+    {
+        size_t j = 0;
+        while (j < common && lc.items[i][j] == lc.items[0][j])
+        {
+            j++;
+        }
+        common = j;
+    }
+
+    size_t wlen = st->pos - lc.word_start;
+    if (common > wlen || (lc.count == 1 && common == wlen))
+    {
+        int space = lc.count == 1 && common > 0 && lc.items[0][common - 1] != '/';
+        if (reserve(st, common + space))
+        {
+            delete_range(st, lc.word_start, st->pos);
+            memmove(st->buf + st->pos + common, st->buf + st->pos, st->len - st->pos + 1);
+            memcpy(st->buf + st->pos, lc.items[0], common);
+            st->len += common;
+            st->pos += common;
+            if (space)
+            {
+                insert_char(st, ' ');
+            }
+        }
+    }
+    else if (repeated)
+    {
+        list_completions(&lc);
+    }
+    else
+    {
+        write_all("\x07", 1);
+    }
+    free_completions(&lc);
+}
+
+static char *read_line_fallback(const char *prompt)
+{
+    // not a terminal (or raw mode failed): plain buffered read
+    char *line = NULL;
+    size_t cap = 0;
+
+    fputs(prompt, stdout);
+    fflush(stdout);
+
+    ssize_t n = getline(&line, &cap, stdin);
+    if (n < 0)
+    {
+        free(line);
+        return NULL;
+    }
+    if (n > 0 && line[n - 1] == '\n')
+    {
+        line[n - 1] = '\0';
+    }
+    return line;
+}
+
+char *le_readline(const char *prompt)
+{
+    if (!isatty(STDIN_FILENO) || !enable_raw_mode())
+    {
+        return read_line_fallback(prompt);
+    }
+
+    struct le_state st = {.prompt = prompt, .plen = strlen(prompt)};
+    if (!reserve(&st, 0))
+    {
+        disable_raw_mode();
+        return NULL;
+    }
+    st.buf[0] = '\0';
+
+    // 0 is the line being edited, k is the k-th newest history entry
+    unsigned long hist_index = 0;
+    char *scratch = NULL; // the edited line while browsing history
+
+    int last_key = 0;
+
+    refresh_line(&st);
+
+    while (1)
+    {
+        int c = read_key();
+        int prev_key = last_key;
+        last_key = c;
+
+        if (c == KEY_CTRL('r'))
+        {
+            c = reverse_search(&st);
+            if (c == 0)
+            {
+                refresh_line(&st);
+                continue;
+            }
+        }
+
+        if (c < 0)
+        {
+            // input closed: hand back what we have, or EOF if nothing
+            disable_raw_mode();
+            free(scratch);
+            if (st.len == 0)
+            {
+                free(st.buf);
+                return NULL;
+            }
+            write_all("\n", 1);
+            return st.buf;
+        }
+
+        switch (c)
+        {
+        case '\r':
+        case '\n':
+            st.pos = st.len;
+            refresh_line(&st);
+            disable_raw_mode();
+            write_all("\n", 1);
+            free(scratch);
+            return st.buf;
+
+        case KEY_CTRL('c'):
+            write_all("^C\r\n", 4);
+            st.len = st.pos = 0;
+            st.buf[0] = '\0';
+            hist_index = 0;
+            break;
+
+        case KEY_CTRL('d'):
+            if (st.len == 0)
+            {
+                disable_raw_mode();
+                free(scratch);
+                free(st.buf);
+                return NULL;
+            }
+            if (st.pos < st.len)
+            {
+                delete_range(&st, st.pos, st.pos + 1);
+            }
+            break;
+
+        case KEY_BACKSPACE:
+        case KEY_CTRL('h'):
+            if (st.pos > 0)
+            {
+                delete_range(&st, st.pos - 1, st.pos);
+            }
+            break;
+
+        case KEY_CTRL('a'):
+            st.pos = 0;
+            break;
+
+        case KEY_CTRL('e'):
+            st.pos = st.len;
+            break;
+
+        case KEY_CTRL('b'):
+            if (st.pos > 0)
+            {
+                st.pos--;
+            }
+            break;
+
+        case KEY_CTRL('f'):
+            if (st.pos < st.len)
+            {
+                st.pos++;
+            }
+            break;
+
+        case KEY_CTRL('k'):
+            st.len = st.pos;
+            st.buf[st.len] = '\0';
+            break;
+
+        case KEY_CTRL('u'):
+            delete_range(&st, 0, st.pos);
+            break;
+
+        case KEY_CTRL('w'):
+        {
+            size_t from = st.pos;
+            while (from > 0 && st.buf[from - 1] == ' ')
+            {
+                from--;
+            }
+            while (from > 0 && st.buf[from - 1] != ' ')
+            {
+                from--;
+            }
+            delete_range(&st, from, st.pos);
+            break;
+        }
+
+        case '\t':
+            if (completion_fn)
+            {
+                complete_word(&st, prev_key == '\t');
+            }
+            break;
+
+        case KEY_CTRL('l'):
+            write_all("\x1b[H\x1b[2J", 7);
+            break;
+
+        case KEY_CTRL('p'):
+        case KEY_CTRL('n'):
+        case KEY_ESC:
+        {
+            int key = c;
+            if (c == KEY_ESC)
+            {
+                // escape sequences: ESC [ x, ESC [ n ~ and ESC O x
+                int c1 = read_key();
+                int c2 = read_key();
+                if (c1 == '[' && c2 >= '0' && c2 <= '9')
+                {
+                    if (read_key() != '~')
+                    {
+                        break;
+                    }
+                    key = c2 == '3' ? KEY_CTRL('d') : (c2 == '1' || c2 == '7') ? 'H' : (c2 == '4' || c2 == '8') ? 'F' : 0;
+                }
+                else if (c1 == '[' || c1 == 'O')
+                {
+                    key = c2;
+                }
+                else
+                {
+                    break;
+                }
+            }
+
+            if (key == KEY_CTRL('p') || key == 'A' || key == KEY_CTRL('n') || key == 'B')
+            {
+                int older = key == KEY_CTRL('p') || key == 'A';
+                unsigned long count = hist_next - hist_oldest();
+
+                if (older && hist_index < count)
+                {
+                    if (hist_index == 0)
+                    {
+                        free(scratch);
+                        scratch = strdup(st.buf);
+                    }
+                    hist_index++;
+                    set_line(&st, hist_get(hist_next - hist_index));
+                }
+                else if (!older && hist_index > 0)
+                {
+                    hist_index--;
+                    set_line(&st, hist_index ? hist_get(hist_next - hist_index) : (scratch ? scratch : ""));
+                }
+            }
+            else if (key == 'C' && st.pos < st.len)
+            {
+                st.pos++;
+            }
+            else if (key == 'D' && st.pos > 0)
+            {
+                st.pos--;
+            }
+            else if (key == 'H')
+            {
+                st.pos = 0;
+            }
+            else if (key == 'F')
+            {
+                st.pos = st.len;
+            }
+            else if (key == KEY_CTRL('d') && st.pos < st.len)
+            {
+                delete_range(&st, st.pos, st.pos + 1);
+            }
+            break;
+        }
+
+        default:
+            if (c >= 32 && c != KEY_BACKSPACE)
+            {
+                insert_char(&st, c);
+            }
+            break;
+        }
+
+        refresh_line(&st);
+    }
+}
@@ -0,0 +1,38 @@
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stddef.h>
+
+// capacity of the history ring buffer (older entries are overwritten)
+#define LE_HISTORY_MAX 100000
+
+// candidates for the word that ends at the cursor: each item replaces
+// line[word_start, cursor). items ending in '/' (directories) don't get a
+// trailing space when they are the only match
+struct le_completions
+{
+    size_t word_start;
+    size_t count;
+    size_t cap;
+    char **items;
+};
+
+typedef void (*le_completion_fn)(const char *line, size_t pos, struct le_completions *lc);
+
+// registers the function called when tab is pressed
+void le_set_completion(le_completion_fn fn);
+
+// adds a copy of item to the candidate list
+void le_add_completion(struct le_completions *lc, const char *item, size_t len);
+
+// loads the history file (if any) and opens it for appending
+void le_history_init(const char *filename);
+
+// adds a line to the ring buffer and appends it to the history file
+void le_history_add(const char *line);
+
+// reads one line from the terminal with editing, history and ctrl-r search;
+// returns a malloc'd string without the trailing newline, or NULL on EOF
+char *le_readline(const char *prompt);
+
+#endif
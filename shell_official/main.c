@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "wish.h"
+#include "lineedit.h"
+#include "complete.h"
+#include "serve.h"
+
+#define MAX_LINE 1024
+#define HISTORY_FILE ".wish_history" // kept in $HOME
+#define SERVE_WORKERS 4 // --serve without -j
+
+// the wish binary: options, the batch file / prompt loops, the line editor
+// and completion. running the lines is up to libwish (wish.h)
+
+// a here-document body line typed at the prompt
+static char *read_prompt_line(void *arg)
+{
+    (void)arg;
+    return le_readline("> ");
+}
+
+// after each interactive line: completion follows "path", and file names
+// complete relative to where "cd" (which only moves the context) went
+static void follow_ctx(struct wish_ctx *ctx)
+{
+    int count;
+    char **paths = wish_paths(ctx, &count);
+    complete_set_paths(paths, count);
+    if (fchdir(wish_cwd(ctx)) != 0)
+    {
+        perror("fchdir");
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    struct wish_ctx *ctx = wish_new();
+    if (!ctx)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        exit(1);
+    }
+    
+    // options: -j N (or -jN) runs batch file lines in parallel,
+    // -O tag|group routes the output of concurrent jobs through the mux,
+    // -p off|on|dry controls the pipeline rewrite pass,
+    // --serve SOCKET runs a command server (-j: its number of workers),
+    // -z starts commands from a zygote process,
+    // --compile SCRIPT -o IMAGE compiles a batch file
+    int max_jobs = 0;
+    enum outmux_mode output_mode = OUTMUX_OFF;
+    enum rewrite_mode rewrite_mode = REWRITE_ON;
+    const char *socket_path = NULL;
+    int zygote = 0;
+    const char *compile_path = NULL;
+    const char *image_path = NULL;
+    int argi = 1;
+    while (argi < argc && argv[argi][0] == '-' && argv[argi][1] != '\0')
+    {
+        if (strcmp(argv[argi], "--serve") == 0 && argi + 1 < argc)
+        {
+            socket_path = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "--compile") == 0 && argi + 1 < argc)
+        {
+            compile_path = argv[argi + 1];
+            argi += 2;
+            continue;
+        }
+        if (strcmp(argv[argi], "-z") == 0)
+        {
+            zygote = 1;
+            argi++;
+            continue;
+        }
+        char opt = argv[argi][1];
+        const char *value = argv[argi][2] ? argv[argi] + 2 : (argi + 1 < argc ? argv[++argi] : "");
+        argi++;
+
+        if (opt == 'j' && (max_jobs = atoi(value)) >= 1)
+        {
+            continue;
+        }
+        if (opt == 'o' && value[0] != '\0')
+        {
+            image_path = value;
+            continue;
+        }
+        if (opt == 'O' && (strcmp(value, "tag") == 0 || strcmp(value, "group") == 0))
+        {
+            output_mode = strcmp(value, "tag") == 0 ? OUTMUX_TAG : OUTMUX_GROUP;
+            wish_set_output_mode(ctx, output_mode);
+            continue;
+        }
+        if (opt == 'p' && (strcmp(value, "off") == 0 || strcmp(value, "on") == 0 || strcmp(value, "dry") == 0))
+        {
+            rewrite_mode = value[1] == 'f' ? REWRITE_OFF : value[1] == 'n' ? REWRITE_ON : REWRITE_DRY;
+            wish_set_rewrite_mode(ctx, rewrite_mode);
+            continue;
+        }
+        fprintf(stderr, "An error has occurred\n");
+        exit(1);
+    }
+
+    // compiling: nothing runs
+    if (compile_path || image_path)
+    {
+        if (!compile_path || !image_path || argc - argi != 0 || wish_compile(ctx, compile_path, image_path) < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            exit(1);
+        }
+        exit(0);
+    }
+
+    // server mode: no batch file, no prompt
+    if (socket_path)
+    {
+        if (argc - argi != 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            exit(1);
+        }
+        wish_free(ctx);
+        if (wish_serve(socket_path, max_jobs ? max_jobs : SERVE_WORKERS, output_mode, rewrite_mode) != 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            exit(1);
+        }
+        exit(0);
+    }
+
+    // the zygote is forked now, while the shell is at its smallest
+    if (zygote && wish_set_zygote(ctx, 1) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        exit(1);
+    }
+
+    // if more than one argument is provided
+    if (argc - argi > 1 || (max_jobs && argc - argi != 1))
+    {
+        fprintf(stderr, "An error has occurred\n");
+        exit(1);
+    }
+    
+    // batch file provided as an argument
+    if (argc - argi == 1)
+    {
+        // first argument after the options -> treated as a batch file,
+        // or a compiled one
+        int status;
+        int compiled = wish_run_image(ctx, argv[argi], max_jobs, &status);
+        if (compiled != 0)
+        {
+            if (compiled < 0)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                exit(1);
+            }
+            exit(max_jobs ? status : 0);
+        }
+
+        FILE *batch_file = fopen(argv[argi], "r");
+        if (!batch_file)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            exit(1);
+        }
+
+        status = wish_run_file(ctx, batch_file, max_jobs);
+        fclose(batch_file);
+        exit(max_jobs ? status : 0);
+    }
+
+    // interactive mode on a terminal -> line editor with history
+    if (isatty(STDIN_FILENO))
+    {
+        const char *home = getenv("HOME");
+        if (home)
+        {
+            size_t len = strlen(home) + strlen(HISTORY_FILE) + 2;
+            char histfile[len];
+            snprintf(histfile, len, "%s/%s", home, HISTORY_FILE);
+            le_history_init(histfile);
+        }
+        follow_ctx(ctx);
+        le_set_completion(complete_line);
+
+        while (1)
+        {
+            wish_poll(ctx); // reap background jobs that finished meanwhile
+            char *edited = le_readline("wish> ");
+            if (edited == NULL)
+            {
+                printf("\n");
+                exit(0);
+            }
+            le_history_add(edited);
+            char *text = wish_read_heredocs(edited, read_prompt_line, NULL);
+            char *line = text ? text : edited;
+            if (wish_run_line(ctx, line, strlen(line)) == WISH_EXIT)
+            {
+                exit(0);
+            }
+            follow_ctx(ctx);
+            free(text);
+            free(edited);
+        }
+    }
+
+    // interactive mode
+    char line[MAX_LINE];
+    while (1)
+    {
+        wish_poll(ctx);
+        printf("wish> ");
+
+        if (fgets(line, sizeof(line), stdin) == NULL)
+        {
+            printf("\n");
+            exit(0);
+        }
+
+        // remove newline and process the line (with its here-documents)
+        char *text = wish_read_heredocs(line, wish_read_file_line, stdin);
+        char *run = text ? text : line;
+        if (wish_run_line(ctx, run, strlen(run)) == WISH_EXIT)
+        {
+            exit(0);
+        }
+        free(text);
+    }
+
+    return 0;
+}
@@ -0,0 +1,380 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "evloop.h"
+#include "outmux.h"
+
+#define MUX_READ_CHUNK 65536
+#define MUX_READS_PER_EVENT 4
+
+struct mux_buf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+};
+
+struct mux_job;
+
+// what the event loop hands back to us when a pipe is readable
+struct mux_stream
+{
+    struct outmux *mux;
+    struct mux_job *job;
+    int s; // 0 = stdout, 1 = stderr
+};
+
+struct mux_job
+{
+    int label;
+    struct mux_stream streams[2];
+    int fds[2];            // read ends of the job's stdout/stderr pipes (-1 = closed)
+    struct mux_buf buf[2]; // what was read and not written out yet
+    int closed;            // both pipes hit EOF
+};
+
+struct outmux
+{
+    enum outmux_mode mode;
+    int out_fds[2]; // where the job's stdout/stderr end up
+    struct evloop *loop;
+
+    struct mux_job **jobs; // separately allocated, the loop keeps pointers to them
+    int count;
+    int cap;
+    int flushed; // group mode: every job before this one was written out
+    int open;
+};
+
+static void write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t n = write(fd, data, len);
+        if (n < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= n;
+    }
+}
+
+static int buf_reserve(struct mux_buf *b, size_t extra)
+{
+    if (b->len + extra <= b->cap)
+    {
+        return 1;
+    }
+    size_t cap = b->cap ? b->cap : MUX_READ_CHUNK;
+    while (cap < b->len + extra)
+    {
+        cap *= 2;
+    }
+    char *data = realloc(b->data, cap);
+    if (!data)
+    {
+        return 0;
+    }
+    b->data = data;
+    b->cap = cap;
+    return 1;
+}
+
+static void buf_free(struct mux_buf *b)
+{
+    free(b->data);
+    b->data = NULL;
+    b->len = b->cap = 0;
+}
+
+struct outmux *outmux_new(struct evloop *loop, enum outmux_mode mode, int out_fd, int err_fd)
+{
+    struct outmux *mux = calloc(1, sizeof(struct outmux));
+    if (!mux)
+    {
+        return NULL;
+    }
+    mux->mode = mode;
+    mux->out_fds[0] = out_fd;
+    mux->out_fds[1] = err_fd;
+    mux->loop = loop;
+    return mux;
+}
+
+static void drain_stream(struct evloop *loop, int fd, void *arg);
+
+int outmux_add_job(struct outmux *mux, int label, int child_fds[2])
+{
+    if (mux->count == mux->cap)
+    {
+        int cap = mux->cap ? mux->cap * 2 : 64;
+        struct mux_job **jobs = realloc(mux->jobs, cap * sizeof(struct mux_job *));
+        if (!jobs)
+        {
+            return -1;
+        }
+        mux->jobs = jobs;
+        mux->cap = cap;
+    }
+
+    struct mux_job *job = calloc(1, sizeof(struct mux_job));
+    if (!job)
+    {
+        return -1;
+    }
+    job->label = label;
+
+    int pipes[2][2];
+    if (pipe2(pipes[0], O_CLOEXEC) < 0)
+    {
+        free(job);
+        return -1;
+    }
+    if (pipe2(pipes[1], O_CLOEXEC) < 0)
+    {
+        close(pipes[0][0]);
+        close(pipes[0][1]);
+        free(job);
+        return -1;
+    }
+
+    for (int s = 0; s < 2; s++)
+    {
+        job->fds[s] = pipes[s][0];
+        child_fds[s] = pipes[s][1];
+        fcntl(job->fds[s], F_SETFL, O_NONBLOCK);
+
+        job->streams[s].mux = mux;
+        job->streams[s].job = job;
+        job->streams[s].s = s;
+        if (ev_add_fd(mux->loop, job->fds[s], drain_stream, &job->streams[s]) < 0)
+        {
+            // a stream nobody drains would never close: no job at all
+            if (s == 1)
+            {
+                ev_del_fd(mux->loop, job->fds[0]);
+            }
+            for (int i = 0; i < 2; i++)
+            {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
+            }
+            free(job);
+            return -1;
+        }
+    }
+
+    mux->jobs[mux->count] = job;
+    mux->open++;
+    return mux->count++;
+}
+
+// tag mode: writes every complete line of the buffer with the job's prefix
+static void flush_tagged(struct outmux *mux, struct mux_job *job, int s, int final)
+{
+    struct mux_buf *b = &job->buf[s];
+    if (b->len == 0)
+    {
+        return;
+    }
+
+    char *end = memrchr(b->data, '\n', b->len);
+    size_t upto = end ? (size_t)(end - b->data) + 1 : 0;
+    if (final)
+    {
+        upto = b->len;
+    }
+    if (upto == 0)
+    {
+        return;
+    }
+
+    char prefix[32];
+    int plen = snprintf(prefix, sizeof(prefix), "[%d] ", job->label);
+
+    // one write per batch of lines keeps them whole even next to other writers
+    size_t lines = 1;
+    for (size_t i = 0; i < upto; i++)
+    {
+        lines += b->data[i] == '\n';
+    }
+    char *out = malloc(upto + lines * plen + 1);
+    if (!out)
+    {
+        return;
+    }
+
+    size_t olen = 0, start = 0;
+    while (start < upto)
+    {
+        char *nl = memchr(b->data + start, '\n', upto - start);
+        size_t stop = nl ? (size_t)(nl - b->data) + 1 : upto;
+        memcpy(out + olen, prefix, plen);
+        olen += plen;
+        memcpy(out + olen, b->data + start, stop - start);
+        olen += stop - start;
+        start = stop;
+    }
+    if (out[olen - 1] != '\n')
+    {
+        out[olen++] = '\n'; // unterminated last line of a finished job
+    }
+    write_all(mux->out_fds[s], out, olen);
+    free(out);
+
+    memmove(b->data, b->data + upto, b->len - upto);
+    b->len -= upto;
+}
+
+// group mode: the job at the front of the submission order is written out
+// as it runs; the ones behind it keep their output until it is their turn.
+// what a job wrote while it waited goes out when it reaches the front, and
+// a job that is done by then is passed, so the next one moves up
+static int at_front(struct outmux *mux, struct mux_job *job)
+{
+    return mux->mode == OUTMUX_GROUP && mux->flushed < mux->count && mux->jobs[mux->flushed] == job;
+}
+
+static void flush_groups(struct outmux *mux)
+{
+    while (mux->flushed < mux->count)
+    {
+        struct mux_job *job = mux->jobs[mux->flushed];
+        for (int s = 0; s < 2; s++)
+        {
+            write_all(mux->out_fds[s], job->buf[s].data, job->buf[s].len);
+            job->buf[s].len = 0;
+        }
+        if (!job->closed)
+        {
+            break;
+        }
+        buf_free(&job->buf[0]);
+        buf_free(&job->buf[1]);
+        mux->flushed++;
+    }
+}
+
+static void close_stream(struct outmux *mux, struct mux_job *job, int s)
+{
+    ev_del_fd(mux->loop, job->fds[s]);
+    close(job->fds[s]);
+    job->fds[s] = -1;
+
+    if (mux->mode == OUTMUX_TAG)
+    {
+        flush_tagged(mux, job, s, 1);
+        buf_free(&job->buf[s]);
+    }
+
+    if (job->fds[0] < 0 && job->fds[1] < 0)
+    {
+        job->closed = 1;
+        mux->open--;
+        if (mux->mode == OUTMUX_GROUP)
+        {
+            flush_groups(mux);
+        }
+    }
+}
+
+static void drain_stream(struct evloop *loop, int fd, void *arg)
+{
+    struct mux_stream *stream = arg;
+    struct outmux *mux = stream->mux;
+    struct mux_job *job = stream->job;
+    struct mux_buf *b = &job->buf[stream->s];
+    (void)loop;
+
+    // a few chunks per wakeup so one chatty job can't starve the others;
+    // epoll is level triggered and reports the fd again if more is left
+    for (int i = 0; i < MUX_READS_PER_EVENT; i++)
+    {
+        if (!buf_reserve(b, MUX_READ_CHUNK))
+        {
+            // nowhere to put it: stop reading the stream (its writes fail
+            // from now on) rather than have epoll report it again and again
+            static const char error_message[] = "An error has occurred\n";
+            write_all(mux->out_fds[1], error_message, sizeof(error_message) - 1);
+            close_stream(mux, job, stream->s);
+            return;
+        }
+        ssize_t n = read(fd, b->data + b->len, b->cap - b->len);
+        if (n > 0)
+        {
+            b->len += n;
+            if (at_front(mux, job))
+            {
+                // however much the job writes, it only ever takes a chunk
+                write_all(mux->out_fds[stream->s], b->data, b->len);
+                b->len = 0;
+            }
+            continue;
+        }
+        if (n < 0 && errno == EINTR)
+        {
+            i--;
+            continue;
+        }
+        if (n < 0 && errno == EAGAIN)
+        {
+            break;
+        }
+        close_stream(mux, job, stream->s); // EOF (or a read error)
+        return;
+    }
+
+    if (mux->mode == OUTMUX_TAG)
+    {
+        flush_tagged(mux, job, stream->s, 0);
+    }
+}
+
+void outmux_close_in_child(struct outmux *mux)
+{
+    for (int i = 0; i < mux->count; i++)
+    {
+        for (int s = 0; s < 2; s++)
+        {
+            if (mux->jobs[i]->fds[s] >= 0)
+            {
+                close(mux->jobs[i]->fds[s]);
+            }
+        }
+    }
+}
+
+int outmux_open_jobs(struct outmux *mux)
+{
+    return mux->open;
+}
+
+void outmux_finish(struct outmux *mux)
+{
+    while (mux->open > 0)
+    {
+        ev_run_once(mux->loop, -1);
+    }
+    if (mux->mode == OUTMUX_GROUP)
+    {
+        flush_groups(mux);
+    }
+    for (int i = 0; i < mux->count; i++)
+    {
+        buf_free(&mux->jobs[i]->buf[0]);
+        buf_free(&mux->jobs[i]->buf[1]);
+        free(mux->jobs[i]);
+    }
+    free(mux->jobs);
+    free(mux);
+}
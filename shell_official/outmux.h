@@ -0,0 +1,37 @@
+#ifndef OUTMUX_H
+#define OUTMUX_H
+
+// how the output of concurrently running jobs reaches the terminal
+enum outmux_mode
+{
+    OUTMUX_OFF,   // jobs write straight to the shell's stdout/stderr
+    OUTMUX_TAG,   // whole lines, as they arrive, prefixed with "[label] "
+    OUTMUX_GROUP, // each job's whole output, in submission order (the first
+                  // unfinished one streamed, the ones behind it buffered)
+};
+
+struct outmux;
+struct evloop;
+
+// creates a multiplexer writing to out_fd/err_fd; the job pipes are watched
+// by loop, so they are drained whenever the caller runs it (NULL on failure)
+struct outmux *outmux_new(struct evloop *loop, enum outmux_mode mode, int out_fd, int err_fd);
+
+// registers a job and creates its pipes: child_fds[0] and child_fds[1] are
+// the write ends to install as the child's stdout and stderr (close them in
+// the parent after forking). returns the job id, or -1 on failure
+int outmux_add_job(struct outmux *mux, int label, int child_fds[2]);
+
+// for a child forked while mux runs: closes its copies of the pipes' read
+// ends, so a job whose stream the shell stops reading gets EPIPE instead of
+// filling a pipe the child still holds open
+void outmux_close_in_child(struct outmux *mux);
+
+// # of jobs whose pipes are still open
+int outmux_open_jobs(struct outmux *mux);
+
+// runs the loop until every job's pipes are closed, writes out what is
+// left and frees the mux
+void outmux_finish(struct outmux *mux);
+
+#endif
@@ -0,0 +1,172 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "scan.h"
+
+typedef size_t (*scan_fn)(const char *s);
+
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+size_t scan_word_scalar(const char *s)
+{
+    const char *p = s;
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '|' &&
+           *p != '<' && *p != '>' && *p != '&' && *p != ';')
+    {
+        p++;
+    }
+    return p - s;
+}
+
+#ifdef SCAN_X86
+
+// the vector versions only ever load whole aligned blocks: an aligned block
+// never straddles a page, so reading past the '\0' (or before s, in the
+// first block) can't fault. the bytes before s are shifted out of the mask.
+// AddressSanitizer can't tell, so they are left out of its checks
+#if defined(__SANITIZE_ADDRESS__)
+#define SCAN_NO_ASAN __attribute__((no_sanitize_address))
+#else
+#define SCAN_NO_ASAN
+#endif
+
+static inline unsigned delims_sse2(__m128i v)
+{
+    __m128i m = _mm_cmpeq_epi8(v, _mm_setzero_si128());
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('\t')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('|')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('<')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('>')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8('&')));
+    m = _mm_or_si128(m, _mm_cmpeq_epi8(v, _mm_set1_epi8(';')));
+    return (unsigned)_mm_movemask_epi8(m);
+}
+
+SCAN_NO_ASAN static size_t scan_word_sse2(const char *s)
+{
+    uintptr_t skip = (uintptr_t)s & 15;
+    const __m128i *block = (const __m128i *)(s - skip);
+    unsigned mask = delims_sse2(_mm_load_si128(block)) >> skip;
+    if (mask)
+    {
+        return __builtin_ctz(mask);
+    }
+    size_t len = 16 - skip;
+    for (block++;; block++, len += 16)
+    {
+        mask = delims_sse2(_mm_load_si128(block));
+        if (mask)
+        {
+            return len + __builtin_ctz(mask);
+        }
+    }
+}
+
+__attribute__((target("avx2"))) static inline uint32_t delims_avx2(__m256i v)
+{
+    __m256i m = _mm256_cmpeq_epi8(v, _mm256_setzero_si256());
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(' ')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('\t')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('|')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('<')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('>')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8('&')));
+    m = _mm256_or_si256(m, _mm256_cmpeq_epi8(v, _mm256_set1_epi8(';')));
+    return (uint32_t)_mm256_movemask_epi8(m);
+}
+
+SCAN_NO_ASAN __attribute__((target("avx2"))) static size_t scan_word_avx2(const char *s)
+{
+    uintptr_t skip = (uintptr_t)s & 31;
+    const __m256i *block = (const __m256i *)(s - skip);
+    uint32_t mask = delims_avx2(_mm256_load_si256(block)) >> skip;
+    if (mask)
+    {
+        return __builtin_ctz(mask);
+    }
+    size_t len = 32 - skip;
+    for (block++;; block++, len += 32)
+    {
+        mask = delims_avx2(_mm256_load_si256(block));
+        if (mask)
+        {
+            return len + __builtin_ctz(mask);
+        }
+    }
+}
+
+#endif
+
+#ifdef WISH_SCAN_CHECK
+// random strings at every alignment, made mostly of delimiters and bytes
+// next to them, so every block position and boundary gets hit
+static void scan_selftest(const char *name, scan_fn scan)
+{
+    static const char alphabet[] = " \t|<>&\x01\x08\x1f!=;{}a\x80\xa0\xbc\xfe";
+    _Alignas(64) char buf[256];
+
+    srand(1);
+    for (int round = 0; round < 20000; round++)
+    {
+        size_t off = round % 64;
+        size_t len = rand() % (sizeof(buf) - off - 1);
+        for (size_t i = 0; i < sizeof(buf); i++)
+        {
+            buf[i] = rand() % 4 ? 'x' : alphabet[rand() % (sizeof(alphabet) - 1)];
+        }
+        buf[off + len] = '\0';
+        size_t got = scan(buf + off), want = scan_word_scalar(buf + off);
+        if (got != want)
+        {
+            fprintf(stderr, "scan_word (%s): %zu instead of %zu at offset %zu\n", name, got, want, off);
+            abort();
+        }
+    }
+}
+#endif
+
+static scan_fn scan_impl;
+
+static scan_fn scan_select(void)
+{
+    scan_fn impl = scan_word_scalar;
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    impl = __builtin_cpu_supports("avx2") ? scan_word_avx2 : scan_word_sse2;
+#endif
+#ifdef WISH_SCAN_CHECK
+#ifdef SCAN_X86
+    scan_selftest("sse2", scan_word_sse2);
+    if (__builtin_cpu_supports("avx2"))
+    {
+        scan_selftest("avx2", scan_word_avx2);
+    }
+#endif
+#endif
+    __atomic_store_n(&scan_impl, impl, __ATOMIC_RELAXED);
+    return impl;
+}
+
+size_t scan_word(const char *s)
+{
+    // threads racing here all pick the same version, so the store is harmless
+    scan_fn impl = __atomic_load_n(&scan_impl, __ATOMIC_RELAXED);
+    if (!impl)
+    {
+        impl = scan_select();
+    }
+    size_t len = impl(s);
+#ifdef WISH_SCAN_CHECK
+    // differential check: every real scan is compared with the scalar one
+    if (len != scan_word_scalar(s))
+    {
+        fprintf(stderr, "scan_word: %zu instead of %zu for \"%s\"\n", len, scan_word_scalar(s), s);
+        abort();
+    }
+#endif
+    return len;
+}
@@ -0,0 +1,14 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// # of bytes before the first word delimiter in s: ' ', '\t', '|', '<',
+// '>', '&', ';' or the terminating '\0'. on x86 it looks at 16 (SSE2) or 32
+// (AVX2, when the CPU has it) bytes at a time; elsewhere it is a plain loop
+size_t scan_word(const char *s);
+
+// the byte-at-a-time version, kept as the reference the vector ones must match
+size_t scan_word_scalar(const char *s);
+
+#endif
@@ -0,0 +1,317 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "frame.h"
+#include "serve.h"
+
+#define SERVE_CHUNK 65536
+#define SERVE_BACKLOG 128
+
+struct serve_opts
+{
+    enum outmux_mode output_mode;
+    enum rewrite_mode rewrite_mode;
+};
+
+// what the relay thread forwards: the read ends of the request's
+// stdout/stderr pipes, to the client as frames
+struct relay
+{
+    int conn;
+    int fds[2];
+};
+
+static volatile sig_atomic_t stopping;
+
+static void stop_serving(int sig)
+{
+    (void)sig;
+    stopping = 1;
+}
+
+static void *relay_output(void *arg)
+{
+    struct relay *relay = arg;
+    char *buf = malloc(SERVE_CHUNK);
+    int open = 2;
+    int client_gone = !buf;
+
+    while (open > 0)
+    {
+        struct pollfd pfds[2] = {{relay->fds[0], POLLIN, 0}, {relay->fds[1], POLLIN, 0}};
+        if (poll(pfds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+        for (int s = 0; s < 2; s++)
+        {
+            if (relay->fds[s] < 0 || !pfds[s].revents)
+            {
+                continue;
+            }
+            ssize_t n = client_gone ? read(relay->fds[s], &(char){0}, 1) : read(relay->fds[s], buf, SERVE_CHUNK);
+            if (n < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            if (n <= 0)
+            {
+                relay->fds[s] = -1; // poll ignores negative fds
+                open--;
+                continue;
+            }
+            // a client that left still gets its commands run to the end;
+            // the output is just dropped
+            if (!client_gone && frame_write(relay->conn, s ? FRAME_STDERR : FRAME_STDOUT, buf, n) < 0)
+            {
+                client_gone = 1;
+            }
+        }
+    }
+    free(buf);
+    return NULL;
+}
+
+// runs one line with stdout/stderr on pipes that are relayed to the client
+// while it runs; the status frame goes out once all of its output has
+static int run_request(int conn, const char *line, uint32_t len, const struct serve_opts *opts)
+{
+    int out[2], err[2];
+    if (pipe2(out, O_CLOEXEC) < 0)
+    {
+        return -1;
+    }
+    if (pipe2(err, O_CLOEXEC) < 0)
+    {
+        close(out[0]);
+        close(out[1]);
+        return -1;
+    }
+
+    fflush(NULL);
+    dup2(out[1], STDOUT_FILENO);
+    dup2(err[1], STDERR_FILENO);
+    close(out[1]);
+    close(err[1]);
+
+    struct relay relay = {conn, {out[0], err[0]}};
+    pthread_t thread;
+    int relaying = pthread_create(&thread, NULL, relay_output, &relay) == 0;
+
+    // a fresh context per request: /bin, the worker's environment and
+    // directory, whatever an earlier request did with cd or path
+    int status = 1;
+    struct wish_ctx *ctx = wish_new();
+    if (ctx)
+    {
+        wish_set_output_mode(ctx, opts->output_mode);
+        wish_set_rewrite_mode(ctx, opts->rewrite_mode);
+        status = wish_run_line(ctx, line, len);
+        if (status == WISH_EXIT)
+        {
+            status = 0;
+        }
+        wish_free(ctx);
+    }
+    else
+    {
+        fprintf(stderr, "An error has occurred\n");
+    }
+    wish_reset_fds(); // exec N>file lasts one request
+
+    // the relay sees EOF once the worker's copies and the commands' (also
+    // those of background jobs) are closed
+    fflush(NULL);
+    int null = open("/dev/null", O_WRONLY | O_CLOEXEC);
+    dup2(null, STDOUT_FILENO);
+    dup2(null, STDERR_FILENO);
+    close(null);
+    if (relaying)
+    {
+        pthread_join(thread, NULL);
+    }
+    close(out[0]);
+    close(err[0]);
+
+    uint32_t netstatus = htonl((uint32_t)status);
+    return frame_write(conn, FRAME_STATUS, &netstatus, sizeof(netstatus));
+}
+
+static void worker(int listen_fd, const struct serve_opts *opts)
+{
+    signal(SIGINT, SIG_DFL);
+    signal(SIGTERM, SIG_DFL);
+
+    while (1)
+    {
+        int conn = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+        if (conn < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+            {
+                continue;
+            }
+            _exit(1);
+        }
+
+        // any number of lines per connection, one after the other
+        char type;
+        char *line;
+        uint32_t len;
+        while (frame_read(conn, &type, &line, &len) == 0)
+        {
+            int ok = type == FRAME_LINE && run_request(conn, line, len, opts) == 0;
+            free(line);
+            if (!ok)
+            {
+                break;
+            }
+        }
+        close(conn);
+
+        // background jobs of earlier requests
+        while (waitpid(-1, NULL, WNOHANG) > 0)
+        {
+        }
+    }
+}
+
+static pid_t spawn_worker(int listen_fd, const struct serve_opts *opts)
+{
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        worker(listen_fd, opts);
+    }
+    return pid;
+}
+
+// makes way for binding addr: nothing there, or a socket left behind by a
+// server that is gone, which is removed. -1 for anything else, a file or a
+// server that still answers, which stays as it is
+static int clear_socket_path(struct sockaddr_un *addr)
+{
+    struct stat st;
+    if (lstat(addr->sun_path, &st) < 0)
+    {
+        return errno == ENOENT ? 0 : -1;
+    }
+    if (!S_ISSOCK(st.st_mode))
+    {
+        return -1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    int live = connect(fd, (struct sockaddr *)addr, sizeof(*addr)) == 0 || errno != ECONNREFUSED;
+    close(fd);
+    if (live)
+    {
+        return -1;
+    }
+    return unlink(addr->sun_path) < 0 && errno != ENOENT ? -1 : 0;
+}
+
+int wish_serve(const char *socket_path, int workers, enum outmux_mode output_mode,
+               enum rewrite_mode rewrite_mode)
+{
+    struct serve_opts opts = {output_mode, rewrite_mode};
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        return 1;
+    }
+    strcpy(addr.sun_path, socket_path);
+
+    // 3-9 stay free for the requests' exec redirections
+    wish_reset_fds();
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0)
+    {
+        return 1;
+    }
+    if (clear_socket_path(&addr) < 0)
+    {
+        close(listen_fd);
+        return 1;
+    }
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(listen_fd, SERVE_BACKLOG) < 0)
+    {
+        close(listen_fd);
+        return 1;
+    }
+
+    // the requests' commands read from /dev/null, not from the server's stdin
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    dup2(null, STDIN_FILENO);
+    close(null);
+
+    // no SA_RESTART: wait() has to return so the loop can see stopping
+    struct sigaction sa = {0};
+    sa.sa_handler = stop_serving;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    pid_t *pids = calloc(workers, sizeof(pid_t));
+    if (!pids)
+    {
+        close(listen_fd);
+        unlink(socket_path);
+        return 1;
+    }
+    for (int i = 0; i < workers; i++)
+    {
+        pids[i] = spawn_worker(listen_fd, &opts);
+    }
+
+    // a worker that died is replaced
+    while (!stopping)
+    {
+        pid_t pid = wait(NULL);
+        if (pid < 0 && errno != EINTR)
+        {
+            sleep(1); // no workers at all (every fork failed)
+        }
+        for (int i = 0; i < workers; i++)
+        {
+            if (!stopping && (pids[i] == pid || pids[i] < 0))
+            {
+                pids[i] = spawn_worker(listen_fd, &opts);
+            }
+        }
+    }
+
+    for (int i = 0; i < workers; i++)
+    {
+        if (pids[i] > 0)
+        {
+            kill(pids[i], SIGTERM);
+            waitpid(pids[i], NULL, 0);
+        }
+    }
+    free(pids);
+    close(listen_fd);
+    unlink(socket_path);
+    return 0;
+}
@@ -0,0 +1,15 @@
+#ifndef SERVE_H
+#define SERVE_H
+
+#include "wish.h"
+
+// wish --serve SOCKET: listens on a Unix domain socket and runs the lines
+// clients send (see frame.h) in a pool of workers forked up front, each
+// line in a fresh wish_ctx, streaming back its output and status. runs
+// until SIGINT/SIGTERM; returns non-zero if the socket couldn't be set up.
+// a stale socket at socket_path is replaced, but never anything else or a
+// socket a server is still listening on
+int wish_serve(const char *socket_path, int workers, enum outmux_mode output_mode,
+               enum rewrite_mode rewrite_mode);
+
+#endif
@@ -1,21 +1,46 @@
-#define _POSIX_C_SOURCE 200809L
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include "wish.h"
+#include "outmux.h"
+#include "evloop.h"
+#include "scan.h"
+#include "zygote.h"
 
 #define MAX_LINE 1024
 #define MAX_ARGS 64
 #define MAX_TOKENS 128
 #define MAX_WORD_LEN 256
 #define MAX_PATHS 10
+#define TIMEOUT_STATUS 124          // exit status of a pipeline stopped by timeout
+#define TIMEOUT_KILL_AFTER_MS 2000  // SIGTERM -> SIGKILL delay unless -k says otherwise
+#define MAX_LIMITS 3                // ulimit -v, -n and -t
+#define MAX_OUTPUTS 8               // "> a > b ..." targets of one command
+#define FANOUT_PIPE_SIZE (1 << 20)  // bytes per tee()/splice() round (best effort)
+#define MAX_PROCSUBS 8              // <(...) / >(...) in one command
+#define MAX_REDIRS 8                // N>file, >&N ... of one command
+#define MAX_USER_FD 9               // exec N>file takes N from 0 to this
+#define MAX_NESTING 32              // source / { ...; } inside one another
 
-char *search_paths[MAX_PATHS];
-int path_count = 0;
+// 3..MAX_USER_FD: opened by an exec redirection (or inherited). these are
+// the process's fds, so unlike everything else this isn't per context
+static int user_fds[MAX_USER_FD + 1];
 
 // token "labels"
 typedef enum
@@ -25,6 +50,15 @@ typedef enum
     TOKEN_REDIRECT_IN,  // <
     TOKEN_REDIRECT_OUT, // >
     TOKEN_BACKGROUND,   // &
+    TOKEN_PROCSUB_IN,   // <(...)
+    TOKEN_PROCSUB_OUT,  // >(...)
+    TOKEN_HEREDOC,      // <<
+    TOKEN_APPEND,       // >>
+    TOKEN_DUP_IN,       // <&
+    TOKEN_DUP_OUT,      // >&
+    TOKEN_IONUMBER,     // the N of N>, N<, N>>, N>&, N<&
+    TOKEN_SEMI,         // ;
+    TOKEN_GROUP,        // ( ... ) or { ...; }, brackets included
     TOKEN_EOL,
     TOKEN_EOF
 } TokenType;
@@ -35,13 +69,68 @@ typedef struct
     char *value;
 } Token;
 
+// pin/nice/ulimit prefixes of a command, applied in the child between fork and exec
+typedef struct exec_attrs
+{
+    int pinned;   // cpus holds the affinity mask
+    int siblings; // pin -s: spread the pipeline's stages over neighbouring cores
+    cpu_set_t cpus;
+    int niced;
+    int nice; // added to the priority the shell runs at
+    int limit_count;
+    int limit_resources[MAX_LIMITS];
+    rlim_t limit_values[MAX_LIMITS];
+} ExecAttrs;
+
+// a <(line) or >(line) argument
+typedef struct proc_sub
+{
+    char *word;   // the argument as written, replaced by path once started
+    char *line;   // what runs in the subshell
+    int output;   // >(...): the command writes, the subshell reads
+    int fd;       // the shell's end of the pipe (-1 = not started / handed over)
+    char path[24]; // "/dev/fd/N"
+} ProcSub;
+
+// N>file, N>>file, N<file, N>&M, N<&M, N>&-
+typedef enum
+{
+    REDIR_READ,
+    REDIR_WRITE,
+    REDIR_APPEND,
+    REDIR_DUP,
+    REDIR_CLOSE,
+} RedirKind;
+
+typedef struct redir
+{
+    int fd;
+    RedirKind kind;
+    char *target; // file name, or the word after >& / <&
+    int source;   // REDIR_DUP: the fd to copy
+} Redir;
+
 typedef struct command
 {
     char *args[MAX_ARGS];
     int arg_count;
+    ExecAttrs attrs;
     char *input_file;     // input redirection
-    char *output_file;    // output redirection
+    char *heredoc_delim;  // <<DELIM: stdin is the body below the command line
+    char *heredoc_body;   // points into the text given to process_line
+    size_t heredoc_len;
+    char *output_files[MAX_OUTPUTS]; // output redirection, fanned out if more than one
+    int output_count;
     int background;       // background processes
+    int status_is_zero;   // a "| cat > out" was folded into it; the pipeline reported cat's 0
+    int sequenced;        // its pipeline ended in ";": under -O, what comes next waits for it
+    char group;           // '(' or '{': args[0] is a whole group, run by process_line
+    char *group_bodies;   // the here-document bodies of the commands inside the group
+    size_t group_bodies_len;
+    ProcSub procsubs[MAX_PROCSUBS];
+    int procsub_count;
+    Redir redirs[MAX_REDIRS]; // applied in order, after < and >
+    int redir_count;
     struct command *next; // piping
 } Command;
 
@@ -51,7 +140,27 @@ typedef struct command_list
     int count;          // # of commands
 } CommandList;
 
-CommandList *new_command_list()
+// everything the shell keeps between lines (see wish.h)
+struct wish_ctx
+{
+    char *search_paths[MAX_PATHS];
+    int path_count;
+    char **env;  // what commands are exec'd with, NULL terminated
+    int env_count;
+    int cwd_fd;  // O_PATH fd of the working directory; children fchdir() to it
+    struct evloop *loop; // children, job output and timers, all served from one thread
+    enum outmux_mode output_mode; // -O: how concurrent jobs share the terminal
+    enum rewrite_mode rewrite_mode;
+    Token tokens[MAX_TOKENS]; // tokenize_input's result, up to the next line
+    struct zygote *zygote;    // -z: starts the commands (NULL = they're forked here)
+    struct zygote_child *zchildren; // its children not reaped yet
+    int zchild_count;
+    int zchild_cap;
+    int depth; // source / { ...; } being run from inside a line
+    int shares_terminal; // a forked job running next to others: timeout leaves the terminal alone
+};
+
+static CommandList *new_command_list()
 {
     CommandList *list = malloc(sizeof(CommandList));
     list->commands = malloc(sizeof(Command *) * MAX_ARGS);
@@ -59,7 +168,7 @@ CommandList *new_command_list()
     return list;
 }
 
-Command *new_command()
+static Command *new_command()
 {
     Command *cmd = malloc(sizeof(Command));
     if (!cmd)
@@ -67,9 +176,20 @@ Command *new_command()
 
     cmd->arg_count = 0;
     cmd->input_file = NULL;
-    cmd->output_file = NULL;
+    cmd->heredoc_delim = NULL;
+    cmd->heredoc_body = NULL;
+    cmd->heredoc_len = 0;
+    cmd->output_count = 0;
     cmd->background = 0;
+    cmd->status_is_zero = 0;
+    cmd->sequenced = 0;
+    cmd->group = 0;
+    cmd->group_bodies = NULL;
+    cmd->group_bodies_len = 0;
+    cmd->procsub_count = 0;
+    cmd->redir_count = 0;
     cmd->next = NULL;
+    memset(&cmd->attrs, 0, sizeof(ExecAttrs));
 
     for (int i = 0; i < MAX_ARGS; i++)
     {
@@ -79,9 +199,26 @@ Command *new_command()
     return cmd;
 }
 
-Token *tokenize_input(char *line, int *token_count)
+// the bracket that closes the '(' or '{' at open, counting the ones nested
+// in between; NULL if there is none
+static char *closing_bracket(char *open)
+{
+    char close = *open == '(' ? ')' : '}';
+    int depth = 0;
+    for (char *p = open; *p; p++)
+    {
+        depth += (*p == *open) - (*p == close);
+        if (depth == 0)
+        {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+static Token *tokenize_input(struct wish_ctx *ctx, char *line, int *token_count)
 {
-    static Token tokens[MAX_TOKENS];
+    Token *tokens = ctx->tokens;
     *token_count = 0;
     char *current = line;
 
@@ -100,7 +237,19 @@ Token *tokenize_input(char *line, int *token_count)
 
         // declare word buffer outside the switch
         char word[MAX_WORD_LEN];
-        int i = 0;
+        size_t i = 0;
+
+        // a group, up to the matching bracket (the value stays NULL if there
+        // is none). only "{ " starts one: {a,b} is a word
+        if (*current == '(' || (*current == '{' && (current[1] == ' ' || current[1] == '\t')))
+        {
+            char *end = closing_bracket(current);
+            tok->type = TOKEN_GROUP;
+            tok->value = end ? strndup(current, end - current + 1) : NULL;
+            current = end ? end + 1 : current + strlen(current);
+            (*token_count)++;
+            continue;
+        }
 
         // special characters checking
         switch (*current)
@@ -110,14 +259,39 @@ Token *tokenize_input(char *line, int *token_count)
             tok->value = strdup("|");
             current++;
             break;
-        case '<':
-            tok->type = TOKEN_REDIRECT_IN;
-            tok->value = strdup("<");
+        case ';':
+            tok->type = TOKEN_SEMI;
+            tok->value = strdup(";");
             current++;
             break;
+        case '<':
         case '>':
-            tok->type = TOKEN_REDIRECT_OUT;
-            tok->value = strdup(">");
+            if (current[1] == '(')
+            {
+                // process substitution, up to the matching parenthesis;
+                // the value stays NULL if there is none
+                char *end = closing_bracket(current + 1);
+                tok->type = *current == '<' ? TOKEN_PROCSUB_IN : TOKEN_PROCSUB_OUT;
+                tok->value = end ? strndup(current, end - current + 1) : NULL;
+                current = end ? end + 1 : current + strlen(current);
+                break;
+            }
+            if (current[0] == '<' && current[1] == '<')
+            {
+                tok->type = TOKEN_HEREDOC; // the delimiter is the next word
+                tok->value = strdup("<<");
+                current += 2;
+                break;
+            }
+            if (current[1] == '&' || (current[0] == '>' && current[1] == '>'))
+            {
+                tok->type = current[1] == '>' ? TOKEN_APPEND : current[0] == '<' ? TOKEN_DUP_IN : TOKEN_DUP_OUT;
+                tok->value = strndup(current, 2);
+                current += 2;
+                break;
+            }
+            tok->type = *current == '<' ? TOKEN_REDIRECT_IN : TOKEN_REDIRECT_OUT;
+            tok->value = strdup(*current == '<' ? "<" : ">");
             current++;
             break;
         case '&':
@@ -126,16 +300,22 @@ Token *tokenize_input(char *line, int *token_count)
             current++;
             break;
         default:
-            // handle word tokens
-            while (*current != '\0' && *current != ' ' &&
-                   *current != '\t' && *current != '|' &&
-                   *current != '<' && *current != '>' &&
-                   *current != '&' && i < MAX_WORD_LEN - 1)
+            // handle word tokens: find where the word ends in one go, then
+            // copy it (longer words are split, as they always were)
+            i = scan_word(current);
+            if (i > MAX_WORD_LEN - 1)
             {
-                word[i++] = *current++;
+                i = MAX_WORD_LEN - 1;
             }
+            memcpy(word, current, i);
+            current += i;
             word[i] = '\0';
             tok->type = TOKEN_WORD;
+            // a single digit right before < or > is the fd it redirects
+            if (i == 1 && word[0] >= '0' && word[0] <= '9' && (*current == '<' || *current == '>'))
+            {
+                tok->type = TOKEN_IONUMBER;
+            }
             tok->value = strdup(word);
             break;
         }
@@ -146,7 +326,66 @@ Token *tokenize_input(char *line, int *token_count)
     return tokens;
 }
 
-Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
+// records a <(...) / >(...) token of cmd; -1 if the parentheses don't match
+// or there are too many
+static int add_procsub(Command *cmd, Token *token)
+{
+    if (!token->value || cmd->procsub_count == MAX_PROCSUBS)
+    {
+        return -1;
+    }
+    ProcSub *sub = &cmd->procsubs[cmd->procsub_count++];
+    sub->word = token->value;
+    sub->line = strndup(token->value + 2, strlen(token->value) - 3);
+    sub->output = token->type == TOKEN_PROCSUB_OUT;
+    sub->fd = -1;
+    return 0;
+}
+
+// records an N>file / N>>file / N<file / N>&M / N<&M / N>&- of cmd (fd is
+// -1 when there was no N); -1 on a bad target or too many
+static int add_redir(Command *cmd, int fd, TokenType op, Token *target)
+{
+    if (cmd->redir_count == MAX_REDIRS || !target || target->type != TOKEN_WORD)
+    {
+        return -1;
+    }
+
+    Redir *redir = &cmd->redirs[cmd->redir_count];
+    int reads = op == TOKEN_REDIRECT_IN || op == TOKEN_DUP_IN;
+    redir->fd = fd >= 0 ? fd : reads ? STDIN_FILENO : STDOUT_FILENO;
+    redir->target = target->value;
+    if (op == TOKEN_DUP_IN || op == TOKEN_DUP_OUT)
+    {
+        if (strcmp(target->value, "-") == 0)
+        {
+            redir->kind = REDIR_CLOSE;
+        }
+        else if (target->value[0] >= '0' && target->value[0] <= '9' && target->value[1] == '\0')
+        {
+            redir->kind = REDIR_DUP;
+            redir->source = target->value[0] - '0';
+        }
+        else
+        {
+            return -1;
+        }
+    }
+    else
+    {
+        redir->kind = op == TOKEN_REDIRECT_IN ? REDIR_READ : op == TOKEN_APPEND ? REDIR_APPEND : REDIR_WRITE;
+    }
+    cmd->redir_count++;
+    return 0;
+}
+
+// a word, or a process substitution standing for a file name
+static int is_file_token(Token *token)
+{
+    return token->type == TOKEN_WORD || token->type == TOKEN_PROCSUB_IN || token->type == TOKEN_PROCSUB_OUT;
+}
+
+static Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
 {
     Command *first_cmd = new_command();
     Command *current_cmd = first_cmd;
@@ -165,9 +404,34 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
             break;
         }
 
+        // so does ";", which under -O also keeps the next one from starting
+        // before this one is done. every stage is marked: a rewrite may drop
+        // the first or the last
+        if (token.type == TOKEN_SEMI)
+        {
+            for (Command *stage = first_cmd; stage; stage = stage->next)
+            {
+                stage->sequenced = 1;
+            }
+            (*current_pos)++;
+            break;
+        }
+
         switch (token.type)
         {
         case TOKEN_WORD:
+            // nothing but redirections after a group
+            if (current_cmd->group)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                while (first_cmd)
+                {
+                    Command *next = first_cmd->next;
+                    free(first_cmd);
+                    first_cmd = next;
+                }
+                return NULL;
+            }
             // no redirection yet -> this word is part of the command
             if (input_redirect_count == 0 && output_redirect_count == 0)
             {
@@ -176,6 +440,41 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
             current_cmd->args[current_cmd->arg_count++] = token.value;
             break;
 
+        case TOKEN_GROUP:
+            // ( ... ) / { ...; } is a whole command (or pipeline stage) of its own
+            if (!token.value || current_cmd->arg_count > 0 || input_redirect_count > 0 || output_redirect_count > 0)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                while (first_cmd)
+                {
+                    Command *next = first_cmd->next;
+                    free(first_cmd);
+                    first_cmd = next;
+                }
+                return NULL;
+            }
+            has_command = 1;
+            current_cmd->group = token.value[0];
+            current_cmd->args[current_cmd->arg_count++] = token.value;
+            break;
+
+        case TOKEN_PROCSUB_IN:
+        case TOKEN_PROCSUB_OUT:
+            // as an argument (or a redirection target, see below)
+            if (!has_command || add_procsub(current_cmd, &tokens[*current_pos]) < 0)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                while (first_cmd)
+                {
+                    Command *next = first_cmd->next;
+                    free(first_cmd);
+                    first_cmd = next;
+                }
+                return NULL;
+            }
+            current_cmd->args[current_cmd->arg_count++] = token.value;
+            break;
+
         case TOKEN_PIPE:
             if (!has_command)
             {
@@ -197,6 +496,58 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
             has_command = 0;
             break;
 
+        case TOKEN_IONUMBER:
+        case TOKEN_APPEND:
+        case TOKEN_DUP_IN:
+        case TOKEN_DUP_OUT:
+        {
+            // fd redirections: the optional N, the operator, then the target
+            int fd = -1;
+            if (token.type == TOKEN_IONUMBER)
+            {
+                fd = token.value[0] - '0';
+                (*current_pos)++;
+            }
+            Token *op = *current_pos < token_count ? &tokens[*current_pos] : NULL;
+            int valid = has_command && op &&
+                        (op->type == TOKEN_REDIRECT_IN || op->type == TOKEN_REDIRECT_OUT || op->type == TOKEN_APPEND ||
+                         op->type == TOKEN_DUP_IN || op->type == TOKEN_DUP_OUT) &&
+                        add_redir(current_cmd, fd, op->type,
+                                  *current_pos + 1 < token_count ? &tokens[*current_pos + 1] : NULL) == 0;
+            // like < and >, no more words after the target
+            if (!valid || (*current_pos + 2 < token_count && tokens[*current_pos + 2].type == TOKEN_WORD))
+            {
+                fprintf(stderr, "An error has occurred\n");
+                while (first_cmd)
+                {
+                    Command *next = first_cmd->next;
+                    free(first_cmd);
+                    first_cmd = next;
+                }
+                return NULL;
+            }
+            (*current_pos)++; // on the target now
+            break;
+        }
+
+        case TOKEN_HEREDOC:
+            // an input redirection whose source is the body
+            input_redirect_count++;
+            if (!has_command || input_redirect_count > 1 || *current_pos + 1 >= token_count ||
+                tokens[*current_pos + 1].type != TOKEN_WORD)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                while (first_cmd)
+                {
+                    Command *next = first_cmd->next;
+                    free(first_cmd);
+                    first_cmd = next;
+                }
+                return NULL;
+            }
+            current_cmd->heredoc_delim = tokens[++(*current_pos)].value;
+            break;
+
         case TOKEN_REDIRECT_IN:
             if (!has_command)
             {
@@ -223,7 +574,8 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
                 return NULL;
             }
             
-            if (*current_pos + 1 < token_count && tokens[*current_pos + 1].type == TOKEN_WORD)
+            if (*current_pos + 1 < token_count && is_file_token(&tokens[*current_pos + 1]) &&
+                (tokens[*current_pos + 1].type == TOKEN_WORD || add_procsub(current_cmd, &tokens[*current_pos + 1]) == 0))
             {
                 current_cmd->input_file = tokens[++(*current_pos)].value;
                 // if next token is also a word
@@ -271,7 +623,7 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
             }
             
             output_redirect_count++;
-            if (output_redirect_count > 1)
+            if (output_redirect_count > MAX_OUTPUTS)
             {
                 fprintf(stderr, "An error has occurred\n");
                 while (first_cmd)
@@ -283,9 +635,10 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
                 return NULL;
             }
             
-            if (*current_pos + 1 < token_count && tokens[*current_pos + 1].type == TOKEN_WORD)
+            if (*current_pos + 1 < token_count && is_file_token(&tokens[*current_pos + 1]) &&
+                (tokens[*current_pos + 1].type == TOKEN_WORD || add_procsub(current_cmd, &tokens[*current_pos + 1]) == 0))
             {
-                current_cmd->output_file = tokens[++(*current_pos)].value;
+                current_cmd->output_files[current_cmd->output_count++] = tokens[++(*current_pos)].value;
                 // if next token is also a word (multiple files after redirection)
                 if (*current_pos + 1 < token_count && 
                     tokens[*current_pos + 1].type == TOKEN_WORD &&
@@ -339,7 +692,7 @@ Command *parse_single_command(Token *tokens, int *current_pos, int token_count)
     return first_cmd;
 }
 
-CommandList *parse_tokens(Token *tokens, int token_count)
+static CommandList *parse_tokens(Token *tokens, int token_count)
 {
     CommandList *list = new_command_list();
     int current_pos = 0;
@@ -370,42 +723,43 @@ CommandList *parse_tokens(Token *tokens, int token_count)
     return list;
 }
 
-void initialize_paths()
+static void initialize_paths(struct wish_ctx *ctx)
 {
     // clear existing paths
     for (int i = 0; i < MAX_PATHS; i++)
     {
-        search_paths[i] = NULL;
+        ctx->search_paths[i] = NULL;
     }
     // default path to /bin
-    search_paths[0] = strdup("/bin");
-    path_count = 1;
+    ctx->search_paths[0] = strdup("/bin");
+    ctx->path_count = 1;
 }
 
-void handle_path_command(Command *cmd)
+static void handle_path_command(struct wish_ctx *ctx, Command *cmd)
 {
     // Free existing paths
-    for (int i = 0; i < path_count; i++)
+    for (int i = 0; i < ctx->path_count; i++)
     {
-        free(search_paths[i]);
-        search_paths[i] = NULL;
+        free(ctx->search_paths[i]);
+        ctx->search_paths[i] = NULL;
     }
-    path_count = 0;
+    ctx->path_count = 0;
 
     // Add new paths
-    for (int i = 1; i < cmd->arg_count && path_count < MAX_PATHS; i++)
+    for (int i = 1; i < cmd->arg_count && ctx->path_count < MAX_PATHS; i++)
     {
-        search_paths[path_count++] = strdup(cmd->args[i]);
+        ctx->search_paths[ctx->path_count++] = strdup(cmd->args[i]);
     }
 }
 
-int search_path(char *command)
+// the file to exec for command goes to full_path (size bytes); 0 if there
+// is none
+static int search_path(struct wish_ctx *ctx, const char *command, char *full_path, size_t size)
 {
-    char full_path[256];
-
     // check if the command is an absolute path or relative path
     if (strchr(command, '/') != NULL)
     {
+        snprintf(full_path, size, "%s", command);
         if (access(command, X_OK) == 0)
         {
             return 1;
@@ -414,22 +768,21 @@ int search_path(char *command)
     }
 
     // search in all paths
-    for (int i = 0; i < path_count; i++)
+    for (int i = 0; i < ctx->path_count; i++)
     {
-        if (search_paths[i] == NULL)
+        if (ctx->search_paths[i] == NULL)
             continue;
 
-        snprintf(full_path, sizeof(full_path), "%s/%s", search_paths[i], command);
+        snprintf(full_path, size, "%s/%s", ctx->search_paths[i], command);
         if (access(full_path, X_OK) == 0)
         {
-            strcpy(command, full_path);
             return 1;
         }
     }
     return 0;
 }
 
-void free_command_list(CommandList *list)
+static void free_command_list(CommandList *list)
 {
     if (!list)
         return;
@@ -439,6 +792,10 @@ void free_command_list(CommandList *list)
         while (cmd)
         {
             Command *next = cmd->next;
+            for (int j = 0; j < cmd->procsub_count; j++)
+            {
+                free(cmd->procsubs[j].line);
+            }
             free(cmd);
             cmd = next;
         }
@@ -447,297 +804,3379 @@ void free_command_list(CommandList *list)
     free(list);
 }
 
-void execute_command(Command *cmd)
+// the args of a parsed line point at the token values, so these go last
+static void free_tokens(Token *tokens, int count)
 {
-    // handling built-in commands
-    if (strcmp(cmd->args[0], "cd") == 0)
+    for (int i = 0; i < count; i++)
     {
-        if (cmd->arg_count == 1)
+        free(tokens[i].value);
+        tokens[i].value = NULL;
+    }
+}
+
+// exit status of a reaped child, shell style (128 + signal when killed)
+static int wait_status(int status)
+{
+    if (WIFEXITED(status))
+    {
+        return WEXITSTATUS(status);
+    }
+    if (WIFSIGNALED(status))
+    {
+        return 128 + WTERMSIG(status);
+    }
+    return 1;
+}
+
+// a child the shell is waiting for, filled in by the loop when it exits
+typedef struct child_wait
+{
+    int done;
+    int status;
+} ChildWait;
+
+static void child_exited(struct evloop *loop, pid_t pid, int status, void *arg)
+{
+    ChildWait *wait = arg;
+    (void)loop;
+    (void)pid;
+    if (wait)
+    {
+        wait->status = wait_status(status);
+        wait->done = 1;
+    }
+}
+
+// a child the zygote started: it isn't the shell's to reap, so its status
+// comes as a message from the zygote instead of from the loop
+typedef struct zygote_child
+{
+    pid_t pid;
+    int watched;     // watch_child() was called for it
+    ChildWait *wait;
+    int exited;      // before it was watched
+    int status;
+} ZygoteChild;
+
+static void forget_zygote_child(struct wish_ctx *ctx, ZygoteChild *child)
+{
+    *child = ctx->zchildren[--ctx->zchild_count];
+}
+
+// the zygote's exit callback
+static void zygote_child_exited(pid_t pid, int status, void *arg)
+{
+    struct wish_ctx *ctx = arg;
+    for (int i = 0; i < ctx->zchild_count; i++)
+    {
+        ZygoteChild *child = &ctx->zchildren[i];
+        if (child->pid != pid)
         {
-            fprintf(stderr, "An error has occurred\n");
-            return;
+            continue;
         }
-        if (chdir(cmd->args[1]) != 0)
+        if (child->watched)
         {
-            fprintf(stderr, "An error has occurred\n");
+            child_exited(ctx->loop, pid, status, child->wait);
+            forget_zygote_child(ctx, child);
+        }
+        else
+        {
+            child->exited = 1;
+            child->status = status;
         }
         return;
     }
+}
 
-    // Add path command handling
-    if (strcmp(cmd->args[0], "path") == 0)
+// no zygote any more: the commands it started are given up on (their
+// waits end with status 1) and the next ones are forked here again
+static void drop_zygote(struct wish_ctx *ctx)
+{
+    if (!ctx->zygote)
     {
-        handle_path_command(cmd);
         return;
     }
-
-    pid_t pid = fork();
-
-    if (pid == 0)
-    { // child process
-        // set up process group for background processes
-        if (cmd->background)
+    ev_del_fd(ctx->loop, zygote_fd(ctx->zygote));
+    zygote_stop(ctx->zygote);
+    ctx->zygote = NULL;
+    for (int i = 0; i < ctx->zchild_count; i++)
+    {
+        if (ctx->zchildren[i].watched)
         {
-            setpgid(0, 0); // put the process in its own process group
+            child_exited(ctx->loop, ctx->zchildren[i].pid, 1 << 8, ctx->zchildren[i].wait);
         }
+    }
+    ctx->zchild_count = 0;
+}
 
-        // input redirection
-        if (cmd->input_file)
+static void zygote_ready(struct evloop *loop, int fd, void *arg)
+{
+    struct wish_ctx *ctx = arg;
+    (void)loop;
+    (void)fd;
+    if (zygote_dispatch(ctx->zygote) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        drop_zygote(ctx);
+    }
+}
+
+// has the loop reap pid when it exits; wait is NULL for children nobody
+// waits for (background commands)
+static void watch_child(struct wish_ctx *ctx, pid_t pid, ChildWait *wait)
+{
+    if (wait)
+    {
+        wait->done = 0;
+        wait->status = 0;
+    }
+    for (int i = 0; i < ctx->zchild_count; i++)
+    {
+        ZygoteChild *child = &ctx->zchildren[i];
+        if (child->pid == pid)
         {
-            int fd = open(cmd->input_file, O_RDONLY);
-            if (fd == -1)
+            if (child->exited)
             {
-                fprintf(stderr, "An error has occurred\n");
-                exit(EXIT_FAILURE);
+                child_exited(ctx->loop, pid, child->status, wait);
+                forget_zygote_child(ctx, child);
             }
-            dup2(fd, STDIN_FILENO);
-            close(fd);
-        }
-
-        // output redirection
-        if (cmd->output_file)
-        {
-            int fd = open(cmd->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-            if (fd == -1)
+            else
             {
-                fprintf(stderr, "An error has occurred\n");
-                exit(EXIT_FAILURE);
+                child->watched = 1;
+                child->wait = wait;
             }
-            dup2(fd, STDOUT_FILENO);
-            close(fd);
+            return;
         }
+    }
+    if (ev_add_child(ctx->loop, pid, child_exited, wait) < 0 && wait)
+    {
+        // the loop couldn't take it -> plain blocking wait
+        int status = 0;
+        waitpid(pid, &status, 0);
+        child_exited(ctx->loop, pid, status, wait);
+    }
+}
 
-        if (search_path(cmd->args[0]))
+// runs the loop until all of them have exited. whatever else is registered
+// (job output, other children, timers) keeps being served in the meantime
+static void wait_children(struct wish_ctx *ctx, ChildWait *waits, int count)
+{
+    for (int i = 0; i < count; i++)
+    {
+        while (!waits[i].done)
         {
-            execv(cmd->args[0], cmd->args);
+            ev_run_once(ctx->loop, -1);
         }
-
-        fprintf(stderr, "An error has occurred\n");
-        exit(EXIT_FAILURE);
     }
-    else if (pid < 0)
+}
+
+// a forked subshell gets a loop of its own: the epoll set is shared across
+// fork, so registering its children in the parent's would mix them up. for
+// the same reason it forks its commands itself rather than share the zygote
+static void reset_shell_loop(struct wish_ctx *ctx)
+{
+    ev_free(ctx->loop);
+    ctx->loop = ev_new();
+    ctx->shares_terminal = 1;
+    if (ctx->zygote)
     {
-        fprintf(stderr, "An error has occurred\n");
-        return;
+        zygote_stop(ctx->zygote); // only this process's end of the socket
+        ctx->zygote = NULL;
+        ctx->zchild_count = 0;
     }
+}
 
-    // parent process
-    if (!cmd->background)
+// "0-3,6" -> cpu set, -1 if malformed
+static int parse_cpu_list(const char *text, cpu_set_t *cpus)
+{
+    CPU_ZERO(cpus);
+    while (*text)
     {
-        int status;
-        waitpid(pid, &status, 0);
+        char *end;
+        long first = strtol(text, &end, 10);
+        long last = first;
+        if (end == text || first < 0)
+        {
+            return -1;
+        }
+        if (*end == '-')
+        {
+            text = end + 1;
+            last = strtol(text, &end, 10);
+            if (end == text || last < first)
+            {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE || (*end != ',' && *end != '\0'))
+        {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++)
+        {
+            CPU_SET(cpu, cpus);
+        }
+        text = *end ? end + 1 : end;
     }
+    return CPU_COUNT(cpus) > 0 ? 0 : -1;
 }
 
-void execute_pipeline(Command *cmd)
+// "-v 1024" (KiB), "-n 64" or "-t 10" (seconds) -> a pending rlimit; -1 if malformed
+static int parse_limit(ExecAttrs *attrs, const char *flag, const char *value)
 {
-    if (!cmd->next)
+    int resource;
+    rlim_t scale = 1;
+    if (strcmp(flag, "-v") == 0)
     {
-        // no pipe -> execute the single command
-        execute_command(cmd);
-        return;
+        resource = RLIMIT_AS;
+        scale = 1024;
     }
-
-    int num_commands = 0;
-    Command *current = cmd;
-    while (current)
+    else if (strcmp(flag, "-n") == 0)
     {
-        num_commands++;
-        current = current->next;
+        resource = RLIMIT_NOFILE;
+    }
+    else if (strcmp(flag, "-t") == 0)
+    {
+        resource = RLIMIT_CPU;
+    }
+    else
+    {
+        return -1;
     }
 
-    int pipes[num_commands - 1][2];
-    pid_t pids[num_commands];
-
-    // create all necessary pipes
-    for (int i = 0; i < num_commands - 1; i++)
+    rlim_t limit = RLIM_INFINITY;
+    if (strcmp(value, "unlimited") != 0)
     {
-        if (pipe(pipes[i]) == -1)
+        char *end;
+        unsigned long long n = strtoull(value, &end, 10);
+        if (end == value || *end != '\0' || value[0] == '-')
         {
-            perror("Pipe creation failed");
-            return;
+            return -1;
         }
+        limit = n * scale;
     }
 
-    // execute all commands in pipeline
-    current = cmd;
-    for (int i = 0; i < num_commands; i++)
+    int i = 0;
+    while (i < attrs->limit_count && attrs->limit_resources[i] != resource)
+    {
+        i++; // a repeated flag overrides the earlier one
+    }
+    attrs->limit_resources[i] = resource;
+    attrs->limit_values[i] = limit;
+    if (i == attrs->limit_count)
     {
-        pids[i] = fork();
+        attrs->limit_count++;
+    }
+    return 0;
+}
 
-        if (pids[i] == 0)
-        { // child process
-            // input redirection for first command
-            if (i == 0 && current->input_file)
-            {
-                int fd = open(current->input_file, O_RDONLY);
-                if (fd == -1)
-                {
-                    perror("Input redirection failed");
-                    exit(EXIT_FAILURE);
-                }
-                dup2(fd, STDIN_FILENO);
-                close(fd);
-            }
+// strips the "pin [-s] CPUS", "nice [-n] [N]" and "ulimit -v|-n|-t N ..."
+// prefixes (any number, in any order) off cmd into cmd->attrs;
+// returns -1 on bad usage
+static int strip_modifiers(Command *cmd)
+{
+    ExecAttrs *attrs = &cmd->attrs;
+    int skip = 0;
+    while (skip < cmd->arg_count)
+    {
+        char **args = cmd->args + skip;
+        int left = cmd->arg_count - skip;
 
-            // output redirection for last command
-            if (i == num_commands - 1 && current->output_file)
+        if (strcmp(args[0], "pin") == 0)
+        {
+            int i = 1;
+            if (i < left && strcmp(args[i], "-s") == 0)
             {
-                int fd = open(current->output_file, O_WRONLY | O_CREAT | O_TRUNC, 0644);
-                if (fd == -1)
-                {
-                    perror("Output redirection failed");
-                    exit(EXIT_FAILURE);
-                }
-                dup2(fd, STDOUT_FILENO);
-                close(fd);
+                attrs->siblings = 1;
+                i++;
             }
-
-            // setting up pipes
-            if (i > 0)
-            { // not 1st command -> read from previous pipe
-                dup2(pipes[i - 1][0], STDIN_FILENO);
+            if (i >= left || parse_cpu_list(args[i], &attrs->cpus) < 0)
+            {
+                return -1;
             }
-            if (i < num_commands - 1)
-            { // not last command -> write to next pipe
-                dup2(pipes[i][1], STDOUT_FILENO);
+            attrs->pinned = 1;
+            skip += i + 1;
+        }
+        else if (strcmp(args[0], "nice") == 0)
+        {
+            // like nice(1): the adjustment is 10 unless one is given
+            int i = 1;
+            if (i < left && strcmp(args[i], "-n") == 0)
+            {
+                i++;
             }
-
-            // close pipe file descriptors
-            for (int j = 0; j < num_commands - 1; j++)
+            char *end = NULL;
+            long n = i < left ? strtol(args[i], &end, 10) : 0;
+            if (end && end != args[i] && *end == '\0')
             {
-                close(pipes[j][0]);
-                close(pipes[j][1]);
+                i++;
             }
-
-            if (search_path(current->args[0]))
+            else if (i > 1)
             {
-                execvp(current->args[0], current->args);
+                return -1; // -n without a number
             }
             else
             {
-                fprintf(stderr, "An error has occurred\n");
-                exit(EXIT_FAILURE);
+                n = 10;
             }
+            attrs->niced = 1;
+            attrs->nice += n;
+            skip += i;
         }
-        else if (pids[i] < 0)
+        else if (strcmp(args[0], "ulimit") == 0)
         {
-            perror("Fork failed");
-            return;
+            int i = 1;
+            while (i + 1 < left && args[i][0] == '-')
+            {
+                if (parse_limit(attrs, args[i], args[i + 1]) < 0)
+                {
+                    return -1;
+                }
+                i += 2;
+            }
+            if (i == 1)
+            {
+                return -1;
+            }
+            skip += i;
+        }
+        else
+        {
+            break;
         }
-
-        current = current->next;
     }
 
-    // parent process -> close pipe file descriptors
-    for (int i = 0; i < num_commands - 1; i++)
+    if (skip == 0)
     {
-        close(pipes[i][0]);
-        close(pipes[i][1]);
+        return 0;
     }
+    if (skip >= cmd->arg_count)
+    {
+        return -1; // nothing to run
+    }
+    memmove(cmd->args, cmd->args + skip, (cmd->arg_count - skip + 1) * sizeof(char *));
+    cmd->arg_count -= skip;
+    return 0;
+}
 
-    // wait child processes to complete
-    for (int i = 0; i < num_commands; i++)
+// cpu topology number from sysfs, -1 if it isn't there
+static int read_topology(int cpu, const char *name)
+{
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/%s", cpu, name);
+    FILE *file = fopen(path, "r");
+    int value = -1;
+    if (file)
     {
-        waitpid(pids[i], NULL, 0);
+        if (fscanf(file, "%d", &value) != 1)
+        {
+            value = -1;
+        }
+        fclose(file);
     }
+    return value;
 }
 
-void process_line(char *line)
+// pin -s: stage i gets the i-th cpu of the set, with the cpus ordered by
+// package and core, so adjacent stages land on SMT siblings (or at least on
+// cores sharing a cache) and the data going through their pipe stays warm
+static void spread_over_siblings(Command *cmd)
 {
-    line[strcspn(line, "\n")] = 0;
+    int cpus[CPU_SETSIZE];
+    long keys[CPU_SETSIZE];
+    int n = 0;
 
-    if (strlen(line) == 0)
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
     {
-        return;
+        if (!CPU_ISSET(cpu, &cmd->attrs.cpus))
+        {
+            continue;
+        }
+        int package = read_topology(cpu, "physical_package_id");
+        int core = read_topology(cpu, "core_id");
+        long key = core < 0 ? cpu : (long)(package < 0 ? 0 : package) << 32 | core;
+
+        // insertion sort, the set is small
+        int i = n++;
+        while (i > 0 && keys[i - 1] > key)
+        {
+            keys[i] = keys[i - 1];
+            cpus[i] = cpus[i - 1];
+            i--;
+        }
+        keys[i] = key;
+        cpus[i] = cpu;
     }
 
-    if (strcmp(line, "exit") == 0)
+    int i = 0;
+    for (Command *stage = cmd; stage; stage = stage->next, i++)
     {
-        exit(0);
+        if (stage != cmd && stage->attrs.pinned)
+        {
+            continue; // a stage's own pin wins
+        }
+        CPU_ZERO(&stage->attrs.cpus);
+        CPU_SET(cpus[i % n], &stage->attrs.cpus);
+        stage->attrs.pinned = 1;
     }
+}
 
-    int token_count;
-    Token *tokens = tokenize_input(line, &token_count);
-    CommandList *cmd_list = parse_tokens(tokens, token_count);
-
-    // proceed if parsing was successful
-    if (cmd_list != NULL)
+// applies a command's modifiers to the calling process (the child, right
+// before exec)
+static int apply_exec_attrs(const ExecAttrs *attrs)
+{
+    if (attrs->pinned && sched_setaffinity(0, sizeof(cpu_set_t), &attrs->cpus) < 0)
     {
-        for (int i = 0; i < cmd_list->count; i++)
+        return -1;
+    }
+    if (attrs->niced && setpriority(PRIO_PROCESS, 0, getpriority(PRIO_PROCESS, 0) + attrs->nice) < 0)
+    {
+        return -1;
+    }
+    for (int i = 0; i < attrs->limit_count; i++)
+    {
+        // soft and hard together, like ulimit without -S/-H
+        struct rlimit limit = {attrs->limit_values[i], attrs->limit_values[i]};
+        if (setrlimit(attrs->limit_resources[i], &limit) < 0)
         {
-            execute_pipeline(cmd_list->commands[i]);
+            return -1;
         }
-        free_command_list(cmd_list);
     }
+    return 0;
 }
 
-void execute_batch_file(const char *filename)
+static int apply_modifiers(Command *cmd)
 {
-    FILE *batch_file = fopen(filename, "r");
-    if (!batch_file)
+    return apply_exec_attrs(&cmd->attrs);
+}
+
+// the same, as the zygote's setup hook
+static int zygote_setup(const void *attrs)
+{
+    return apply_exec_attrs(attrs);
+}
+
+// moves n bytes from a pipe to fd with splice(), or through a buffer when
+// fd doesn't support it; -1 on failure
+static int move_bytes(int from, int to, size_t n)
+{
+    while (n > 0)
     {
-        perror("An error has occurred");
-        return;
+        ssize_t moved = splice(from, NULL, to, NULL, n, SPLICE_F_MOVE);
+        if (moved < 0 && errno == EINVAL)
+        {
+            char buf[65536];
+            moved = read(from, buf, n < sizeof(buf) ? n : sizeof(buf));
+            for (ssize_t done = 0, w; moved > 0 && done < moved; done += w)
+            {
+                if ((w = write(to, buf + done, moved - done)) < 0)
+                {
+                    return -1;
+                }
+            }
+        }
+        if (moved < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (moved <= 0)
+        {
+            return -1;
+        }
+        n -= moved;
     }
+    return 0;
+}
 
-    char line[MAX_LINE];
-    while (fgets(line, sizeof(line), batch_file) != NULL)
+// the fan-out process gives up: the command's writes fail from then on and
+// the targets stay short, so it has to be said (the status is non-zero too)
+static void fan_out_failed(void)
+{
+    static const char error_message[] = "An error has occurred\n";
+    write(STDERR_FILENO, error_message, sizeof(error_message) - 1);
+    _exit(EXIT_FAILURE);
+}
+
+// the fan-out process: copies everything coming in to every fd of outs.
+// tee() duplicates the pipe's pages into one pipe per extra target without
+// consuming them, splice() moves them on into the files, so the data is never
+// copied through user space. the last target gets the original pages
+static void fan_out(int in, int *outs, int count)
+{
+    int pipes[MAX_OUTPUTS][2];
+    int size = fcntl(in, F_GETPIPE_SZ);
+    int smallest = 0;
+    for (int i = 0; i < count - 1; i++)
     {
-        process_line(line);
+        if (pipe(pipes[i]) < 0)
+        {
+            fan_out_failed();
+        }
+        // as big as the input pipe, so one tee() takes everything in it. that
+        // is refused once the user is over pipe-user-pages-soft: then each
+        // round moves what the smallest of the pipes holds
+        fcntl(pipes[i][1], F_SETPIPE_SZ, size);
+        if (fcntl(pipes[i][1], F_GETPIPE_SZ) < fcntl(pipes[smallest][1], F_GETPIPE_SZ))
+        {
+            smallest = i;
+        }
     }
 
-    fclose(batch_file);
-    exit(0);
+    while (1)
+    {
+        // the smallest pipe first: what it takes, the others take as well
+        ssize_t n = tee(in, pipes[smallest][1], size, 0);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n == 0)
+        {
+            _exit(0); // the command closed its stdout
+        }
+        if (n < 0)
+        {
+            fan_out_failed();
+        }
+
+        for (int i = 0; i < count - 1; i++)
+        {
+            if (i != smallest && tee(in, pipes[i][1], n, 0) != n)
+            {
+                fan_out_failed();
+            }
+        }
+        for (int i = 0; i < count - 1; i++)
+        {
+            if (move_bytes(pipes[i][0], outs[i], n) < 0)
+            {
+                fan_out_failed();
+            }
+        }
+        if (move_bytes(in, outs[count - 1], n) < 0)
+        {
+            fan_out_failed();
+        }
+    }
 }
 
-int main(int argc, char *argv[])
+// "> a > b ...": opens every target and forks the fan-out process that
+// copies into all of them (instead of a tee binary). returns the write end
+// to install as the command's stdout, -1 on failure
+static int start_fanout(struct wish_ctx *ctx, Command *cmd, ChildWait *wait)
 {
-    initialize_paths();
-    
-    // if more than one argument is provided
-    if (argc > 2)
+    int outs[MAX_OUTPUTS];
+    int data[2];
+
+    for (int i = 0; i < cmd->output_count; i++)
     {
-        fprintf(stderr, "An error has occurred\n");
-        exit(1);
+        outs[i] = openat(ctx->cwd_fd, cmd->output_files[i], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (outs[i] < 0)
+        {
+            while (i-- > 0)
+            {
+                close(outs[i]);
+            }
+            return -1;
+        }
     }
-    
-    // batch file provided as an argument
-    if (argc == 2)
+
+    pid_t pid = -1;
+    if (pipe2(data, O_CLOEXEC) == 0)
     {
-        // first argument after the program name -> treated as a batch file
-        FILE *batch_file = fopen(argv[1], "r");
-        if (!batch_file)
+        fcntl(data[0], F_SETPIPE_SZ, FANOUT_PIPE_SIZE); // fewer, bigger rounds
+        pid = fork();
+        if (pid == 0)
         {
-            fprintf(stderr, "An error has occurred\n");
-            exit(1);
+            close(data[1]);
+            fan_out(data[0], outs, cmd->output_count);
+        }
+        close(data[0]);
+        if (pid < 0)
+        {
+            close(data[1]);
+        }
+    }
+    for (int i = 0; i < cmd->output_count; i++)
+    {
+        close(outs[i]);
+    }
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    watch_child(ctx, pid, wait);
+    return data[1];
+}
+
+static int process_line(struct wish_ctx *ctx, char *line);
+
+// <(line) / >(line): runs each line in a forked subshell (process_line,
+// so execute_pipeline) with its stdout (or stdin) on a pipe, and puts
+// /dev/fd/N for the shell's end of that pipe into the command's argv.
+// nothing touches the disk, and the subshells run alongside the command.
+// returns -1 if one couldn't be started; *started of them were
+static int start_procsubs(struct wish_ctx *ctx, Command *cmd, ChildWait *waits, int *started)
+{
+    *started = 0;
+    for (int i = 0; i < cmd->procsub_count; i++)
+    {
+        ProcSub *sub = &cmd->procsubs[i];
+        int fds[2];
+        if (pipe2(fds, O_CLOEXEC) < 0)
+        {
+            return -1;
+        }
+
+        fflush(NULL);
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            dup2(fds[sub->output ? 0 : 1], sub->output ? STDIN_FILENO : STDOUT_FILENO);
+            // nothing else of the shell's: a pipe end held open here would
+            // keep another substitution (or the command) from seeing EOF.
+            // exec'd fds stay, and so does the context's directory, which
+            // the subshell's commands start in
+            syscall(SYS_close_range, MAX_USER_FD + 1, ctx->cwd_fd - 1, 0);
+            syscall(SYS_close_range, ctx->cwd_fd + 1, ~0U, 0);
+            reset_shell_loop(ctx);
+            int status = process_line(ctx, sub->line);
+            fflush(NULL);
+            _exit(status == WISH_EXIT ? 0 : status);
         }
-        
-        char line[MAX_LINE];
-        while (fgets(line, sizeof(line), batch_file) != NULL)
+        close(fds[sub->output ? 0 : 1]);
+        if (pid < 0)
         {
-            process_line(line);
+            close(fds[sub->output ? 1 : 0]);
+            return -1;
         }
+        watch_child(ctx, pid, waits ? &waits[i] : NULL);
+        (*started)++;
 
-        fclose(batch_file);
-        exit(0);
+        sub->fd = fds[sub->output ? 1 : 0];
+        snprintf(sub->path, sizeof(sub->path), "/dev/fd/%d", sub->fd);
+        for (int j = 0; j < cmd->arg_count; j++)
+        {
+            if (cmd->args[j] == sub->word)
+            {
+                cmd->args[j] = sub->path;
+            }
+        }
+        if (cmd->input_file == sub->word)
+        {
+            cmd->input_file = sub->path;
+        }
+        for (int j = 0; j < cmd->output_count; j++)
+        {
+            if (cmd->output_files[j] == sub->word)
+            {
+                cmd->output_files[j] = sub->path;
+            }
+        }
     }
+    return 0;
+}
 
-    // interactive mode
-    char line[MAX_LINE];
-    while (1)
+// in the command's child: its pipe ends have to survive the exec
+static void keep_procsubs(Command *cmd)
+{
+    for (int i = 0; i < cmd->procsub_count; i++)
+    {
+        if (cmd->procsubs[i].fd >= 0)
+        {
+            fcntl(cmd->procsubs[i].fd, F_SETFD, 0);
+        }
+    }
+}
+
+// in the shell once the command is forked (or failed to be)
+static void close_procsubs(Command *cmd)
+{
+    for (int i = 0; i < cmd->procsub_count; i++)
+    {
+        if (cmd->procsubs[i].fd >= 0)
+        {
+            close(cmd->procsubs[i].fd);
+            cmd->procsubs[i].fd = -1;
+        }
+    }
+}
+
+static int write_all(int fd, const char *data, size_t len)
+{
+    while (len > 0)
     {
-        printf("wish> ");
+        ssize_t n = write(fd, data, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        data += n;
+        len -= n;
+    }
+    return 0;
+}
 
-        if (fgets(line, sizeof(line), stdin) == NULL)
+// cmd's here-document body as an fd to read stdin from, without going
+// through the filesystem: a pipe when the whole body fits in one (written
+// up front, so it can't block), otherwise a memfd, sealed and rewound
+static int open_heredoc(Command *cmd)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == 0)
+    {
+        int size = fcntl(fds[1], F_GETPIPE_SZ);
+        if (size > 0 && cmd->heredoc_len <= (size_t)size &&
+            write_all(fds[1], cmd->heredoc_body, cmd->heredoc_len) == 0)
         {
-            printf("\n");
-            exit(0);
+            close(fds[1]);
+            return fds[0];
         }
+        close(fds[0]);
+        close(fds[1]);
+    }
 
-        // remove newline and process the line
-        process_line(line);
+    int fd = memfd_create("wish-heredoc", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (write_all(fd, cmd->heredoc_body, cmd->heredoc_len) < 0)
+    {
+        close(fd);
+        return -1;
     }
+    fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    lseek(fd, 0, SEEK_SET);
+    return fd;
+}
 
+// puts a CLOEXEC /dev/null on fd, so the shell's own fds (pipes, pidfds,
+// the epoll fd...) never get that number and an exec redirection can't
+// clobber one of them
+static int park_fd(int fd)
+{
+    int null = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (null < 0)
+    {
+        return -1;
+    }
+    if (null != fd)
+    {
+        dup3(null, fd, O_CLOEXEC);
+        close(null);
+    }
+    user_fds[fd] = 0;
     return 0;
-}
\ No newline at end of file
+}
+
+// at startup: fds 3..MAX_USER_FD are left to exec redirections
+static void reserve_user_fds(void)
+{
+    for (int fd = 3; fd <= MAX_USER_FD; fd++)
+    {
+        if (fcntl(fd, F_GETFD) < 0)
+        {
+            park_fd(fd);
+        }
+        else
+        {
+            user_fds[fd] = 1; // inherited, so it's the user's
+        }
+    }
+}
+
+// applies cmd's fd redirections to the calling process: a command's child,
+// or with in_shell the shell itself (exec), where they stay for every
+// command after it. -1 on failure
+static int apply_redirs(struct wish_ctx *ctx, Command *cmd, int in_shell)
+{
+    for (int i = 0; i < cmd->redir_count; i++)
+    {
+        Redir *redir = &cmd->redirs[i];
+        int user = redir->fd >= 3 && redir->fd <= MAX_USER_FD;
+
+        if (redir->kind == REDIR_CLOSE)
+        {
+            if (in_shell && user)
+            {
+                park_fd(redir->fd);
+            }
+            else
+            {
+                close(redir->fd);
+            }
+            continue;
+        }
+
+        int fd;
+        if (redir->kind == REDIR_DUP)
+        {
+            // a parked fd is only /dev/null, so it counts as closed
+            if ((redir->source >= 3 && !user_fds[redir->source]) || fcntl(redir->source, F_GETFD) < 0)
+            {
+                return -1;
+            }
+            fd = redir->source;
+        }
+        else
+        {
+            int flags = redir->kind == REDIR_READ ? O_RDONLY
+                        : redir->kind == REDIR_APPEND ? O_WRONLY | O_CREAT | O_APPEND
+                                                      : O_WRONLY | O_CREAT | O_TRUNC;
+            fd = openat(ctx->cwd_fd, redir->target, flags | O_CLOEXEC, 0644);
+            if (fd < 0)
+            {
+                return -1;
+            }
+        }
+
+        if (fd == redir->fd)
+        {
+            fcntl(fd, F_SETFD, 0); // only the descriptor itself had to be opened
+        }
+        else
+        {
+            if (redir->fd <= STDERR_FILENO)
+            {
+                fflush(NULL);
+            }
+            dup2(fd, redir->fd); // the copy is inherited by every exec
+            if (redir->kind != REDIR_DUP)
+            {
+                close(fd);
+            }
+        }
+        if (user)
+        {
+            user_fds[redir->fd] = 1;
+        }
+    }
+    return 0;
+}
+
+// "exec N>file ...": with nothing to run, exec applies its redirections to
+// the shell, so the fds are opened once and every later command inherits
+// them (>&N / <&N) instead of opening and truncating the file again
+static int exec_redirections(struct wish_ctx *ctx, Command *cmd)
+{
+    if (cmd->arg_count > 1 || cmd->heredoc_delim || cmd->procsub_count > 0 || cmd->output_count > 1)
+    {
+        return -1; // replacing the shell with a command isn't supported
+    }
+
+    // plain "exec < file" / "exec > file" too
+    Command plain = {0};
+    if (cmd->input_file)
+    {
+        plain.redirs[plain.redir_count++] = (Redir){STDIN_FILENO, REDIR_READ, cmd->input_file, 0};
+    }
+    if (cmd->output_count == 1)
+    {
+        plain.redirs[plain.redir_count++] = (Redir){STDOUT_FILENO, REDIR_WRITE, cmd->output_files[0], 0};
+    }
+    if (apply_redirs(ctx, &plain, 1) < 0)
+    {
+        return -1;
+    }
+    return apply_redirs(ctx, cmd, 1);
+}
+
+// the child's fd table as the zygote is to build it: target_fds[i] gets a
+// copy of fds[i]; -1 when the table is full
+static int set_job_fd(struct zygote_job *job, int target, int fd)
+{
+    for (int i = 0; i < job->fd_count; i++)
+    {
+        if (job->target_fds[i] == target)
+        {
+            job->fds[i] = fd;
+            return 0;
+        }
+    }
+    if (job->fd_count == ZYGOTE_MAX_FDS)
+    {
+        return -1;
+    }
+    job->target_fds[job->fd_count] = target;
+    job->fds[job->fd_count++] = fd;
+    return 0;
+}
+
+// the fd that target will be a copy of, -1 if it's going to be closed
+static int job_fd(struct zygote_job *job, int target)
+{
+    for (int i = 0; i < job->fd_count; i++)
+    {
+        if (job->target_fds[i] == target)
+        {
+            return job->fds[i];
+        }
+    }
+    return -1;
+}
+
+static void unset_job_fd(struct zygote_job *job, int target)
+{
+    for (int i = 0; i < job->fd_count; i++)
+    {
+        if (job->target_fds[i] == target)
+        {
+            job->target_fds[i] = job->target_fds[--job->fd_count];
+            job->fds[i] = job->fds[job->fd_count];
+            return;
+        }
+    }
+}
+
+// -z: has the zygote start cmd, with in_fd / out_fd (-1 = none) as its
+// stdin / stdout over its own < and >, and in process group pgid (-1 =
+// the shell's, 0 = a new one). everything a forked child does between fork
+// and exec is worked out here first: the files it would open are opened
+// now, its redirections become the fd table the zygote installs, and the
+// path search is done. returns the pid, or -1 with nothing started; then
+// the command is forked here as usual (which also reports the errors)
+static pid_t zygote_command(struct wish_ctx *ctx, Command *cmd, int in_fd, int out_fd, pid_t pgid)
+{
+    if (!ctx->zygote || cmd->group) // a group needs a copy of the shell to run in
+    {
+        return -1;
+    }
+
+    struct zygote_job job = {0};
+    int opened[ZYGOTE_MAX_FDS];
+    int open_count = 0;
+    int failed = 0;
+    pid_t pid = -1;
+
+    // what a forked child would inherit: stdio, the exec'd fds, the
+    // substitutions' pipe ends
+    for (int fd = 0; fd <= MAX_USER_FD; fd++)
+    {
+        if (fd <= STDERR_FILENO || user_fds[fd])
+        {
+            set_job_fd(&job, fd, fd);
+        }
+    }
+    for (int i = 0; i < cmd->procsub_count && !failed; i++)
+    {
+        if (cmd->procsubs[i].fd >= 0)
+        {
+            failed = set_job_fd(&job, cmd->procsubs[i].fd, cmd->procsubs[i].fd) < 0;
+        }
+    }
+
+    // < and >, then N>file, >&N ... in order, as apply_redirs() does them
+    Command plain = {0};
+    if (in_fd < 0 && cmd->input_file)
+    {
+        plain.redirs[plain.redir_count++] = (Redir){STDIN_FILENO, REDIR_READ, cmd->input_file, 0};
+    }
+    if (out_fd < 0 && cmd->output_count == 1)
+    {
+        plain.redirs[plain.redir_count++] = (Redir){STDOUT_FILENO, REDIR_WRITE, cmd->output_files[0], 0};
+    }
+    if (in_fd >= 0)
+    {
+        set_job_fd(&job, STDIN_FILENO, in_fd);
+    }
+    if (out_fd >= 0)
+    {
+        set_job_fd(&job, STDOUT_FILENO, out_fd);
+    }
+    for (int i = 0; i < plain.redir_count + cmd->redir_count && !failed; i++)
+    {
+        Redir *redir = i < plain.redir_count ? &plain.redirs[i] : &cmd->redirs[i - plain.redir_count];
+        int fd;
+        if (redir->kind == REDIR_CLOSE)
+        {
+            unset_job_fd(&job, redir->fd);
+            continue;
+        }
+        if (redir->kind == REDIR_DUP)
+        {
+            int user = redir->source >= 3 && redir->source <= MAX_USER_FD;
+            fd = (redir->source >= 3 && !(user && user_fds[redir->source])) ? -1 : job_fd(&job, redir->source);
+        }
+        else
+        {
+            int flags = redir->kind == REDIR_READ ? O_RDONLY
+                        : redir->kind == REDIR_APPEND ? O_WRONLY | O_CREAT | O_APPEND
+                                                      : O_WRONLY | O_CREAT | O_TRUNC;
+            fd = open_count < ZYGOTE_MAX_FDS ? openat(ctx->cwd_fd, redir->target, flags | O_CLOEXEC, 0644) : -1;
+            if (fd >= 0)
+            {
+                opened[open_count++] = fd;
+            }
+        }
+        failed = fd < 0 || set_job_fd(&job, redir->fd, fd) < 0;
+    }
+
+    char path[PATH_MAX];
+    char *argv[MAX_ARGS + 1];
+    if (!failed && search_path(ctx, cmd->args[0], path, sizeof(path)) && cmd->arg_count < MAX_ARGS)
+    {
+        // room for it in the table of children first: it can't be lost once started
+        if (ctx->zchild_count == ctx->zchild_cap)
+        {
+            int cap = ctx->zchild_cap ? ctx->zchild_cap * 2 : 16;
+            ZygoteChild *grown = realloc(ctx->zchildren, cap * sizeof(ZygoteChild));
+            if (grown)
+            {
+                ctx->zchildren = grown;
+                ctx->zchild_cap = cap;
+            }
+        }
+
+        memcpy(argv, cmd->args, cmd->arg_count * sizeof(char *));
+        argv[0] = path;
+        argv[cmd->arg_count] = NULL;
+        job.path = path;
+        job.argv = argv;
+        job.env = ctx->env;
+        job.cwd_fd = ctx->cwd_fd;
+        job.pgid = pgid;
+        ExecAttrs *attrs = &cmd->attrs;
+        if (attrs->pinned || attrs->niced || attrs->limit_count > 0)
+        {
+            job.setup = zygote_setup;
+            job.data = attrs;
+            job.data_len = sizeof(ExecAttrs);
+        }
+        if (ctx->zchild_count < ctx->zchild_cap && (pid = zygote_spawn(ctx->zygote, &job)) > 0)
+        {
+            ctx->zchildren[ctx->zchild_count++] = (ZygoteChild){pid, 0, NULL, 0, 0};
+        }
+    }
+
+    while (open_count > 0)
+    {
+        close(opened[--open_count]);
+    }
+    return pid;
+}
+
+// runs text (with the here-document bodies of its commands after its first
+// newline) or, when text is NULL, every line of file, from inside a line
+// that is still running: that line's tokens are put aside meanwhile. an
+// "exit" in there only ends what is run here
+static int run_nested(struct wish_ctx *ctx, char *text, FILE *file)
+{
+    if (ctx->depth == MAX_NESTING)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    Token saved[MAX_TOKENS];
+    memcpy(saved, ctx->tokens, sizeof(saved));
+    ctx->depth++;
+    int status = text ? process_line(ctx, text) : wish_run_file(ctx, file, 0);
+    ctx->depth--;
+    memcpy(ctx->tokens, saved, sizeof(saved));
+    return status == WISH_EXIT ? 0 : status;
+}
+
+// runs the commands inside cmd's group in the calling process
+static int run_group(struct wish_ctx *ctx, Command *cmd)
+{
+    size_t len = strlen(cmd->args[0]) - 2; // without the brackets
+    char *text = malloc(len + cmd->group_bodies_len + 2);
+    if (!text)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    memcpy(text, cmd->args[0] + 1, len);
+    text[len] = '\0';
+    if (cmd->group_bodies_len > 0)
+    {
+        text[len] = '\n';
+        memcpy(text + len + 1, cmd->group_bodies, cmd->group_bodies_len);
+        text[len + 1 + cmd->group_bodies_len] = '\0';
+    }
+    int status = run_nested(ctx, text, NULL);
+    free(text);
+    return status;
+}
+
+// "source file" / ". file": the lines of file run in this context, so what
+// its cd, path and exec do stays in effect after it
+static int source_file(struct wish_ctx *ctx, Command *cmd)
+{
+    int fd = cmd->arg_count == 2 ? openat(ctx->cwd_fd, cmd->args[1], O_RDONLY | O_CLOEXEC) : -1;
+    FILE *file = fd >= 0 ? fdopen(fd, "r") : NULL;
+    if (!file)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return 1;
+    }
+    int status = run_nested(ctx, NULL, file);
+    fclose(file);
+    return status;
+}
+
+// { ...; } and source: no process of their own. their redirections are
+// applied to the shell for as long as they run (to the whole process, as
+// with exec) and every command inside inherits them; then the fds are put
+// back
+static int run_in_shell(struct wish_ctx *ctx, Command *cmd)
+{
+    ChildWait fanout_wait;
+    ChildWait sub_waits[MAX_PROCSUBS];
+    int subs = 0;
+    int fanout_fd = -1;
+    int heredoc_fd = -1;
+    int failed = (cmd->heredoc_delim && (heredoc_fd = open_heredoc(cmd)) < 0) ||
+                 start_procsubs(ctx, cmd, sub_waits, &subs) < 0 ||
+                 (cmd->output_count > 1 && (fanout_fd = start_fanout(ctx, cmd, &fanout_wait)) < 0);
+
+    // every fd a redirection replaces is copied out of the way first
+    int targets[MAX_REDIRS + 2];
+    int saved[MAX_REDIRS + 2];
+    int flags[MAX_REDIRS + 2];
+    int target_count = 0;
+    int saved_user_fds[MAX_USER_FD + 1];
+    memcpy(saved_user_fds, user_fds, sizeof(user_fds));
+    if (heredoc_fd >= 0 || cmd->input_file)
+    {
+        targets[target_count++] = STDIN_FILENO;
+    }
+    if (cmd->output_count > 0)
+    {
+        targets[target_count++] = STDOUT_FILENO;
+    }
+    for (int i = 0; i < cmd->redir_count; i++)
+    {
+        targets[target_count++] = cmd->redirs[i].fd;
+    }
+    fflush(NULL);
+    for (int i = 0; i < target_count; i++)
+    {
+        flags[i] = fcntl(targets[i], F_GETFD);
+        saved[i] = flags[i] < 0 ? -1 : fcntl(targets[i], F_DUPFD_CLOEXEC, MAX_USER_FD + 1);
+        failed |= flags[i] >= 0 && saved[i] < 0;
+    }
+
+    if (!failed && heredoc_fd >= 0)
+    {
+        dup2(heredoc_fd, STDIN_FILENO);
+    }
+    else if (!failed && cmd->input_file)
+    {
+        int fd = openat(ctx->cwd_fd, cmd->input_file, O_RDONLY | O_CLOEXEC);
+        failed = fd < 0 || dup2(fd, STDIN_FILENO) < 0;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    if (!failed && fanout_fd >= 0)
+    {
+        dup2(fanout_fd, STDOUT_FILENO);
+    }
+    else if (!failed && cmd->output_count == 1)
+    {
+        int fd = openat(ctx->cwd_fd, cmd->output_files[0], O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        failed = fd < 0 || dup2(fd, STDOUT_FILENO) < 0;
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+    failed = failed || apply_redirs(ctx, cmd, 0) < 0;
+
+    int status = 1;
+    if (failed)
+    {
+        fprintf(stderr, "An error has occurred\n");
+    }
+    else
+    {
+        status = cmd->group ? run_group(ctx, cmd) : source_file(ctx, cmd);
+    }
+
+    // put back in reverse, so an fd redirected twice ends up as it was
+    fflush(NULL);
+    for (int i = target_count - 1; i >= 0; i--)
+    {
+        if (saved[i] >= 0)
+        {
+            dup3(saved[i], targets[i], flags[i] & FD_CLOEXEC ? O_CLOEXEC : 0);
+            close(saved[i]);
+        }
+        else if (flags[i] < 0)
+        {
+            close(targets[i]);
+        }
+    }
+    memcpy(user_fds, saved_user_fds, sizeof(user_fds));
+
+    if (heredoc_fd >= 0)
+    {
+        close(heredoc_fd);
+    }
+    int fanout_status = 0;
+    if (fanout_fd >= 0)
+    {
+        close(fanout_fd);
+        wait_children(ctx, &fanout_wait, 1);
+        fanout_status = fanout_wait.status;
+    }
+    close_procsubs(cmd);
+    wait_children(ctx, sub_waits, subs);
+    status = cmd->status_is_zero ? 0 : status;
+    return status ? status : fanout_status; // targets left short fail it too
+}
+
+static int execute_command(struct wish_ctx *ctx, Command *cmd)
+{
+    // pin/nice/ulimit prefixes
+    if (strip_modifiers(cmd) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+
+    // { ...; } runs right here; ( ... ) is forked once, below, like a command
+    if (cmd->group == '{' || strcmp(cmd->args[0], "source") == 0 || strcmp(cmd->args[0], ".") == 0)
+    {
+        return run_in_shell(ctx, cmd);
+    }
+
+    // handling built-in commands
+    if (strcmp(cmd->args[0], "cd") == 0)
+    {
+        if (cmd->arg_count == 1)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            return 1;
+        }
+        // only the context moves: its children start there, the process stays put
+        int fd = openat(ctx->cwd_fd, cmd->args[1], O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            return 1;
+        }
+        close(ctx->cwd_fd);
+        ctx->cwd_fd = fd;
+        return 0;
+    }
+
+    // Add path command handling
+    if (strcmp(cmd->args[0], "path") == 0)
+    {
+        handle_path_command(ctx, cmd);
+        return 0;
+    }
+
+    if (strcmp(cmd->args[0], "exec") == 0)
+    {
+        if (exec_redirections(ctx, cmd) < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            return 1;
+        }
+        return 0;
+    }
+
+    // <<DELIM, <(...) / >(...) and several "> file"s: the body's fd, the
+    // subshells and the fan-out process are all set up before the command
+    ChildWait waits[2];
+    ChildWait sub_waits[MAX_PROCSUBS];
+    int subs = 0;
+    int fanout_fd = -1;
+    int heredoc_fd = -1;
+    if (cmd->heredoc_delim && (heredoc_fd = open_heredoc(cmd)) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    if (start_procsubs(ctx, cmd, cmd->background ? NULL : sub_waits, &subs) < 0 ||
+        (cmd->output_count > 1 && (fanout_fd = start_fanout(ctx, cmd, cmd->background ? NULL : &waits[1])) < 0))
+    {
+        fprintf(stderr, "An error has occurred\n");
+        if (heredoc_fd >= 0)
+        {
+            close(heredoc_fd);
+        }
+        close_procsubs(cmd);
+        if (!cmd->background)
+        {
+            wait_children(ctx, sub_waits, subs);
+        }
+        return 1;
+    }
+
+    pid_t pid = zygote_command(ctx, cmd, heredoc_fd, fanout_fd, cmd->background ? 0 : -1);
+    if (pid < 0)
+    {
+        pid = fork();
+    }
+
+    if (pid == 0)
+    { // child process
+        fchdir(ctx->cwd_fd);
+
+        // set up process group for background processes
+        if (cmd->background)
+        {
+            setpgid(0, 0); // put the process in its own process group
+        }
+
+        // input redirection
+        if (heredoc_fd >= 0)
+        {
+            dup2(heredoc_fd, STDIN_FILENO);
+        }
+        else if (cmd->input_file)
+        {
+            int fd = open(cmd->input_file, O_RDONLY);
+            if (fd == -1)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                _exit(EXIT_FAILURE);
+            }
+            dup2(fd, STDIN_FILENO);
+            close(fd);
+        }
+
+        // output redirection
+        if (fanout_fd >= 0)
+        {
+            dup2(fanout_fd, STDOUT_FILENO);
+        }
+        else if (cmd->output_count == 1)
+        {
+            int fd = open(cmd->output_files[0], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (fd == -1)
+            {
+                fprintf(stderr, "An error has occurred\n");
+                _exit(EXIT_FAILURE);
+            }
+            dup2(fd, STDOUT_FILENO);
+            close(fd);
+        }
+
+        if (apply_redirs(ctx, cmd, 0) < 0 || apply_modifiers(cmd) < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            _exit(EXIT_FAILURE);
+        }
+        keep_procsubs(cmd);
+
+        if (cmd->group)
+        {
+            // the subshell: one process for every command in the group. it
+            // runs in the shell's place, so the terminal is as much its own
+            int shares_terminal = ctx->shares_terminal;
+            reset_shell_loop(ctx);
+            ctx->shares_terminal = shares_terminal;
+            int status = run_group(ctx, cmd);
+            fflush(NULL);
+            _exit(status);
+        }
+
+        char path[PATH_MAX];
+        if (search_path(ctx, cmd->args[0], path, sizeof(path)))
+        {
+            cmd->args[0] = path;
+            execve(path, cmd->args, ctx->env);
+        }
+
+        fprintf(stderr, "An error has occurred\n");
+        _exit(EXIT_FAILURE);
+    }
+
+    // parent process; the fan-out and the >(...) subshells end once the
+    // command's end of their pipes is closed
+    if (fanout_fd >= 0)
+    {
+        close(fanout_fd);
+    }
+    if (heredoc_fd >= 0)
+    {
+        close(heredoc_fd);
+    }
+    close_procsubs(cmd);
+    if (pid < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        if (!cmd->background)
+        {
+            wait_children(ctx, &waits[1], fanout_fd >= 0 ? 1 : 0);
+            wait_children(ctx, sub_waits, subs);
+        }
+        return 1;
+    }
+
+    if (!cmd->background)
+    {
+        watch_child(ctx, pid, &waits[0]);
+        wait_children(ctx, waits, fanout_fd >= 0 ? 2 : 1);
+        wait_children(ctx, sub_waits, subs);
+        int status = cmd->status_is_zero ? 0 : waits[0].status;
+        return status || fanout_fd < 0 ? status : waits[1].status; // targets left short fail it too
+    }
+    watch_child(ctx, pid, NULL); // reaped whenever the loop next runs
+    return 0;
+}
+
+// a pipeline running under the timeout builtin
+typedef struct timeout
+{
+    pid_t pgid;         // process group holding every stage
+    long kill_after_ms; // 0 = never escalate to SIGKILL
+    int timer;          // pending timer id (-1 = none)
+    int expired;        // SIGTERM was sent
+} Timeout;
+
+// makes pgid the terminal's foreground group. a process outside of it gets
+// SIGTTOU for that, which the shell ignores while it does so
+static void set_terminal(pid_t pgid)
+{
+    void (*old)(int) = signal(SIGTTOU, SIG_IGN);
+    tcsetpgrp(STDIN_FILENO, pgid);
+    signal(SIGTTOU, old);
+}
+
+// a timed pipeline has a process group of its own, which has to have the
+// terminal to read from it (anything else stops on SIGTTIN) and to get
+// ctrl-c. only the shell that has the terminal gives it away; 1 if it did
+static int give_terminal(struct wish_ctx *ctx, pid_t pgid)
+{
+    if (ctx->shares_terminal || !isatty(STDIN_FILENO) || tcgetpgrp(STDIN_FILENO) != getpgrp())
+    {
+        return 0;
+    }
+    set_terminal(pgid);
+    kill(-pgid, SIGCONT); // a stage that read before it had the terminal stopped
+    return 1;
+}
+
+// "10", "1.5", "30s", "2m", "1h", "1d" -> milliseconds, -1 if malformed
+static long parse_duration(const char *text)
+{
+    char *end;
+    double value = strtod(text, &end);
+    double unit = 1000;
+    if (end == text || !(value >= 0))
+    {
+        return -1;
+    }
+    if (*end == 's' || *end == 'm' || *end == 'h' || *end == 'd')
+    {
+        unit = *end == 's' ? 1000 : *end == 'm' ? 60000 : *end == 'h' ? 3600000 : 86400000;
+        end++;
+    }
+    if (*end != '\0')
+    {
+        return -1;
+    }
+    value *= unit;
+    return value > 1e15 ? (long)1e15 : (long)(value + 0.5);
+}
+
+// strips "timeout [-k DURATION] DURATION" off the front of cmd;
+// returns -1 on bad usage
+static int strip_timeout(Command *cmd, long *timeout_ms, long *kill_after_ms)
+{
+    int skip = 1;
+    *kill_after_ms = TIMEOUT_KILL_AFTER_MS;
+    if (skip < cmd->arg_count && strcmp(cmd->args[skip], "-k") == 0)
+    {
+        if (skip + 1 >= cmd->arg_count || (*kill_after_ms = parse_duration(cmd->args[skip + 1])) < 0)
+        {
+            return -1;
+        }
+        skip += 2;
+    }
+    if (skip >= cmd->arg_count || (*timeout_ms = parse_duration(cmd->args[skip])) < 0)
+    {
+        return -1;
+    }
+    skip++;
+    if (skip >= cmd->arg_count)
+    {
+        return -1; // nothing to run
+    }
+
+    memmove(cmd->args, cmd->args + skip, (cmd->arg_count - skip + 1) * sizeof(char *));
+    cmd->arg_count -= skip;
+    return 0;
+}
+
+static void timeout_kill(struct evloop *loop, void *arg)
+{
+    Timeout *timeout = arg;
+    (void)loop;
+    timeout->timer = -1;
+    kill(-timeout->pgid, SIGKILL);
+}
+
+static void timeout_expired(struct evloop *loop, void *arg)
+{
+    Timeout *timeout = arg;
+    timeout->timer = -1;
+    timeout->expired = 1;
+    kill(-timeout->pgid, SIGTERM);
+    kill(-timeout->pgid, SIGCONT); // a stopped process only sees the TERM once it runs
+    if (timeout->kill_after_ms > 0)
+    {
+        timeout->timer = ev_add_timer(loop, timeout->kill_after_ms, timeout_kill, timeout);
+    }
+}
+
+static int execute_pipeline(struct wish_ctx *ctx, Command *cmd)
+{
+    // "timeout [-k KILL_AFTER] DURATION cmd | ..." limits the whole pipeline:
+    // all stages go in one process group, and a timer in the shell loop
+    // signals that group (no helper process in between)
+    Timeout timeout = {0, 0, -1, 0};
+    int gave_terminal = 0;
+    long timeout_ms = -1;
+    if (cmd->arg_count > 0 && strcmp(cmd->args[0], "timeout") == 0 &&
+        strip_timeout(cmd, &timeout_ms, &timeout.kill_after_ms) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+
+    if (!cmd->next && timeout_ms < 0)
+    {
+        // no pipe -> execute the single command
+        return execute_command(ctx, cmd);
+    }
+
+    int num_commands = 0;
+    Command *current = cmd;
+    while (current)
+    {
+        num_commands++;
+        current = current->next;
+    }
+
+    // every stage can have its own prefixes; "pin -s" on the first one
+    // spreads all of them over neighbouring cores
+    for (current = cmd; current; current = current->next)
+    {
+        if (strip_modifiers(current) < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            return 1;
+        }
+    }
+    if (cmd->attrs.siblings)
+    {
+        spread_over_siblings(cmd);
+    }
+
+    // a timed command runs here alone, with no pipe to set up (and a VLA
+    // can't have zero elements)
+    int pipes[num_commands > 1 ? num_commands - 1 : 1][2];
+    ChildWait waits[num_commands];
+    int started = 0;
+    int failed = 0;
+    Command *last = cmd;
+    while (last->next)
+    {
+        last = last->next;
+    }
+
+    // every stage's <(...) / >(...) and the last stage's "> a > b ..." fan-out
+    // are started before the pipes, so they don't hold on to any of them
+    ChildWait sub_waits[num_commands][MAX_PROCSUBS];
+    int subs[num_commands];
+    ChildWait fanout_wait;
+    int fanout_fd = -1;
+    int heredoc_fd = -1;
+    int setup_failed = 0;
+    int stage = 0;
+    if (cmd->heredoc_delim && (heredoc_fd = open_heredoc(cmd)) < 0)
+    {
+        perror("Here-document failed");
+        return 1;
+    }
+    for (current = cmd; current; current = current->next, stage++)
+    {
+        subs[stage] = 0;
+        if (!setup_failed && start_procsubs(ctx, current, sub_waits[stage], &subs[stage]) < 0)
+        {
+            perror("Process substitution failed");
+            setup_failed = 1;
+        }
+    }
+    if (!setup_failed && last->output_count > 1 && (fanout_fd = start_fanout(ctx, last, &fanout_wait)) < 0)
+    {
+        perror("Output redirection failed");
+        setup_failed = 1;
+    }
+
+    // create all necessary pipes
+    for (int i = 0; !setup_failed && i < num_commands - 1; i++)
+    {
+        if (pipe2(pipes[i], O_CLOEXEC) == -1) // another thread's fork mustn't inherit them
+        {
+            perror("Pipe creation failed");
+            setup_failed = 1;
+            while (i-- > 0)
+            {
+                close(pipes[i][0]);
+                close(pipes[i][1]);
+            }
+        }
+    }
+
+    if (setup_failed)
+    {
+        if (heredoc_fd >= 0)
+        {
+            close(heredoc_fd);
+        }
+        stage = 0;
+        for (current = cmd; current; current = current->next, stage++)
+        {
+            close_procsubs(current);
+            wait_children(ctx, sub_waits[stage], subs[stage]);
+        }
+        if (fanout_fd >= 0)
+        {
+            close(fanout_fd);
+            wait_children(ctx, &fanout_wait, 1);
+        }
+        return 1;
+    }
+
+    // execute all commands in pipeline
+    current = cmd;
+    for (int i = 0; i < num_commands; i++)
+    {
+        pid_t pid = zygote_command(ctx, current, i == 0 ? heredoc_fd : pipes[i - 1][0],
+                                   i == num_commands - 1 ? fanout_fd : pipes[i][1], timeout_ms >= 0 ? timeout.pgid : -1);
+        if (pid < 0)
+        {
+            pid = fork();
+        }
+
+        if (pid == 0)
+        { // child process
+            fchdir(ctx->cwd_fd);
+            if (timeout_ms >= 0)
+            {
+                setpgid(0, timeout.pgid); // the first stage starts the group
+            }
+
+            // input redirection for first command
+            if (i == 0 && heredoc_fd >= 0)
+            {
+                dup2(heredoc_fd, STDIN_FILENO);
+            }
+            else if (i == 0 && current->input_file)
+            {
+                int fd = open(current->input_file, O_RDONLY);
+                if (fd == -1)
+                {
+                    perror("Input redirection failed");
+                    _exit(EXIT_FAILURE);
+                }
+                dup2(fd, STDIN_FILENO);
+                close(fd);
+            }
+
+            // output redirection for last command
+            if (i == num_commands - 1 && fanout_fd >= 0)
+            {
+                dup2(fanout_fd, STDOUT_FILENO);
+            }
+            else if (i == num_commands - 1 && current->output_count == 1)
+            {
+                int fd = open(current->output_files[0], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                if (fd == -1)
+                {
+                    perror("Output redirection failed");
+                    _exit(EXIT_FAILURE);
+                }
+                dup2(fd, STDOUT_FILENO);
+                close(fd);
+            }
+
+            // setting up pipes
+            if (i > 0)
+            { // not 1st command -> read from previous pipe
+                dup2(pipes[i - 1][0], STDIN_FILENO);
+            }
+            if (i < num_commands - 1)
+            { // not last command -> write to next pipe
+                dup2(pipes[i][1], STDOUT_FILENO);
+            }
+
+            // close pipe file descriptors
+            for (int j = 0; j < num_commands - 1; j++)
+            {
+                close(pipes[j][0]);
+                close(pipes[j][1]);
+            }
+
+            // N>file, >&N ... come after the pipes, so 2>&1 follows stdout into one
+            if (apply_redirs(ctx, current, 0) < 0)
+            {
+                perror("Redirection failed");
+                _exit(EXIT_FAILURE);
+            }
+
+            if (apply_modifiers(current) < 0)
+            {
+                perror("Setting up the process failed");
+                _exit(EXIT_FAILURE);
+            }
+            keep_procsubs(current);
+
+            if (current->group)
+            {
+                // ( ... ) or { ...; }, run by the stage's own copy of the shell
+                reset_shell_loop(ctx);
+                int status = run_group(ctx, current);
+                fflush(NULL);
+                _exit(status);
+            }
+
+            char path[PATH_MAX];
+            if (search_path(ctx, current->args[0], path, sizeof(path)))
+            {
+                current->args[0] = path;
+                execve(path, current->args, ctx->env);
+            }
+            else
+            {
+                fprintf(stderr, "An error has occurred\n");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        else if (pid < 0)
+        {
+            perror("Fork failed");
+            failed = 1;
+            break; // still wait for the stages already running
+        }
+
+        if (timeout_ms >= 0)
+        {
+            // also done here, so the group exists before the timer can fire
+            if (timeout.pgid == 0)
+            {
+                timeout.pgid = pid;
+            }
+            setpgid(pid, timeout.pgid);
+            if (pid == timeout.pgid)
+            {
+                gave_terminal = give_terminal(ctx, timeout.pgid);
+            }
+        }
+        watch_child(ctx, pid, &waits[started++]);
+        current = current->next;
+    }
+
+    // parent process -> close pipe file descriptors
+    for (int i = 0; i < num_commands - 1; i++)
+    {
+        close(pipes[i][0]);
+        close(pipes[i][1]);
+    }
+    if (fanout_fd >= 0)
+    {
+        close(fanout_fd);
+    }
+    if (heredoc_fd >= 0)
+    {
+        close(heredoc_fd);
+    }
+    for (current = cmd; current; current = current->next)
+    {
+        close_procsubs(current);
+    }
+
+    // a duration of 0 means no limit
+    if (timeout_ms > 0 && timeout.pgid > 0)
+    {
+        timeout.timer = ev_add_timer(ctx->loop, timeout_ms, timeout_expired, &timeout);
+        if (timeout.timer < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            kill(-timeout.pgid, SIGKILL); // rather than run without the limit
+            failed = 1;
+        }
+    }
+
+    // every stage is watched at once, so they're reaped in whatever order
+    // they exit; the pipeline status is the last one's
+    wait_children(ctx, waits, started);
+    if (fanout_fd >= 0)
+    {
+        wait_children(ctx, &fanout_wait, 1);
+    }
+    for (int i = 0; i < num_commands; i++)
+    {
+        wait_children(ctx, sub_waits[i], subs[i]);
+    }
+    ev_cancel_timer(ctx->loop, timeout.timer);
+    if (gave_terminal)
+    {
+        set_terminal(getpgrp());
+    }
+    if (timeout.expired)
+    {
+        return TIMEOUT_STATUS;
+    }
+    if (failed)
+    {
+        return 1;
+    }
+    int status = last->status_is_zero ? 0 : waits[num_commands - 1].status;
+    return status || fanout_fd < 0 ? status : fanout_wait.status; // targets left short fail it too
+}
+
+// with an output mode set, "a & b & c" runs every pipeline at the same time
+// in a forked subshell, and their output goes through the multiplexer so
+// lines from different jobs never mix. returns the last failing status
+static int execute_list_muxed(struct wish_ctx *ctx, CommandList *cmd_list)
+{
+    struct outmux *mux = outmux_new(ctx->loop, ctx->output_mode, STDOUT_FILENO, STDERR_FILENO);
+    ChildWait waits[cmd_list->count];
+    int status = 0;
+
+    if (!mux)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+
+    fflush(NULL);
+    for (int i = 0; i < cmd_list->count; i++)
+    {
+        int child_fds[2];
+        waits[i].done = 1;
+        waits[i].status = 0;
+        if (outmux_add_job(mux, i + 1, child_fds) < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            status = 1;
+            continue;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            reset_shell_loop(ctx);
+            outmux_close_in_child(mux);
+            dup2(child_fds[0], STDOUT_FILENO);
+            dup2(child_fds[1], STDERR_FILENO);
+            int cmd_status = execute_pipeline(ctx, cmd_list->commands[i]);
+            fflush(NULL);
+            _exit(cmd_status);
+        }
+        else if (pid < 0)
+        {
+            fprintf(stderr, "An error has occurred\n");
+            status = 1;
+        }
+        else
+        {
+            watch_child(ctx, pid, &waits[i]);
+        }
+        close(child_fds[0]);
+        close(child_fds[1]);
+    }
+
+    outmux_finish(mux);
+    wait_children(ctx, waits, cmd_list->count);
+
+    for (int i = 0; i < cmd_list->count; i++)
+    {
+        if (waits[i].status != 0)
+        {
+            status = waits[i].status;
+        }
+    }
+    return status;
+}
+
+// the words the shell runs itself when they start a pipeline, so a rewrite
+// must not move them to the front of one
+static int is_builtin_word(const char *word)
+{
+    return strcmp(word, "cd") == 0 || strcmp(word, "path") == 0 || strcmp(word, "timeout") == 0 ||
+           strcmp(word, "exec") == 0 || strcmp(word, "source") == 0 || strcmp(word, ".") == 0;
+}
+
+// 1 if cmd runs the system's cat. only that one is known to just copy its
+// input: a "cat" found earlier in the context's path could do anything
+static int is_system_cat(struct wish_ctx *ctx, Command *cmd)
+{
+    char path[PATH_MAX];
+    if (strcmp(cmd->args[0], "cat") != 0 || !search_path(ctx, "cat", path, sizeof(path)))
+    {
+        return 0;
+    }
+    return strcmp(path, "/bin/cat") == 0 || strcmp(path, "/usr/bin/cat") == 0;
+}
+
+// the file a "cat FILE" (or "cat < FILE") stage just copies, NULL otherwise.
+// only regular readable files: for anything else cat and a redirection differ
+// (a missing file makes cat print an error while the next stage still runs)
+static char *cat_source(struct wish_ctx *ctx, Command *cmd)
+{
+    char *file = NULL;
+    struct stat st;
+    if (cmd->output_count > 0 || cmd->procsub_count > 0 || cmd->redir_count > 0 || !is_system_cat(ctx, cmd))
+    {
+        return NULL;
+    }
+    if (cmd->arg_count == 2 && !cmd->input_file && cmd->args[1][0] != '-')
+    {
+        file = cmd->args[1];
+    }
+    else if (cmd->arg_count == 1)
+    {
+        file = cmd->input_file;
+    }
+    if (!file || fstatat(ctx->cwd_fd, file, &st, 0) != 0 || !S_ISREG(st.st_mode) ||
+        faccessat(ctx->cwd_fd, file, R_OK, 0) != 0)
+    {
+        return NULL;
+    }
+    return file;
+}
+
+// 1 if opening path for "> path" is going to work, so moving the redirection
+// from cat to the command doesn't keep the command from running
+static int can_write_to(struct wish_ctx *ctx, const char *path)
+{
+    struct stat st;
+    if (fstatat(ctx->cwd_fd, path, &st, 0) == 0)
+    {
+        return (S_ISREG(st.st_mode) || S_ISCHR(st.st_mode)) && faccessat(ctx->cwd_fd, path, W_OK, 0) == 0;
+    }
+
+    const char *slash = strrchr(path, '/');
+    if (!slash)
+    {
+        return faccessat(ctx->cwd_fd, ".", W_OK | X_OK, 0) == 0;
+    }
+    size_t len = slash == path ? 1 : (size_t)(slash - path);
+    char dir[len + 1];
+    memcpy(dir, path, len);
+    dir[len] = '\0';
+    return faccessat(ctx->cwd_fd, dir, W_OK | X_OK, 0) == 0;
+}
+
+// rewrites "cat file | cmd" into "cmd < file" and "cmd | cat > out" into
+// "cmd > out", as long as nothing observable changes; each one saves a
+// process and a copy of the data through a pipe. the stages dropped are
+// freed when owned (not when they are part of a compiled script's image).
+// returns the # of rewrites
+static int rewrite_pipeline(struct wish_ctx *ctx, Command **pipeline, int owned)
+{
+    int rewrites = 0;
+
+    while ((*pipeline)->next)
+    {
+        Command *first = *pipeline;
+        Command *next = first->next;
+        char *file = cat_source(ctx, first);
+        if (!file || next->input_file || next->heredoc_delim || is_builtin_word(next->args[0]))
+        {
+            break;
+        }
+        next->input_file = file;
+        *pipeline = next;
+        if (owned)
+        {
+            free(first);
+        }
+        rewrites++;
+    }
+
+    while ((*pipeline)->next)
+    {
+        Command *prev = *pipeline;
+        while (prev->next->next)
+        {
+            prev = prev->next;
+        }
+        Command *last = prev->next;
+        int writable = last->output_count > 0;
+        for (int i = 0; i < last->output_count; i++)
+        {
+            writable = writable && can_write_to(ctx, last->output_files[i]);
+        }
+        if (last->arg_count != 1 || last->input_file || !writable || prev->output_count > 0 ||
+            last->procsub_count > 0 || last->redir_count > 0 || !is_system_cat(ctx, last))
+        {
+            break;
+        }
+        if (prev == *pipeline && is_builtin_word(prev->args[0]) && strcmp(prev->args[0], "timeout") != 0)
+        {
+            break; // cd/path would stop being run as an external command
+        }
+        memcpy(prev->output_files, last->output_files, sizeof(last->output_files));
+        prev->output_count = last->output_count;
+        prev->status_is_zero = 1; // cat's exit status was the pipeline's
+        prev->next = NULL;
+        if (owned)
+        {
+            free(last);
+        }
+        rewrites++;
+    }
+    return rewrites;
+}
+
+static void print_pipeline(FILE *out, Command *cmd)
+{
+    for (; cmd; cmd = cmd->next)
+    {
+        for (int i = 0; i < cmd->arg_count; i++)
+        {
+            fprintf(out, i ? " %s" : "%s", cmd->args[i]);
+        }
+        if (cmd->input_file)
+        {
+            fprintf(out, " < %s", cmd->input_file);
+        }
+        if (cmd->heredoc_delim)
+        {
+            fprintf(out, " <<%s", cmd->heredoc_delim);
+        }
+        for (int i = 0; i < cmd->redir_count; i++)
+        {
+            Redir *redir = &cmd->redirs[i];
+            const char *op = redir->kind == REDIR_READ     ? "<"
+                             : redir->kind == REDIR_WRITE  ? ">"
+                             : redir->kind == REDIR_APPEND ? ">>"
+                             : redir->fd == STDIN_FILENO   ? "<&"
+                                                           : ">&";
+            fprintf(out, " %d%s%s", redir->fd, op, redir->target);
+        }
+        for (int i = 0; i < cmd->output_count; i++)
+        {
+            fprintf(out, " > %s", cmd->output_files[i]);
+        }
+        if (cmd->next)
+        {
+            fprintf(out, " | ");
+        }
+    }
+}
+
+// the rewrite pass between parsing and execution (-p on, the default).
+// under -p dry the pipeline is rewritten on a copy, what changed is
+// reported on stderr and the original runs as written
+static void optimize_pipeline(struct wish_ctx *ctx, Command **pipeline, int owned)
+{
+    if (ctx->rewrite_mode == REWRITE_ON)
+    {
+        rewrite_pipeline(ctx, pipeline, owned);
+        return;
+    }
+
+    // the args point into the token buffer, so copying the structs is enough
+    Command *copy = NULL;
+    Command **tail = &copy;
+    for (Command *cmd = *pipeline; cmd; cmd = cmd->next)
+    {
+        *tail = malloc(sizeof(Command));
+        if (!*tail)
+        {
+            break;
+        }
+        memcpy(*tail, cmd, sizeof(Command));
+        (*tail)->next = NULL;
+        tail = &(*tail)->next;
+    }
+
+    if (copy && rewrite_pipeline(ctx, &copy, 1) > 0)
+    {
+        fprintf(stderr, "wish: would rewrite \"");
+        print_pipeline(stderr, *pipeline);
+        fprintf(stderr, "\" as \"");
+        print_pipeline(stderr, copy);
+        fprintf(stderr, "\"\n");
+    }
+    while (copy)
+    {
+        Command *next = copy->next;
+        free(copy);
+        copy = next;
+    }
+}
+
+// the next "<<DELIM" in line from *pos on, read the same way tokenize_input
+// does (process substitutions are skipped, they are one token); its
+// delimiter goes to delim. 0 when there are no more
+static int next_heredoc(const char *line, size_t *pos, char *delim, size_t size)
+{
+    const char *p = line + *pos;
+    while (*p)
+    {
+        if ((p[0] == '<' || p[0] == '>') && p[1] == '(')
+        {
+            int depth = 0;
+            for (p++; *p; p++)
+            {
+                depth += (*p == '(') - (*p == ')');
+                if (depth == 0)
+                {
+                    break;
+                }
+            }
+            p += *p != '\0';
+            continue;
+        }
+        if (p[0] != '<' || p[1] != '<')
+        {
+            p++;
+            continue;
+        }
+
+        size_t i = 0;
+        for (p += 2; *p == ' ' || *p == '\t'; p++)
+        {
+        }
+        while (*p && !strchr(" \t|<>&;", *p) && i < size - 1)
+        {
+            delim[i++] = *p++;
+        }
+        delim[i] = '\0';
+        if (i > 0)
+        {
+            *pos = p - line;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// wish_reader for a FILE *: its next line, NULL at EOF
+char *wish_read_file_line(void *arg)
+{
+    FILE *file = arg;
+    char *line = NULL;
+    size_t cap = 0;
+    if (getline(&line, &cap, file) < 0)
+    {
+        free(line);
+        return NULL;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    return line;
+}
+
+// the readers call this for every command line: if it has "<<DELIM"s, the
+// body lines are read with next_line right away and the result is
+// "line\nbody\nDELIM\n...", which is what process_line takes. NULL when
+// line has no here-document. a missing delimiter ends the body at EOF
+char *wish_read_heredocs(char *line, wish_reader next_line, void *arg)
+{
+    char delim[MAX_WORD_LEN];
+    size_t pos = 0;
+    line[strcspn(line, "\n")] = '\0';
+    if (!next_heredoc(line, &pos, delim, sizeof(delim)))
+    {
+        return NULL;
+    }
+
+    size_t len = strlen(line);
+    size_t cap = len + 256;
+    char *text = malloc(cap);
+    if (!text)
+    {
+        return NULL;
+    }
+    memcpy(text, line, len);
+    text[len++] = '\n';
+
+    do
+    {
+        char *body;
+        while ((body = next_line(arg)) != NULL)
+        {
+            size_t n = strlen(body);
+            if (len + n + 2 > cap)
+            {
+                while (len + n + 2 > cap)
+                {
+                    cap *= 2;
+                }
+                char *grown = realloc(text, cap);
+                if (!grown)
+                {
+                    free(body);
+                    body = NULL;
+                    break;
+                }
+                text = grown;
+            }
+            memcpy(text + len, body, n);
+            len += n;
+            text[len++] = '\n';
+            int end = strcmp(body, delim) == 0;
+            free(body);
+            if (end)
+            {
+                break;
+            }
+        }
+        if (!body)
+        {
+            break; // EOF
+        }
+    } while (next_heredoc(line, &pos, delim, sizeof(delim)));
+
+    text[len] = '\0';
+    return text;
+}
+
+// the body at the start of bodies: everything up to a line that is just
+// delim (or the end). its length goes to *len; returns where the next body
+// starts, past the delimiter line
+static char *next_body(char *bodies, const char *delim, size_t *len)
+{
+    size_t dlen = strlen(delim);
+    char *p = bodies;
+    while (*p)
+    {
+        char *nl = strchrnul(p, '\n');
+        if ((size_t)(nl - p) == dlen && strncmp(p, delim, dlen) == 0)
+        {
+            break;
+        }
+        p = *nl ? nl + 1 : nl;
+    }
+    *len = p - bodies;
+    p = *p ? strchrnul(p, '\n') : p;
+    return p + (*p == '\n');
+}
+
+// hands the here-documents of the list, in order, their bodies from the
+// lines after the command line. a group gets the bodies of the commands
+// inside it as they are, delimiters and all, for process_line to hand out
+static void assign_heredocs(CommandList *list, char *bodies)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        for (Command *cmd = list->commands[i]; cmd; cmd = cmd->next)
+        {
+            if (cmd->group)
+            {
+                char delim[MAX_WORD_LEN];
+                size_t pos = 0;
+                size_t len;
+                cmd->group_bodies = bodies;
+                while (next_heredoc(cmd->args[0], &pos, delim, sizeof(delim)))
+                {
+                    bodies = next_body(bodies, delim, &len);
+                }
+                cmd->group_bodies_len = bodies - cmd->group_bodies;
+            }
+            if (cmd->heredoc_delim)
+            {
+                cmd->heredoc_body = bodies;
+                bodies = next_body(bodies, cmd->heredoc_delim, &cmd->heredoc_len);
+            }
+        }
+    }
+}
+
+// runs the commands of a parsed line (owned: see rewrite_pipeline)
+static int run_command_list(struct wish_ctx *ctx, CommandList *cmd_list, int owned)
+{
+    if (ctx->rewrite_mode != REWRITE_OFF)
+    {
+        for (int i = 0; i < cmd_list->count; i++)
+        {
+            optimize_pipeline(ctx, &cmd_list->commands[i], owned);
+        }
+    }
+
+    // the line fails if any of its commands did. under -O, the pipelines
+    // between two ";"s run at the same time
+    int status = 0;
+    for (int i = 0, end; i < cmd_list->count; i = end)
+    {
+        end = i + 1;
+        while (ctx->output_mode != OUTMUX_OFF && end < cmd_list->count && !cmd_list->commands[end - 1]->sequenced)
+        {
+            end++;
+        }
+        CommandList part = {cmd_list->commands + i, end - i};
+        int cmd_status = part.count > 1 ? execute_list_muxed(ctx, &part) : execute_pipeline(ctx, part.commands[0]);
+        if (cmd_status != 0)
+        {
+            status = cmd_status;
+        }
+    }
+    return status;
+}
+
+// line may carry here-document bodies after its first newline (see
+// wish_read_heredocs)
+static int process_line(struct wish_ctx *ctx, char *line)
+{
+    char *bodies = strchr(line, '\n');
+    if (bodies)
+    {
+        *bodies++ = '\0';
+    }
+
+    if (strlen(line) == 0)
+    {
+        return 0;
+    }
+
+    if (strcmp(line, "exit") == 0)
+    {
+        return WISH_EXIT; // up to the caller: a library mustn't end the process
+    }
+
+    int token_count;
+    Token *tokens = tokenize_input(ctx, line, &token_count);
+    CommandList *cmd_list = parse_tokens(tokens, token_count);
+
+    // proceed if parsing was successful
+    if (cmd_list == NULL)
+    {
+        free_tokens(tokens, token_count);
+        return 1;
+    }
+    assign_heredocs(cmd_list, bodies ? bodies : "");
+
+    int status = run_command_list(ctx, cmd_list, 1);
+    free_command_list(cmd_list);
+    free_tokens(tokens, token_count);
+    return status;
+}
+
+typedef struct batch_queue
+{
+    int running;
+    int failed; // # of lines that exited non-zero
+    struct outmux *mux;
+} BatchQueue;
+
+// 1 when the first word of line is word (cd/path/wait/exit checks)
+static int first_word_is(const char *line, const char *word)
+{
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    size_t len = strlen(word);
+    return strncmp(line, word, len) == 0 &&
+           (line[len] == '\0' || line[len] == ' ' || line[len] == '\t' || line[len] == '\n');
+}
+
+// a batch line's subshell exited -> its slot is free again (its output may
+// still be draining through the mux, which the same loop takes care of)
+static void batch_job_exited(struct evloop *loop, pid_t pid, int status, void *arg)
+{
+    BatchQueue *queue = arg;
+    (void)loop;
+    (void)pid;
+    if (wait_status(status) != 0)
+    {
+        queue->failed++;
+    }
+    queue->running--;
+}
+
+// runs the loop until no more than max jobs are running
+static void wait_batch_jobs(struct wish_ctx *ctx, BatchQueue *queue, int max)
+{
+    while (queue->running > max)
+    {
+        ev_run_once(ctx->loop, -1);
+    }
+}
+
+static void spawn_batch_job(struct wish_ctx *ctx, BatchQueue *queue, char *line, int lineno)
+{
+    int child_fds[2];
+    if (outmux_add_job(queue->mux, lineno, child_fds) < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        queue->failed++;
+        return;
+    }
+
+    fflush(NULL); // don't let the child inherit buffered output
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        reset_shell_loop(ctx);
+        outmux_close_in_child(queue->mux);
+        dup2(child_fds[0], STDOUT_FILENO);
+        dup2(child_fds[1], STDERR_FILENO);
+
+        // _exit: a normal exit would rewind the batch file we share with the parent
+        int status = process_line(ctx, line);
+        fflush(NULL);
+        _exit(status == WISH_EXIT ? 0 : status);
+    }
+    else if (pid < 0)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        queue->failed++;
+    }
+    else
+    {
+        queue->running++;
+        if (ev_add_child(ctx->loop, pid, batch_job_exited, queue) < 0)
+        {
+            int status = 0;
+            waitpid(pid, &status, 0);
+            batch_job_exited(ctx->loop, pid, status, queue);
+        }
+    }
+
+    // the mux sees EOF once the child (and whatever it started) is done
+    close(child_fds[0]);
+    close(child_fds[1]);
+}
+
+// -j N: up to N lines run at once, each in a forked subshell whose output
+// goes through the output multiplexer (grouped in line order unless -O tag
+// was given). "wait" is a barrier, and cd/path/exec/source/exit wait for everything
+// before them and then run in the shell itself, so they affect every line
+// after them. returns 1 if any line failed
+static int execute_batch_parallel(struct wish_ctx *ctx, FILE *batch_file, int max_jobs)
+{
+    BatchQueue queue = {0};
+    char line[MAX_LINE];
+    int lineno = 0;
+
+    queue.mux = outmux_new(ctx->loop, ctx->output_mode == OUTMUX_TAG ? OUTMUX_TAG : OUTMUX_GROUP,
+                           STDOUT_FILENO, STDERR_FILENO);
+    if (!queue.mux)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+
+    while (fgets(line, sizeof(line), batch_file) != NULL)
+    {
+        lineno++;
+        line[strcspn(line, "\n")] = 0;
+        if (line[strspn(line, " \t")] == '\0')
+        {
+            continue;
+        }
+
+        if (first_word_is(line, "wait"))
+        {
+            wait_batch_jobs(ctx, &queue, 0);
+            continue;
+        }
+
+        // here-document bodies are read here, so the subshell gets them
+        // along with its line (and the next line read is the right one)
+        int job_line = lineno;
+        char *text = wish_read_heredocs(line, wish_read_file_line, batch_file);
+        for (char *nl = text ? strchr(text, '\n') : NULL; nl && (nl = strchr(nl + 1, '\n')) != NULL;)
+        {
+            lineno++; // one per body line and delimiter
+        }
+
+        if (first_word_is(line, "cd") || first_word_is(line, "path") || first_word_is(line, "exec") ||
+            first_word_is(line, "source") || first_word_is(line, ".") || first_word_is(line, "exit"))
+        {
+            wait_batch_jobs(ctx, &queue, 0);
+            if (first_word_is(line, "exit"))
+            {
+                free(text);
+                break;
+            }
+            if (process_line(ctx, text ? text : line) != 0)
+            {
+                queue.failed++;
+            }
+            free(text);
+            continue;
+        }
+
+        wait_batch_jobs(ctx, &queue, max_jobs - 1);
+        spawn_batch_job(ctx, &queue, text ? text : line, job_line);
+        free(text);
+    }
+
+    wait_batch_jobs(ctx, &queue, 0);
+    outmux_finish(queue.mux);
+    return queue.failed ? 1 : 0;
+}
+
+// compiled scripts (wish --compile): every line of a batch file parsed
+// once and written out as compact records of its Commands, with offsets
+// into the file where the Command has pointers. running one maps the file
+// and, line by line, fills a buffer of Commands set aside at the start
+// from the records, the strings staying where they are in the mapping:
+// no parsing, and nothing to allocate or free per command. pin/nice/ulimit
+// prefixes stay words of the command, taken off when it runs as they are
+// from the source
+#define IMAGE_MAGIC "WISHC\n\0\0"
+#define IMAGE_VERSION 3
+
+// laid out the same in every version, so an image from another build of
+// wish still leads to its script
+typedef struct image_header
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t reserved;
+    uint32_t line_count;
+    uint32_t max_stages;    // most commands in one line, over all its pipelines
+    uint32_t max_pipelines; // most pipelines in one line
+    uint32_t unused;
+    uint64_t size;          // of the whole image, which ends in '\0'
+    uint64_t source_size;   // the script as it was compiled
+    int64_t source_mtime_ns;
+    uint64_t source_hash;
+    uint64_t source_path;   // offset of its absolute path
+    uint64_t lines;         // offset of line_count ImageLines
+} ImageHeader;
+
+typedef enum
+{
+    IMAGE_PARSED, // data: count offsets of the first ImageCommand of each pipeline
+    IMAGE_SOURCE, // data: the text, for process_line (lines that didn't parse)
+    IMAGE_EXIT,
+} ImageLineKind;
+
+typedef struct image_line
+{
+    uint32_t kind;
+    uint32_t count;
+    uint64_t data;
+} ImageLine;
+
+// a Command; offsets are 0 for NULL / none
+typedef struct image_command
+{
+    uint32_t arg_count;
+    uint32_t output_count;
+    uint32_t procsub_count;
+    uint32_t redir_count;
+    uint32_t background;
+    uint32_t status_is_zero;
+    uint32_t sequenced;
+    uint32_t unused;
+    uint64_t input_file;
+    uint64_t heredoc_delim;
+    uint64_t heredoc_body;
+    uint64_t heredoc_len;
+    uint64_t args;         // arg_count string offsets
+    uint64_t output_files; // output_count string offsets
+    uint64_t procsubs;     // procsub_count ImageProcSubs
+    uint64_t redirs;       // redir_count ImageRedirs
+    uint64_t next;         // the next stage of the pipeline
+} ImageCommand;
+
+typedef struct image_proc_sub
+{
+    uint64_t word;
+    uint64_t line;
+    uint32_t output;
+    uint32_t unused;
+} ImageProcSub;
+
+typedef struct image_redir
+{
+    int32_t fd;
+    uint32_t kind;
+    int32_t source;
+    uint32_t unused;
+    uint64_t target;
+} ImageRedir;
+
+// the image as it is being written
+typedef struct image_buf
+{
+    char *data;
+    size_t len;
+    size_t cap;
+    int failed;
+    uint32_t stages;   // commands in the line being written
+    const char **seen; // strings already in this line, by address: a
+    uint64_t *seen_at; // procsub word is found by comparing pointers
+    int seen_count;
+    int seen_cap;
+} ImageBuf;
+
+// FNV-1a over the script
+static int hash_file(FILE *file, uint64_t *hash)
+{
+    char buf[65536];
+    size_t n;
+    *hash = 14695981039346656037ULL;
+    while ((n = fread(buf, 1, sizeof(buf), file)) > 0)
+    {
+        for (size_t i = 0; i < n; i++)
+        {
+            *hash = (*hash ^ (unsigned char)buf[i]) * 1099511628211ULL;
+        }
+    }
+    return ferror(file) ? -1 : 0;
+}
+
+// appends n bytes (zeros for data == NULL) at the next multiple of align;
+// returns their offset
+static uint64_t image_put(ImageBuf *buf, const void *data, size_t n, size_t align)
+{
+    size_t at = (buf->len + align - 1) & ~(align - 1);
+    if (at + n > buf->cap)
+    {
+        size_t cap = buf->cap ? buf->cap : 65536;
+        while (cap < at + n)
+        {
+            cap *= 2;
+        }
+        char *grown = realloc(buf->data, cap);
+        if (!grown)
+        {
+            buf->failed = 1;
+            return 0;
+        }
+        buf->data = grown;
+        buf->cap = cap;
+    }
+    memset(buf->data + buf->len, 0, at - buf->len);
+    if (data)
+    {
+        memcpy(buf->data + at, data, n);
+    }
+    else
+    {
+        memset(buf->data + at, 0, n);
+    }
+    buf->len = at + n;
+    return at;
+}
+
+static uint64_t image_string(ImageBuf *buf, const char *s)
+{
+    if (!s)
+    {
+        return 0;
+    }
+    for (int i = 0; i < buf->seen_count; i++)
+    {
+        if (buf->seen[i] == s)
+        {
+            return buf->seen_at[i];
+        }
+    }
+    uint64_t at = image_put(buf, s, strlen(s) + 1, 1);
+    if (buf->seen_count == buf->seen_cap)
+    {
+        int cap = buf->seen_cap ? buf->seen_cap * 2 : 64;
+        const char **seen = realloc(buf->seen, cap * sizeof(char *));
+        uint64_t *seen_at = seen ? realloc(buf->seen_at, cap * sizeof(uint64_t)) : NULL;
+        buf->seen = seen ? seen : buf->seen;
+        if (!seen || !seen_at)
+        {
+            return at; // only the sharing is lost, and only for this string
+        }
+        buf->seen_at = seen_at;
+        buf->seen_cap = cap;
+    }
+    buf->seen[buf->seen_count] = s;
+    buf->seen_at[buf->seen_count++] = at;
+    return at;
+}
+
+// writes the pipeline from its last stage back, so each stage's next is
+// known by the time it's written; returns the first stage's offset
+static uint64_t image_pipeline(ImageBuf *buf, Command *cmd)
+{
+    if (!cmd)
+    {
+        return 0;
+    }
+    ImageCommand out = {0};
+    out.next = image_pipeline(buf, cmd->next);
+    buf->stages++;
+
+    uint64_t strings[MAX_ARGS > MAX_OUTPUTS ? MAX_ARGS : MAX_OUTPUTS];
+    out.arg_count = cmd->arg_count;
+    for (int i = 0; i < cmd->arg_count; i++)
+    {
+        strings[i] = image_string(buf, cmd->args[i]);
+    }
+    if (cmd->arg_count > 0)
+    {
+        out.args = image_put(buf, strings, cmd->arg_count * sizeof(uint64_t), 8);
+    }
+    out.output_count = cmd->output_count;
+    for (int i = 0; i < cmd->output_count; i++)
+    {
+        strings[i] = image_string(buf, cmd->output_files[i]);
+    }
+    if (cmd->output_count > 0)
+    {
+        out.output_files = image_put(buf, strings, cmd->output_count * sizeof(uint64_t), 8);
+    }
+
+    out.procsub_count = cmd->procsub_count;
+    ImageProcSub procsubs[MAX_PROCSUBS];
+    for (int i = 0; i < cmd->procsub_count; i++)
+    {
+        procsubs[i].word = image_string(buf, cmd->procsubs[i].word);
+        procsubs[i].line = image_string(buf, cmd->procsubs[i].line);
+        procsubs[i].output = cmd->procsubs[i].output;
+        procsubs[i].unused = 0;
+    }
+    if (cmd->procsub_count > 0)
+    {
+        out.procsubs = image_put(buf, procsubs, cmd->procsub_count * sizeof(ImageProcSub), 8);
+    }
+    out.redir_count = cmd->redir_count;
+    ImageRedir redirs[MAX_REDIRS];
+    for (int i = 0; i < cmd->redir_count; i++)
+    {
+        int source = cmd->redirs[i].kind == REDIR_DUP ? cmd->redirs[i].source : 0; // only set for these
+        redirs[i] = (ImageRedir){cmd->redirs[i].fd, cmd->redirs[i].kind, source, 0,
+                                 image_string(buf, cmd->redirs[i].target)};
+    }
+    if (cmd->redir_count > 0)
+    {
+        out.redirs = image_put(buf, redirs, cmd->redir_count * sizeof(ImageRedir), 8);
+    }
+
+    out.input_file = image_string(buf, cmd->input_file);
+    out.heredoc_delim = image_string(buf, cmd->heredoc_delim);
+    if (cmd->heredoc_body)
+    {
+        out.heredoc_body = image_put(buf, cmd->heredoc_body, cmd->heredoc_len, 1);
+        out.heredoc_len = cmd->heredoc_len;
+        image_put(buf, NULL, 1, 1);
+    }
+    out.background = cmd->background;
+    out.status_is_zero = cmd->status_is_zero;
+    out.sequenced = cmd->sequenced;
+    return image_put(buf, &out, sizeof(out), 8);
+}
+
+static int has_group(CommandList *list)
+{
+    for (int i = 0; i < list->count; i++)
+    {
+        for (Command *cmd = list->commands[i]; cmd; cmd = cmd->next)
+        {
+            if (cmd->group)
+            {
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+// one line of the script (with its here-document bodies)
+static ImageLine image_line(struct wish_ctx *ctx, ImageBuf *buf, char *text)
+{
+    ImageLine line = {IMAGE_SOURCE, 0, 0};
+    char *bodies = strchr(text, '\n');
+    if (bodies)
+    {
+        *bodies++ = '\0';
+    }
+    buf->stages = 0;
+    if (strcmp(text, "exit") == 0)
+    {
+        line.kind = IMAGE_EXIT;
+        return line;
+    }
+
+    buf->seen_count = 0;
+    int token_count;
+    Token *tokens = tokenize_input(ctx, text, &token_count);
+    CommandList *cmd_list = parse_tokens(tokens, token_count);
+    if (cmd_list && has_group(cmd_list))
+    {
+        // what is inside a group is parsed when it runs anyway
+        free_command_list(cmd_list);
+        cmd_list = NULL;
+    }
+    if (!cmd_list)
+    {
+        // kept as text: the error comes up again when the line runs
+        line.data = image_put(buf, text, strlen(text) + 1, 1);
+        if (bodies)
+        {
+            buf->len--; // the line's '\0' becomes its '\n' again
+            image_put(buf, "\n", 1, 1);
+            image_put(buf, bodies, strlen(bodies) + 1, 1);
+        }
+        free_tokens(tokens, token_count);
+        return line;
+    }
+    assign_heredocs(cmd_list, bodies ? bodies : "");
+
+    uint64_t firsts[cmd_list->count + 1];
+    for (int i = 0; i < cmd_list->count; i++)
+    {
+        firsts[i] = image_pipeline(buf, cmd_list->commands[i]);
+    }
+    line.kind = IMAGE_PARSED;
+    line.count = cmd_list->count;
+    line.data = image_put(buf, firsts, cmd_list->count * sizeof(uint64_t), 8);
+    free_command_list(cmd_list);
+    free_tokens(tokens, token_count);
+    return line;
+}
+
+// a mapped image being run
+typedef struct image_run
+{
+    char *base;
+    uint64_t size;
+    Command *cmds;      // max_stages of them, refilled for every line
+    uint32_t used;
+    uint32_t max_stages;
+} ImageRun;
+
+// the n bytes at off, NULL if they aren't all inside the image
+static void *image_at(ImageRun *run, uint64_t off, uint64_t n, size_t align)
+{
+    if (off == 0 || off >= run->size || n > run->size - off || off % align != 0)
+    {
+        return NULL;
+    }
+    return run->base + off;
+}
+
+// a string at off: the image ends in '\0', so any offset inside it will do
+static int image_str(ImageRun *run, uint64_t off, char **s)
+{
+    if (off >= run->size)
+    {
+        return -1;
+    }
+    *s = off ? run->base + off : NULL;
+    return 0;
+}
+
+// the pipeline starting at off into the Command buffer; its first stage,
+// NULL if the records don't make sense
+static Command *decode_pipeline(ImageRun *run, uint64_t off)
+{
+    Command *first = NULL;
+    Command **link = &first;
+    while (off)
+    {
+        ImageCommand *in = image_at(run, off, sizeof(ImageCommand), 8);
+        if (!in || run->used == run->max_stages || in->arg_count >= MAX_ARGS || in->output_count > MAX_OUTPUTS ||
+            in->procsub_count > MAX_PROCSUBS || in->redir_count > MAX_REDIRS)
+        {
+            return NULL;
+        }
+        Command *cmd = &run->cmds[run->used++];
+        memset(cmd, 0, sizeof(*cmd));
+
+        uint64_t *args = image_at(run, in->args, in->arg_count * sizeof(uint64_t), 8);
+        uint64_t *outputs = image_at(run, in->output_files, in->output_count * sizeof(uint64_t), 8);
+        ImageProcSub *procsubs = image_at(run, in->procsubs, in->procsub_count * sizeof(ImageProcSub), 8);
+        ImageRedir *redirs = image_at(run, in->redirs, in->redir_count * sizeof(ImageRedir), 8);
+        if ((in->arg_count && !args) || (in->output_count && !outputs) || (in->procsub_count && !procsubs) ||
+            (in->redir_count && !redirs))
+        {
+            return NULL;
+        }
+        int bad = 0;
+        cmd->arg_count = in->arg_count;
+        for (uint32_t i = 0; i < in->arg_count; i++)
+        {
+            bad |= image_str(run, args[i], &cmd->args[i]);
+        }
+        cmd->output_count = in->output_count;
+        for (uint32_t i = 0; i < in->output_count; i++)
+        {
+            bad |= image_str(run, outputs[i], &cmd->output_files[i]);
+        }
+        cmd->procsub_count = in->procsub_count;
+        for (uint32_t i = 0; i < in->procsub_count; i++)
+        {
+            bad |= image_str(run, procsubs[i].word, &cmd->procsubs[i].word) |
+                   image_str(run, procsubs[i].line, &cmd->procsubs[i].line);
+            cmd->procsubs[i].output = procsubs[i].output;
+            cmd->procsubs[i].fd = -1;
+        }
+        cmd->redir_count = in->redir_count;
+        for (uint32_t i = 0; i < in->redir_count; i++)
+        {
+            cmd->redirs[i].fd = redirs[i].fd;
+            cmd->redirs[i].kind = redirs[i].kind;
+            cmd->redirs[i].source = redirs[i].source;
+            bad |= image_str(run, redirs[i].target, &cmd->redirs[i].target) | (redirs[i].kind > REDIR_CLOSE);
+        }
+        bad |= image_str(run, in->input_file, &cmd->input_file) |
+               image_str(run, in->heredoc_delim, &cmd->heredoc_delim);
+        if (in->heredoc_body)
+        {
+            cmd->heredoc_body = image_at(run, in->heredoc_body, in->heredoc_len, 1);
+            cmd->heredoc_len = in->heredoc_len;
+            bad |= !cmd->heredoc_body;
+        }
+        cmd->background = in->background;
+        cmd->status_is_zero = in->status_is_zero;
+        cmd->sequenced = in->sequenced;
+        if (bad)
+        {
+            return NULL;
+        }
+        *link = cmd;
+        link = &cmd->next;
+        off = in->next;
+    }
+    return first;
+}
+
+// runs a mapped image like wish_run_file runs its source
+static int run_image(struct wish_ctx *ctx, char *base, uint64_t size)
+{
+    ImageHeader *header = (ImageHeader *)base;
+    ImageLine *lines = (ImageLine *)(base + header->lines);
+    ImageRun run = {base, size, malloc((header->max_stages + 1) * sizeof(Command)), 0, header->max_stages};
+    Command **firsts = malloc((header->max_pipelines + 1) * sizeof(Command *));
+    if (!run.cmds || !firsts)
+    {
+        free(run.cmds);
+        free(firsts);
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+
+    int status = 0;
+    for (uint32_t i = 0; i < header->line_count; i++)
+    {
+        int line_status = 1;
+        if (lines[i].kind == IMAGE_EXIT)
+        {
+            break;
+        }
+        uint64_t *offsets = image_at(&run, lines[i].data, lines[i].count * sizeof(uint64_t), 8);
+        if (lines[i].kind == IMAGE_SOURCE && lines[i].data && lines[i].data < size)
+        {
+            line_status = process_line(ctx, base + lines[i].data);
+        }
+        else if (lines[i].kind == IMAGE_PARSED && offsets && lines[i].count <= header->max_pipelines)
+        {
+            CommandList list = {firsts, lines[i].count};
+            int bad = 0;
+            run.used = 0;
+            for (int j = 0; j < list.count && !bad; j++)
+            {
+                list.commands[j] = decode_pipeline(&run, offsets[j]);
+                bad = !list.commands[j];
+            }
+            line_status = bad ? 1 : run_command_list(ctx, &list, 0);
+            if (bad)
+            {
+                fprintf(stderr, "An error has occurred\n");
+            }
+        }
+        else
+        {
+            fprintf(stderr, "An error has occurred\n");
+        }
+        if (line_status == WISH_EXIT)
+        {
+            break;
+        }
+        status = line_status;
+    }
+    free(run.cmds);
+    free(firsts);
+    return status;
+}
+
+// fds 3..MAX_USER_FD are parked once per process, whichever context comes first
+static pthread_once_t user_fds_once = PTHREAD_ONCE_INIT;
+
+void wish_reset_fds(void)
+{
+    pthread_once(&user_fds_once, reserve_user_fds);
+    for (int fd = 3; fd <= MAX_USER_FD; fd++)
+    {
+        park_fd(fd);
+    }
+}
+
+struct wish_ctx *wish_new(void)
+{
+    struct wish_ctx *ctx = calloc(1, sizeof(struct wish_ctx));
+    if (!ctx)
+    {
+        return NULL;
+    }
+    pthread_once(&user_fds_once, reserve_user_fds);
+
+    ctx->cwd_fd = open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+    ctx->loop = ev_new();
+    ctx->rewrite_mode = REWRITE_ON;
+    ctx->output_mode = OUTMUX_OFF;
+    initialize_paths(ctx);
+
+    while (environ[ctx->env_count])
+    {
+        ctx->env_count++;
+    }
+    ctx->env = calloc(ctx->env_count + 1, sizeof(char *));
+    for (int i = 0; ctx->env && i < ctx->env_count; i++)
+    {
+        ctx->env[i] = strdup(environ[i]);
+    }
+
+    if (ctx->cwd_fd < 0 || !ctx->loop || !ctx->env || !ctx->search_paths[0])
+    {
+        wish_free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+void wish_free(struct wish_ctx *ctx)
+{
+    if (!ctx)
+    {
+        return;
+    }
+    for (int i = 0; i < ctx->path_count; i++)
+    {
+        free(ctx->search_paths[i]);
+    }
+    for (int i = 0; ctx->env && i < ctx->env_count; i++)
+    {
+        free(ctx->env[i]);
+    }
+    free(ctx->env);
+    if (ctx->cwd_fd >= 0)
+    {
+        close(ctx->cwd_fd);
+    }
+    drop_zygote(ctx);
+    free(ctx->zchildren);
+    ev_free(ctx->loop);
+    free(ctx);
+}
+
+void wish_set_output_mode(struct wish_ctx *ctx, enum outmux_mode mode)
+{
+    ctx->output_mode = mode;
+}
+
+void wish_set_rewrite_mode(struct wish_ctx *ctx, enum rewrite_mode mode)
+{
+    ctx->rewrite_mode = mode;
+}
+
+int wish_set_zygote(struct wish_ctx *ctx, int on)
+{
+    if (!on)
+    {
+        drop_zygote(ctx);
+        return 0;
+    }
+    if (ctx->zygote)
+    {
+        return 0;
+    }
+    ctx->zygote = zygote_start(zygote_child_exited, ctx);
+    if (!ctx->zygote)
+    {
+        return -1;
+    }
+    if (ev_add_fd(ctx->loop, zygote_fd(ctx->zygote), zygote_ready, ctx) < 0)
+    {
+        drop_zygote(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+int wish_setenv(struct wish_ctx *ctx, const char *name, const char *value)
+{
+    size_t len = strlen(name);
+    int i = 0;
+    while (i < ctx->env_count && !(strncmp(ctx->env[i], name, len) == 0 && ctx->env[i][len] == '='))
+    {
+        i++;
+    }
+
+    if (!value)
+    {
+        if (i < ctx->env_count)
+        {
+            free(ctx->env[i]);
+            ctx->env[i] = ctx->env[--ctx->env_count];
+            ctx->env[ctx->env_count] = NULL;
+        }
+        return 0;
+    }
+
+    char *entry = malloc(len + strlen(value) + 2);
+    if (!entry)
+    {
+        return -1;
+    }
+    sprintf(entry, "%s=%s", name, value);
+    if (i == ctx->env_count)
+    {
+        char **env = realloc(ctx->env, (ctx->env_count + 2) * sizeof(char *));
+        if (!env)
+        {
+            free(entry);
+            return -1;
+        }
+        ctx->env = env;
+        ctx->env[++ctx->env_count] = NULL;
+    }
+    else
+    {
+        free(ctx->env[i]);
+    }
+    ctx->env[i] = entry;
+    return 0;
+}
+
+int wish_run_line(struct wish_ctx *ctx, const char *line, size_t len)
+{
+    // process_line cuts the line up in place
+    char *copy = malloc(len + 1);
+    if (!copy)
+    {
+        fprintf(stderr, "An error has occurred\n");
+        return 1;
+    }
+    memcpy(copy, line, len);
+    copy[len] = '\0';
+    int status = process_line(ctx, copy);
+    free(copy);
+    return status;
+}
+
+int wish_run_file(struct wish_ctx *ctx, FILE *file, int max_jobs)
+{
+    if (max_jobs > 0)
+    {
+        return execute_batch_parallel(ctx, file, max_jobs);
+    }
+
+    int status = 0;
+    char line[MAX_LINE];
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        char *text = wish_read_heredocs(line, wish_read_file_line, file);
+        int line_status = process_line(ctx, text ? text : line);
+        free(text);
+        if (line_status == WISH_EXIT)
+        {
+            break;
+        }
+        status = line_status;
+    }
+    return status;
+}
+
+int wish_compile(struct wish_ctx *ctx, const char *source, const char *image)
+{
+    ImageHeader header = {0};
+    ImageBuf buf = {0};
+    struct stat st;
+    char path[PATH_MAX];
+    FILE *file = fopen(source, "r");
+    if (!file || fstat(fileno(file), &st) < 0 || !realpath(source, path) ||
+        hash_file(file, &header.source_hash) < 0)
+    {
+        if (file)
+        {
+            fclose(file);
+        }
+        return -1;
+    }
+    rewind(file);
+
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(header.magic));
+    header.version = IMAGE_VERSION;
+    header.source_size = st.st_size;
+    header.source_mtime_ns = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec;
+    image_put(&buf, NULL, sizeof(header), 8);
+    header.source_path = image_put(&buf, path, strlen(path) + 1, 1);
+
+    // the lines are read the way wish_run_file reads them
+    ImageLine *lines = NULL;
+    int count = 0;
+    char line[MAX_LINE];
+    while (!buf.failed && fgets(line, sizeof(line), file) != NULL)
+    {
+        ImageLine *grown = realloc(lines, (count + 1) * sizeof(ImageLine));
+        if (!grown)
+        {
+            buf.failed = 1;
+            break;
+        }
+        lines = grown;
+        char *text = wish_read_heredocs(line, wish_read_file_line, file);
+        lines[count] = image_line(ctx, &buf, text ? text : line);
+        free(text);
+        if (buf.stages > header.max_stages)
+        {
+            header.max_stages = buf.stages;
+        }
+        if (lines[count].kind == IMAGE_PARSED && lines[count].count > header.max_pipelines)
+        {
+            header.max_pipelines = lines[count].count;
+        }
+        if (lines[count++].kind == IMAGE_EXIT)
+        {
+            break; // nothing after it runs
+        }
+    }
+    fclose(file);
+
+    header.line_count = count;
+    header.lines = image_put(&buf, lines, count * sizeof(ImageLine), 8);
+    image_put(&buf, NULL, 1, 1);
+    header.size = buf.len;
+    free(lines);
+    free(buf.seen);
+    free(buf.seen_at);
+    if (buf.failed)
+    {
+        free(buf.data);
+        return -1;
+    }
+    memcpy(buf.data, &header, sizeof(header));
+
+    // written next to it and renamed, so a running image is never rewritten
+    size_t len = strlen(image);
+    char tmp[len + 5];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", image);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int status = fd < 0 || write_all(fd, buf.data, buf.len) < 0 ? -1 : 0;
+    if (fd >= 0 && close(fd) < 0)
+    {
+        status = -1;
+    }
+    if (status == 0 && rename(tmp, image) < 0)
+    {
+        status = -1;
+    }
+    if (status < 0)
+    {
+        unlink(tmp);
+    }
+    free(buf.data);
+    return status;
+}
+
+// 1 if the script an image was compiled from is unchanged (or gone)
+static int image_is_current(ImageHeader *header, const char *source)
+{
+    struct stat st;
+    FILE *file = fopen(source, "r");
+    if (!file)
+    {
+        return 1; // only the image was shipped
+    }
+    int current = 0;
+    uint64_t hash;
+    if (fstat(fileno(file), &st) == 0 && (uint64_t)st.st_size == header->source_size)
+    {
+        // the same size and time: no need to read it. otherwise the
+        // contents decide (a touch, a copy with a new time)
+        current = st.st_mtim.tv_sec * 1000000000LL + st.st_mtim.tv_nsec == header->source_mtime_ns ||
+                  (hash_file(file, &hash) == 0 && hash == header->source_hash);
+    }
+    fclose(file);
+    return current;
+}
+
+int wish_run_image(struct wish_ctx *ctx, const char *path, int max_jobs, int *status)
+{
+    ImageHeader header;
+    struct stat st;
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return 0; // not for here to say: the caller's fopen() fails too
+    }
+    if (fstat(fd, &st) < 0 || pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        memcmp(header.magic, IMAGE_MAGIC, sizeof(header.magic)) != 0)
+    {
+        close(fd);
+        return 0;
+    }
+
+    char source[PATH_MAX] = "";
+    int usable = header.version == IMAGE_VERSION && header.size == (uint64_t)st.st_size &&
+                 header.source_path < header.size && header.lines <= header.size &&
+                 header.line_count <= (header.size - header.lines) / sizeof(ImageLine) &&
+                 header.lines % 8 == 0;
+    if (header.source_path < (uint64_t)st.st_size)
+    {
+        pread(fd, source, sizeof(source) - 1, header.source_path);
+    }
+
+    // -j runs lines in subshells that parse them anyway; it goes by the source
+    char *base = MAP_FAILED;
+    if (usable && max_jobs == 0 && image_is_current(&header, source))
+    {
+        base = mmap(NULL, header.size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (base != MAP_FAILED && base[header.size - 1] != '\0')
+    {
+        munmap(base, header.size);
+        base = MAP_FAILED;
+    }
+    if (base != MAP_FAILED)
+    {
+        *status = run_image(ctx, base, header.size);
+        munmap(base, header.size);
+        return 1;
+    }
+
+    // stale, from another build of wish, or -j: the script itself
+    FILE *file = fopen(source, "r");
+    if (!file)
+    {
+        return -1;
+    }
+    *status = wish_run_file(ctx, file, max_jobs);
+    fclose(file);
+    return 1;
+}
+
+void wish_poll(struct wish_ctx *ctx)
+{
+    ev_run_once(ctx->loop, 0);
+}
+
+char **wish_paths(struct wish_ctx *ctx, int *count)
+{
+    *count = ctx->path_count;
+    return ctx->search_paths;
+}
+
+int wish_cwd(struct wish_ctx *ctx)
+{
+    return ctx->cwd_fd;
+}
@@ -0,0 +1,96 @@
+#ifndef WISH_H
+#define WISH_H
+
+#include <stddef.h>
+#include <stdio.h>
+#include "outmux.h"
+
+// libwish: the shell as a library (wish.c, outmux.c, evloop.c, scan.c,
+// zygote.c). everything a shell keeps between lines lives in a wish_ctx:
+// the search path, the environment and working directory commands start
+// with, the jobs and timers it is waiting for, and the options. contexts
+// share nothing, so each thread can run lines in a context of its own. the
+// exceptions are the redirections the shell applies to itself, because
+// they change the process's fds and so every context's: "exec N>file" for
+// good, and those of a { ...; } group or a sourced file ("source f > out")
+// while it runs. a thread must not run one of those while another context
+// is running lines
+
+// -p: the pipeline rewrite pass (useless cat elimination)
+enum rewrite_mode
+{
+    REWRITE_OFF,
+    REWRITE_ON,
+    REWRITE_DRY, // only report what would be rewritten
+};
+
+#define WISH_EXIT (-1) // wish_run_line: the line was "exit"
+
+struct wish_ctx;
+
+// a new context: path /bin, a copy of the process environment, the
+// process's current directory, -p on and no output mux (NULL on failure)
+struct wish_ctx *wish_new(void);
+void wish_free(struct wish_ctx *ctx);
+
+void wish_set_output_mode(struct wish_ctx *ctx, enum outmux_mode mode);
+void wish_set_rewrite_mode(struct wish_ctx *ctx, enum rewrite_mode mode);
+
+// -z: with on, commands are started by a zygote, a helper process forked
+// right away (so call it early, while the process is small), instead of
+// being forked from the calling process. -1 if the helper couldn't be
+// started. a context's zygote is only used from the process that set it up
+int wish_set_zygote(struct wish_ctx *ctx, int on);
+
+// sets (value != NULL) or removes name in the environment of the commands
+// ctx starts; -1 on failure
+int wish_setenv(struct wish_ctx *ctx, const char *name, const char *value);
+
+// runs the len bytes at line as one command line. here-document bodies may
+// follow its first newline (see wish_read_heredocs). returns the exit
+// status of the line, or WISH_EXIT for "exit"
+int wish_run_line(struct wish_ctx *ctx, const char *line, size_t len);
+
+// runs every line of file up to an "exit", reading here-document bodies
+// from it too. with max_jobs > 0, up to that many lines run at once (-j)
+// and the result is 1 if any of them failed; otherwise it is the status of
+// the last line run
+int wish_run_file(struct wish_ctx *ctx, FILE *file, int max_jobs);
+
+// wish --compile: parses every line of the script at source once and
+// writes the result to image, a compiled script for wish_run_image. -1 on
+// failure (lines that don't parse don't count: they are kept as text)
+int wish_compile(struct wish_ctx *ctx, const char *source, const char *image);
+
+// if path is a compiled script, runs it the way wish_run_file would run its
+// source, sets *status and returns 1. when the source has changed since, or
+// the image is from another build of wish, or max_jobs > 0, the source is
+// run instead. 0 when path isn't a compiled script; -1 when it is stale and
+// the source can't be opened
+int wish_run_image(struct wish_ctx *ctx, const char *path, int max_jobs, int *status);
+
+// reaps the background jobs that have finished, without blocking
+void wish_poll(struct wish_ctx *ctx);
+
+// closes whatever exec redirections opened on fds 3-9 (in the whole
+// process), and any fds there the process was started with
+void wish_reset_fds(void);
+
+// the search path as set by "path"
+char **wish_paths(struct wish_ctx *ctx, int *count);
+
+// the working directory, as an O_PATH fd that belongs to ctx
+int wish_cwd(struct wish_ctx *ctx);
+
+// returns the next line (malloc()ed, without its newline), NULL at EOF
+typedef char *(*wish_reader)(void *arg);
+
+// the wish_reader for a FILE * (arg)
+char *wish_read_file_line(void *arg);
+
+// if line has "<<DELIM"s, reads their bodies with next_line right away and
+// returns "line\nbody\nDELIM\n..." for wish_run_line (malloc()ed). NULL when
+// line has no here-document. a missing delimiter ends the body at EOF
+char *wish_read_heredocs(char *line, wish_reader next_line, void *arg);
+
+#endif
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "frame.h"
+
+// a client for "wish --serve": sends LINE (or each line of stdin) to the
+// server at SOCKET, writes what comes back to stdout/stderr and exits with
+// the status of the last line
+//
+// build: gcc wish_client.c frame.c -o wish_client
+// usage: ./wish_client SOCKET [LINE]
+
+static int connect_to(const char *socket_path)
+{
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(socket_path) >= sizeof(addr.sun_path))
+    {
+        return -1;
+    }
+    strcpy(addr.sun_path, socket_path);
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// sends one line and relays the answer; its status, or -1 if the
+// connection broke
+static int run_remote(int fd, const char *line, size_t len)
+{
+    if (frame_write(fd, FRAME_LINE, line, len) < 0)
+    {
+        return -1;
+    }
+    while (1)
+    {
+        char type;
+        char *data;
+        uint32_t n;
+        if (frame_read(fd, &type, &data, &n) < 0)
+        {
+            return -1;
+        }
+        if (type == FRAME_STATUS && n == 4)
+        {
+            uint32_t status;
+            memcpy(&status, data, 4);
+            free(data);
+            return (int)ntohl(status);
+        }
+        if (type == FRAME_STDOUT || type == FRAME_STDERR)
+        {
+            fwrite(data, 1, n, type == FRAME_STDOUT ? stdout : stderr);
+            fflush(type == FRAME_STDOUT ? stdout : stderr);
+        }
+        free(data);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2 || argc > 3)
+    {
+        fprintf(stderr, "usage: %s SOCKET [LINE]\n", argv[0]);
+        return 1;
+    }
+    int fd = connect_to(argv[1]);
+    if (fd < 0)
+    {
+        perror("connect");
+        return 1;
+    }
+
+    int status = 0;
+    if (argc == 3)
+    {
+        status = run_remote(fd, argv[2], strlen(argv[2]));
+    }
+    else
+    {
+        // one request per line, over the same connection
+        char *line = NULL;
+        size_t size = 0;
+        ssize_t len;
+        while (status >= 0 && (len = getline(&line, &size, stdin)) != -1)
+        {
+            if (len > 0 && line[len - 1] == '\n')
+            {
+                line[--len] = '\0';
+            }
+            status = run_remote(fd, line, len);
+        }
+        free(line);
+    }
+    close(fd);
+
+    if (status < 0)
+    {
+        fprintf(stderr, "connection to %s lost\n", argv[1]);
+        return 1;
+    }
+    return status;
+}
@@ -0,0 +1,459 @@
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include "zygote.h"
+
+#define ZYGOTE_MAX_REQUEST (16 << 20) // strings and setup data
+
+enum
+{
+    ZYGOTE_SPAWNED, // the answer to a request: pid, or -1 and errno in value
+    ZYGOTE_EXITED,  // pid exited with wait status value
+};
+
+// shell -> helper, followed by the setup data (first, so it's aligned as
+// malloc() aligns) and the strings (path, argv, env, each with its '\0').
+// the fds ride along with it: the working directory first, then the child's
+struct zygote_req
+{
+    uint32_t argc;
+    uint32_t envc;
+    uint32_t fd_count;
+    int32_t pgid;
+    uint32_t strings_len;
+    uint32_t data_len;
+    int32_t target_fds[ZYGOTE_MAX_FDS];
+    int (*setup)(const void *data); // the helper is a fork of the shell, so
+                                    // the address is the same in both
+};
+
+// helper -> shell
+struct zygote_msg
+{
+    int32_t kind;
+    int32_t pid;
+    int32_t value;
+};
+
+struct zygote
+{
+    int fd;
+    pid_t pid;
+    pid_t owner; // the process that forked the helper
+    zygote_exit_cb exited;
+    void *arg;
+};
+
+static int send_all(int fd, const void *data, size_t len)
+{
+    const char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+static int read_all(int fd, void *data, size_t len)
+{
+    char *p = data;
+    while (len > 0)
+    {
+        ssize_t n = read(fd, p, len);
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n <= 0)
+        {
+            return -1;
+        }
+        p += n;
+        len -= n;
+    }
+    return 0;
+}
+
+// the helper's side
+
+static void send_msg(int sock, int kind, pid_t pid, int value)
+{
+    struct zygote_msg msg = {kind, pid, value};
+    if (send_all(sock, &msg, sizeof(msg)) < 0)
+    {
+        _exit(0); // the shell is gone
+    }
+}
+
+// between fork and execve: everything the shell's own children do there,
+// from what came with the request
+static void start_child(struct zygote_req *req, int cwd_fd, int *fds, char *path, char **argv, char **env,
+                        const void *data, const sigset_t *mask)
+{
+    sigprocmask(SIG_SETMASK, mask, NULL);
+    if (req->pgid >= 0)
+    {
+        setpgid(0, req->pgid);
+    }
+    fchdir(cwd_fd);
+
+    // out of the way of every target first, so no dup2() hits a source
+    int top = STDERR_FILENO;
+    for (uint32_t i = 0; i < req->fd_count; i++)
+    {
+        top = req->target_fds[i] > top ? req->target_fds[i] : top;
+    }
+    for (uint32_t i = 0; i < req->fd_count; i++)
+    {
+        fds[i] = fcntl(fds[i], F_DUPFD_CLOEXEC, top + 1);
+    }
+    for (int fd = 0; fd <= STDERR_FILENO; fd++)
+    {
+        close(fd); // the helper's own; the job's come next
+    }
+    for (uint32_t i = 0; i < req->fd_count; i++)
+    {
+        if (fds[i] < 0 || dup2(fds[i], req->target_fds[i]) < 0)
+        {
+            _exit(EXIT_FAILURE); // no stderr to say so on, maybe
+        }
+    }
+
+    if (!req->setup || req->setup(data) == 0)
+    {
+        execve(path, argv, env);
+    }
+    fprintf(stderr, "An error has occurred\n");
+    _exit(EXIT_FAILURE);
+}
+
+// reads one request and forks its child; -1 once the shell is gone
+static int serve_request(int sock, const sigset_t *mask)
+{
+    struct zygote_req req;
+    int fds[ZYGOTE_MAX_FDS + 1];
+    int fd_count = 0;
+    char control[CMSG_SPACE(sizeof(fds))];
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                         .msg_controllen = sizeof(control)};
+
+    ssize_t n;
+    do
+    {
+        n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+        return -1;
+    }
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c))
+    {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS)
+        {
+            fd_count = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(c), fd_count * sizeof(int));
+        }
+    }
+    if ((size_t)n < sizeof(req) && read_all(sock, (char *)&req + n, sizeof(req) - n) < 0)
+    {
+        return -1;
+    }
+
+    // a request that doesn't add up leaves the stream out of step: give up
+    if (req.fd_count > ZYGOTE_MAX_FDS || fd_count != (int)req.fd_count + 1 || req.argc == 0 ||
+        (uint64_t)req.strings_len + req.data_len > ZYGOTE_MAX_REQUEST)
+    {
+        return -1;
+    }
+    char *body = malloc(req.data_len + req.strings_len + 1);
+    if (!body || read_all(sock, body, req.data_len + req.strings_len) < 0)
+    {
+        return -1;
+    }
+    char *strings = body + req.data_len;
+    strings[req.strings_len] = '\0';
+
+    // path, then argc + envc more strings
+    char **argv = malloc((req.argc + 1) * sizeof(char *));
+    char **env = malloc((req.envc + 1) * sizeof(char *));
+    char *p = strings;
+    char *end = strings + req.strings_len;
+    char *path = p;
+    uint32_t found = 0;
+    p += strnlen(p, end - p) + 1;
+    for (; argv && env && found < req.argc + req.envc && p < end; found++)
+    {
+        if (found < req.argc)
+        {
+            argv[found] = p;
+        }
+        else
+        {
+            env[found - req.argc] = p;
+        }
+        p += strnlen(p, end - p) + 1;
+    }
+
+    pid_t pid = -1;
+    int error = argv && env ? EINVAL : ENOMEM;
+    if (argv && env && found == req.argc + req.envc && p <= end)
+    {
+        argv[req.argc] = NULL;
+        env[req.envc] = NULL;
+        pid = fork();
+        error = errno;
+        if (pid == 0)
+        {
+            start_child(&req, fds[0], fds + 1, path, argv, env, body, mask);
+        }
+        if (pid > 0 && req.pgid >= 0)
+        {
+            // also here, so the group exists as soon as the shell has the pid
+            setpgid(pid, req.pgid ? req.pgid : pid);
+        }
+    }
+
+    send_msg(sock, ZYGOTE_SPAWNED, pid, pid < 0 ? error : 0);
+    for (int i = 0; i < fd_count; i++)
+    {
+        close(fds[i]);
+    }
+    free(body);
+    free(argv);
+    free(env);
+    return 0;
+}
+
+static void zygote_main(int sock)
+{
+    // nothing of the shell's but stdio and the socket
+    if (sock > 3)
+    {
+        syscall(SYS_close_range, 3, sock - 1, 0);
+    }
+    syscall(SYS_close_range, sock + 1, ~0U, 0);
+    malloc_trim(0);
+
+    // children are reaped as SIGCHLD arrives on a signalfd
+    sigset_t mask, chld;
+    sigemptyset(&chld);
+    sigaddset(&chld, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld, &mask);
+    int sigfd = signalfd(-1, &chld, SFD_CLOEXEC);
+    if (sigfd < 0)
+    {
+        _exit(1);
+    }
+
+    while (1)
+    {
+        struct pollfd pfds[2] = {{sock, POLLIN, 0}, {sigfd, POLLIN, 0}};
+        if (poll(pfds, 2, -1) < 0)
+        {
+            continue;
+        }
+        if (pfds[1].revents)
+        {
+            struct signalfd_siginfo info;
+            if (read(sigfd, &info, sizeof(info)) < 0)
+            {
+                // fine: waitpid() below finds them either way
+            }
+            int status;
+            pid_t pid;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+            {
+                send_msg(sock, ZYGOTE_EXITED, pid, status);
+            }
+        }
+        if (pfds[0].revents && serve_request(sock, &mask) < 0)
+        {
+            _exit(0);
+        }
+    }
+}
+
+// the shell's side
+
+struct zygote *zygote_start(zygote_exit_cb exited, void *arg)
+{
+    struct zygote *z = malloc(sizeof(struct zygote));
+    int sv[2];
+    if (!z || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0)
+    {
+        free(z);
+        return NULL;
+    }
+
+    fflush(NULL);
+    pid_t pid = fork();
+    if (pid == 0)
+    {
+        close(sv[0]);
+        zygote_main(sv[1]);
+    }
+    close(sv[1]);
+    if (pid < 0)
+    {
+        close(sv[0]);
+        free(z);
+        return NULL;
+    }
+    z->fd = sv[0];
+    z->pid = pid;
+    z->owner = getpid();
+    z->exited = exited;
+    z->arg = arg;
+    return z;
+}
+
+void zygote_stop(struct zygote *z)
+{
+    if (!z)
+    {
+        return;
+    }
+    close(z->fd);
+    if (z->owner == getpid())
+    {
+        waitpid(z->pid, NULL, 0);
+    }
+    free(z);
+}
+
+int zygote_fd(struct zygote *z)
+{
+    return z->fd;
+}
+
+pid_t zygote_spawn(struct zygote *z, const struct zygote_job *job)
+{
+    struct zygote_req req = {0};
+    size_t strings_len = strlen(job->path) + 1;
+    if (job->fd_count > ZYGOTE_MAX_FDS)
+    {
+        return -1;
+    }
+    for (req.argc = 0; job->argv[req.argc]; req.argc++)
+    {
+        strings_len += strlen(job->argv[req.argc]) + 1;
+    }
+    for (req.envc = 0; job->env[req.envc]; req.envc++)
+    {
+        strings_len += strlen(job->env[req.envc]) + 1;
+    }
+    if (strings_len + job->data_len > ZYGOTE_MAX_REQUEST)
+    {
+        return -1;
+    }
+    req.fd_count = job->fd_count;
+    req.pgid = job->pgid;
+    req.strings_len = strings_len;
+    req.data_len = job->data_len;
+    req.setup = job->setup;
+    memcpy(req.target_fds, job->target_fds, job->fd_count * sizeof(int));
+
+    char *body = malloc(strings_len + job->data_len);
+    if (!body)
+    {
+        return -1;
+    }
+    if (job->data_len > 0)
+    {
+        memcpy(body, job->data, job->data_len);
+    }
+    char *p = stpcpy(body + job->data_len, job->path) + 1;
+    for (uint32_t i = 0; i < req.argc; i++)
+    {
+        p = stpcpy(p, job->argv[i]) + 1;
+    }
+    for (uint32_t i = 0; i < req.envc; i++)
+    {
+        p = stpcpy(p, job->env[i]) + 1;
+    }
+
+    int fds[ZYGOTE_MAX_FDS + 1];
+    fds[0] = job->cwd_fd;
+    memcpy(fds + 1, job->fds, job->fd_count * sizeof(int));
+    char control[CMSG_SPACE(sizeof(fds))] = {0};
+    struct iovec iov = {&req, sizeof(req)};
+    struct msghdr msg = {.msg_iov = &iov, .msg_iovlen = 1, .msg_control = control,
+                         .msg_controllen = CMSG_SPACE((job->fd_count + 1) * sizeof(int))};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN((job->fd_count + 1) * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, (job->fd_count + 1) * sizeof(int));
+
+    // the fds go with the first byte; the rest of the header may follow
+    ssize_t n;
+    do
+    {
+        n = sendmsg(z->fd, &msg, MSG_NOSIGNAL);
+    } while (n < 0 && errno == EINTR);
+    int failed = n < 0 || send_all(z->fd, (char *)&req + n, sizeof(req) - n) < 0 ||
+                 send_all(z->fd, body, strings_len + job->data_len) < 0;
+    free(body);
+    if (failed)
+    {
+        return -1;
+    }
+
+    // children that exit meanwhile are reported before the answer
+    while (1)
+    {
+        struct zygote_msg reply;
+        if (read_all(z->fd, &reply, sizeof(reply)) < 0)
+        {
+            return -1;
+        }
+        if (reply.kind == ZYGOTE_EXITED)
+        {
+            z->exited(reply.pid, reply.value, z->arg);
+            continue;
+        }
+        if (reply.pid < 0)
+        {
+            errno = reply.value;
+        }
+        return reply.pid;
+    }
+}
+
+int zygote_dispatch(struct zygote *z)
+{
+    struct zygote_msg msg;
+    if (read_all(z->fd, &msg, sizeof(msg)) < 0)
+    {
+        return -1;
+    }
+    if (msg.kind == ZYGOTE_EXITED)
+    {
+        z->exited(msg.pid, msg.value, z->arg);
+    }
+    return 0;
+}
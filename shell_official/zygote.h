@@ -0,0 +1,55 @@
+#ifndef ZYGOTE_H
+#define ZYGOTE_H
+
+#include <stddef.h>
+#include <sys/types.h>
+
+// a zygote is a small helper process, forked once while the shell is still
+// small, that forks and execs commands for it. fork() copies the page
+// tables of whoever calls it, so spawning from the helper costs the same
+// however big the shell grows. requests go over a socketpair: the program,
+// argv, envp and working directory, and the child's fds passed with
+// SCM_RIGHTS. exit statuses come back over it as messages, since the
+// children are the helper's, not the shell's
+
+#define ZYGOTE_MAX_FDS 32
+
+// what to start
+struct zygote_job
+{
+    const char *path;  // execve()d as is: no path search
+    char **argv;       // NULL terminated, like env
+    char **env;
+    int cwd_fd;        // fchdir()ed to first
+    pid_t pgid;        // -1 = the helper's group, 0 = a new one, > 0 join it
+    int fd_count;      // the child's fd table: target_fds[i] is a copy of
+    int fds[ZYGOTE_MAX_FDS];        // fds[i] (the caller's), every other
+    int target_fds[ZYGOTE_MAX_FDS]; // fd is closed
+    int (*setup)(const void *data); // run in the child before execve, -1 = fail
+    const void *data;
+    size_t data_len;   // copied into the request
+};
+
+// called with the raw wait status of a child that exited
+typedef void (*zygote_exit_cb)(pid_t pid, int status, void *arg);
+
+struct zygote;
+
+// forks the helper (NULL on failure). exited is called from zygote_spawn
+// and zygote_dispatch
+struct zygote *zygote_start(zygote_exit_cb exited, void *arg);
+
+// closes the socket; the helper exits once no process holds it any more.
+// in the process that started it, also reaps it
+void zygote_stop(struct zygote *z);
+
+// readable whenever a message is waiting (for the caller's event loop)
+int zygote_fd(struct zygote *z);
+
+// starts job; the child's pid, -1 on failure (the helper gone, fork failed)
+pid_t zygote_spawn(struct zygote *z, const struct zygote_job *job);
+
+// handles one message; -1 once the helper is gone
+int zygote_dispatch(struct zygote *z);
+
+#endif
@@ -0,0 +1,38 @@
+#!/bin/sh
+# Process substitutions after cd: the subshell behind <(...) / >(...) has to
+# start its commands in the context's directory (the one cd moved to), not
+# in the directory the shell process was started in.
+#
+# usage: ./procsub_cwd.sh
+#
+# build: gcc -O2 ../shell_official/main.c ../shell_official/wish.c ../shell_official/lineedit.c ../shell_official/complete.c ../shell_official/outmux.c ../shell_official/evloop.c ../shell_official/scan.c ../shell_official/zygote.c ../shell_official/frame.c ../shell_official/serve.c -o wish
+set -e
+
+WISH=$(pwd)/wish
+
+if [ ! -x "$WISH" ]; then
+    echo "build wish first (see the top of this file)" >&2
+    exit 1
+fi
+
+DIR=$(mktemp -d)
+trap 'rm -rf "$DIR"' EXIT
+mkdir "$DIR/sub"
+echo "in sub" > "$DIR/sub/file"
+
+check()
+{
+    printf 'cd sub\n%s\n' "$2" > "$DIR/script"
+    got=$(cd "$DIR" && "$WISH" script 2>&1)
+    if [ "$got" != "$3" ]; then
+        echo "FAIL $1: got \"$got\", want \"$3\"" >&2
+        exit 1
+    fi
+    echo "ok   $1"
+}
+
+check '<(ls)' 'cat <(ls)' 'file'
+check '<(cat file)' 'cat <(cat file)' 'in sub'
+check '<(cat < file)' 'cat <(cat < file)' 'in sub'
+check '> >(cat > out)' 'echo hi > >(cat > out)
+cat out' 'hi'
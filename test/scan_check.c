@@ -0,0 +1,158 @@
+// Differential test of wish's word scanner: scan_word_sse2() and, when the
+// CPU has AVX2, scan_word_avx2() must return what scan_word_scalar() does.
+// Covers every start alignment within a 64-byte line, each delimiter (and
+// bytes next to one, and bytes >= 0x80) at every position, strings whose
+// '\0' is the last byte before an unmapped page, and random strings.
+//
+// build: gcc -O2 scan_check.c -o scan_check
+// usage: ./scan_check
+#include "../shell_official/scan.c" // for the static vector versions
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#define MAX_LEN 130
+
+static const char probes[] = " \t|<>&;\x01\x1f!={}\x80\xa0\xfe";
+
+typedef size_t (*word_scan)(const char *s);
+
+static long checked;
+
+static int check(const char *name, word_scan scan, const char *s)
+{
+    size_t got = scan(s), want = scan_word_scalar(s);
+    checked++;
+    if (got != want)
+    {
+        fprintf(stderr, "FAIL %s: %zu instead of %zu at offset %zu for \"%s\"\n", name, got, want,
+                (size_t)((uintptr_t)s & 63), s);
+        return 0;
+    }
+    return 1;
+}
+
+// every alignment, every probe byte at every position of every length
+static int alignments(const char *name, word_scan scan)
+{
+    _Alignas(64) static char buf[64 + MAX_LEN + 1];
+    for (size_t off = 0; off < 64; off++)
+    {
+        for (size_t len = 0; len <= MAX_LEN; len++)
+        {
+            char *s = buf + off;
+            memset(buf, 'x', sizeof(buf));
+            s[len] = '\0';
+            if (!check(name, scan, s))
+            {
+                return 0;
+            }
+            for (size_t pos = 0; pos < len; pos++)
+            {
+                for (size_t p = 0; p < sizeof(probes) - 1; p++)
+                {
+                    s[pos] = probes[p];
+                    if (!check(name, scan, s))
+                    {
+                        return 0;
+                    }
+                }
+                s[pos] = 'x';
+            }
+        }
+    }
+    return 1;
+}
+
+// the '\0' is the last byte of a page whose next page is not mapped: a load
+// that crosses into it faults
+static int page_ends(const char *name, word_scan scan)
+{
+    long page = sysconf(_SC_PAGESIZE);
+    char *map = mmap(NULL, 2 * page, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED || mprotect(map + page, page, PROT_NONE) < 0)
+    {
+        perror("mmap");
+        return 0;
+    }
+    char *end = map + page - 1;
+    memset(map, 'x', page);
+    *end = '\0';
+    for (size_t len = 0; len <= MAX_LEN; len++)
+    {
+        char *s = end - len;
+        if (!check(name, scan, s))
+        {
+            return 0;
+        }
+        for (size_t pos = 0; pos < len; pos++)
+        {
+            for (size_t p = 0; p < sizeof(probes) - 1; p++)
+            {
+                s[pos] = probes[p];
+                if (!check(name, scan, s))
+                {
+                    return 0;
+                }
+            }
+            s[pos] = 'x';
+        }
+    }
+    munmap(map, 2 * page);
+    return 1;
+}
+
+static int random_strings(const char *name, word_scan scan)
+{
+    _Alignas(64) char buf[256];
+    srand(1);
+    for (int round = 0; round < 200000; round++)
+    {
+        size_t off = round % 64;
+        size_t len = rand() % (sizeof(buf) - off - 1);
+        for (size_t i = 0; i < sizeof(buf); i++)
+        {
+            buf[i] = rand() % 4 ? 'x' : probes[rand() % (sizeof(probes) - 1)];
+        }
+        buf[off + len] = '\0';
+        if (!check(name, scan, buf + off))
+        {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static int run(const char *name, word_scan scan)
+{
+    long before = checked;
+    if (!alignments(name, scan) || !page_ends(name, scan) || !random_strings(name, scan))
+    {
+        return 0;
+    }
+    printf("ok   %-6s %ld strings\n", name, checked - before);
+    return 1;
+}
+
+int main(void)
+{
+#ifdef SCAN_X86
+    __builtin_cpu_init();
+    if (!run("sse2", scan_word_sse2))
+    {
+        return 1;
+    }
+    if (!__builtin_cpu_supports("avx2"))
+    {
+        printf("skip avx2   (not supported by this CPU)\n");
+    }
+    else if (!run("avx2", scan_word_avx2))
+    {
+        return 1;
+    }
+#else
+    printf("skip        (no vector versions on this architecture)\n");
+#endif
+    // and whatever scan_word() picked
+    return run("picked", scan_word) ? 0 : 1;
+}
@@ -0,0 +1,109 @@
+// timeout on a terminal: the timed pipeline runs in a process group of its
+// own, which has to be handed the terminal. otherwise a stage that reads the
+// tty stops on SIGTTIN and the line typed for it goes to the shell, and
+// ctrl-c goes to the shell instead of the job.
+// runs ./wish interactively on a pseudo-terminal.
+//
+// build: gcc -O2 timeout_tty.c -lutil -o timeout_tty
+// usage: ./timeout_tty (with wish built here, see procsub_cwd.sh)
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <poll.h>
+#include <pty.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+static int master;
+static char seen[65536]; // everything the terminal showed since the last send
+static size_t seen_len;
+
+static void send(const char *keys)
+{
+    seen_len = 0;
+    seen[0] = '\0';
+    write(master, keys, strlen(keys));
+}
+
+// reads the terminal until what came out contains want, up to ms
+static int expect(const char *want, int ms)
+{
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    while (!strstr(seen, want))
+    {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        int left = ms - (int)((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000);
+        struct pollfd pfd = {master, POLLIN, 0};
+        if (left <= 0 || poll(&pfd, 1, left) <= 0)
+        {
+            return 0;
+        }
+        ssize_t n = read(master, seen + seen_len, sizeof(seen) - 1 - seen_len);
+        if (n <= 0)
+        {
+            return 0;
+        }
+        seen_len += n;
+        seen[seen_len] = '\0';
+    }
+    return 1;
+}
+
+static int check(const char *what, int ok)
+{
+    printf("%s %s\n", ok ? "ok  " : "FAIL", what);
+    if (!ok)
+    {
+        printf("---- terminal:\n%s\n----\n", seen);
+    }
+    return ok;
+}
+
+int main(void)
+{
+    if (access("./wish", X_OK) < 0)
+    {
+        fprintf(stderr, "build wish first (see procsub_cwd.sh)\n");
+        return 1;
+    }
+
+    pid_t pid = forkpty(&master, NULL, NULL, NULL);
+    if (pid < 0)
+    {
+        perror("forkpty");
+        return 1;
+    }
+    if (pid == 0)
+    {
+        setenv("HOME", "/nonexistent", 1); // no history file
+        execl("./wish", "wish", (char *)NULL);
+        _exit(127);
+    }
+
+    int ok = check("prompt", expect("wish> ", 3000));
+
+    // the typed line is cat's, which echoes it and then sees ctrl-d
+    send("timeout 5 cat\r");
+    usleep(300000);
+    send("typed-for-cat\n");
+    ok = check("cat reads the terminal", expect("typed-for-cat\r\ntyped-for-cat", 2000)) && ok;
+    send("\x04");
+    ok = check("the shell gets the terminal back", expect("wish> ", 2000)) && ok;
+    ok = check("the line didn't go to the shell", !strstr(seen, "An error has occurred")) && ok;
+
+    // ctrl-c stops the timed job, not the shell
+    send("timeout 10 sleep 8\r");
+    usleep(300000);
+    send("\x03");
+    ok = check("ctrl-c ends the job", expect("wish> ", 2000)) && ok;
+    send("echo still-here\r");
+    ok = check("the shell survives ctrl-c", expect("still-here\r\n", 2000)) && ok;
+
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+    return ok ? 0 : 1;
+}
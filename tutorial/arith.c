@@ -0,0 +1,392 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include "arith.h"
+#include "symtab.h"
+
+/*
+ * arithmetic expansion
+ *
+ * a precedence climbing parser that evaluates as it parses: parse_expr
+ * reads an operand, then keeps folding in binary operators as long as they
+ * bind at least as tightly as min_prec, parsing each right-hand side with
+ * the precedence just above (or equal to, for the right-associative
+ * assignments and ?:) the operator's own. there is no tree: a counter
+ * update like i += 1 is one pass over six characters.
+ *
+ * the arithmetic is done on unsigned values where C leaves signed overflow
+ * undefined, so results wrap around the way they do in other shells.
+ */
+
+#define ARITH_MAX_NAME 256
+
+enum arith_op_e
+{
+    OP_ASSIGN, OP_MUL_ASSIGN, OP_DIV_ASSIGN, OP_MOD_ASSIGN, OP_ADD_ASSIGN, OP_SUB_ASSIGN,
+    OP_SHL_ASSIGN, OP_SHR_ASSIGN, OP_AND_ASSIGN, OP_XOR_ASSIGN, OP_OR_ASSIGN,
+    OP_COND, OP_LOR, OP_LAND, OP_OR, OP_XOR, OP_AND, OP_EQ, OP_NE,
+    OP_LT, OP_LE, OP_GT, OP_GE, OP_SHL, OP_SHR, OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_MOD,
+};
+
+struct arith_op_s
+{
+    const char *text;
+    enum arith_op_e op;
+    int prec;           // higher binds tighter
+    int right;          // right-associative
+    enum arith_op_e base; // what a compound assignment does before it assigns
+};
+
+// longest first, so "<<=" is not taken for "<"
+static const struct arith_op_s arith_ops[] =
+{
+    {"<<=", OP_SHL_ASSIGN, 1, 1, OP_SHL}, {">>=", OP_SHR_ASSIGN, 1, 1, OP_SHR},
+    {"*=", OP_MUL_ASSIGN, 1, 1, OP_MUL},  {"/=", OP_DIV_ASSIGN, 1, 1, OP_DIV},
+    {"%=", OP_MOD_ASSIGN, 1, 1, OP_MOD},  {"+=", OP_ADD_ASSIGN, 1, 1, OP_ADD},
+    {"-=", OP_SUB_ASSIGN, 1, 1, OP_SUB},  {"&=", OP_AND_ASSIGN, 1, 1, OP_AND},
+    {"^=", OP_XOR_ASSIGN, 1, 1, OP_XOR},  {"|=", OP_OR_ASSIGN, 1, 1, OP_OR},
+    {"||", OP_LOR, 3, 0, 0},  {"&&", OP_LAND, 4, 0, 0},
+    {"==", OP_EQ, 8, 0, 0},   {"!=", OP_NE, 8, 0, 0},
+    {"<=", OP_LE, 9, 0, 0},   {">=", OP_GE, 9, 0, 0},
+    {"<<", OP_SHL, 10, 0, 0}, {">>", OP_SHR, 10, 0, 0},
+    {"=", OP_ASSIGN, 1, 1, OP_ASSIGN},
+    {"?", OP_COND, 2, 1, 0},
+    {"|", OP_OR, 5, 0, 0},    {"^", OP_XOR, 6, 0, 0},   {"&", OP_AND, 7, 0, 0},
+    {"<", OP_LT, 9, 0, 0},    {">", OP_GT, 9, 0, 0},
+    {"+", OP_ADD, 11, 0, 0},  {"-", OP_SUB, 11, 0, 0},
+    {"*", OP_MUL, 12, 0, 0},  {"/", OP_DIV, 12, 0, 0},  {"%", OP_MOD, 12, 0, 0},
+};
+
+struct arith_s
+{
+    const char *expr;   // the whole expression, for errors
+    const char *p;      // where we are in it
+    int skip;           // > 0 on the side of && || ?: that doesn't count
+    int failed;
+    const char *name;   // the operand just read, when it was a lone variable
+    size_t name_len;
+};
+
+static void arith_error(struct arith_s *a, const char *msg)
+{
+    if (!a->failed)
+    {
+        fprintf(stderr, "error: arithmetic: %s: %s\n", msg, a->expr);
+    }
+    a->failed = 1;
+}
+
+static void skip_blanks(struct arith_s *a)
+{
+    while (isspace((unsigned char)*a->p))
+    {
+        a->p++;
+    }
+}
+
+static int accept(struct arith_s *a, const char *text)
+{
+    skip_blanks(a);
+    size_t len = strlen(text);
+    if (strncmp(a->p, text, len) != 0)
+    {
+        return 0;
+    }
+    a->p += len;
+    return 1;
+}
+
+// a variable's value as a number: stored as one already, or a string that
+// reads as one (unset and empty count as 0)
+static long long read_var(struct arith_s *a, const char *name, size_t len)
+{
+    char buf[ARITH_MAX_NAME];
+    if (len >= sizeof(buf))
+    {
+        arith_error(a, "variable name too long");
+        return 0;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+
+    struct symtab_entry_s *entry = get_symtab_entry(buf);
+    if (entry && entry->val_type == VAL_SLLONG)
+    {
+        return entry->val.sllong;
+    }
+
+    const char *str = get_var(buf);
+    if (!str || !*str)
+    {
+        return 0;
+    }
+    char *end;
+    errno = 0;
+    long long val = strtoll(str, &end, 0);
+    while (isspace((unsigned char)*end))
+    {
+        end++;
+    }
+    if (errno || end == str || *end)
+    {
+        if (!a->skip)
+        {
+            arith_error(a, "variable is not a number");
+        }
+        return 0;
+    }
+    return val;
+}
+
+static void write_var(struct arith_s *a, const char *name, size_t len, long long val)
+{
+    char buf[ARITH_MAX_NAME];
+    if (a->skip || a->failed)
+    {
+        return;
+    }
+    if (len >= sizeof(buf))
+    {
+        arith_error(a, "variable name too long");
+        return;
+    }
+    memcpy(buf, name, len);
+    buf[len] = '\0';
+    if (!set_var_int(buf, val))
+    {
+        arith_error(a, "failed to set variable");
+    }
+}
+
+static long long apply(struct arith_s *a, enum arith_op_e op, long long l, long long r)
+{
+    unsigned long long ul = l, ur = r;
+    switch (op)
+    {
+    case OP_OR:  return l | r;
+    case OP_XOR: return l ^ r;
+    case OP_AND: return l & r;
+    case OP_EQ:  return l == r;
+    case OP_NE:  return l != r;
+    case OP_LT:  return l < r;
+    case OP_LE:  return l <= r;
+    case OP_GT:  return l > r;
+    case OP_GE:  return l >= r;
+    case OP_SHL: return (long long)(ul << (r & 63));
+    case OP_SHR: return l >> (r & 63);
+    case OP_ADD: return (long long)(ul + ur);
+    case OP_SUB: return (long long)(ul - ur);
+    case OP_MUL: return (long long)(ul * ur);
+    case OP_DIV:
+    case OP_MOD:
+        if (r == 0)
+        {
+            if (!a->skip)
+            {
+                arith_error(a, "division by zero");
+            }
+            return 0;
+        }
+        if (l == LLONG_MIN && r == -1) // the one quotient that doesn't fit
+        {
+            return op == OP_DIV ? LLONG_MIN : 0;
+        }
+        return op == OP_DIV ? l / r : l % r;
+    default:
+        return r; // OP_ASSIGN
+    }
+}
+
+static long long parse_expr(struct arith_s *a, int min_prec);
+
+static long long parse_operand(struct arith_s *a)
+{
+    a->name = NULL;
+    skip_blanks(a);
+
+    if (accept(a, "("))
+    {
+        long long val = parse_expr(a, 1);
+        if (!accept(a, ")"))
+        {
+            arith_error(a, "missing `)'");
+        }
+        a->name = NULL;
+        return val;
+    }
+
+    if (isdigit((unsigned char)*a->p))
+    {
+        char *end;
+        errno = 0;
+        long long val = strtoll(a->p, &end, 0); // 10, 0x1f, 017
+        if (errno || isalnum((unsigned char)*end) || *end == '_')
+        {
+            arith_error(a, "invalid number");
+        }
+        a->p = end;
+        return val;
+    }
+
+    size_t len = var_name_len(a->p);
+    if (!len)
+    {
+        arith_error(a, *a->p ? "syntax error" : "operand expected");
+        return 0;
+    }
+    const char *name = a->p;
+    a->p += len;
+    long long val = read_var(a, name, len);
+
+    // i++ / i--: the old value, with the variable updated
+    if (accept(a, "++") || accept(a, "--"))
+    {
+        write_var(a, name, len, apply(a, a->p[-1] == '+' ? OP_ADD : OP_SUB, val, 1));
+        return val;
+    }
+    a->name = name;
+    a->name_len = len;
+    return val;
+}
+
+static long long parse_unary(struct arith_s *a)
+{
+    skip_blanks(a);
+    if (accept(a, "++") || accept(a, "--"))
+    {
+        enum arith_op_e op = a->p[-1] == '+' ? OP_ADD : OP_SUB;
+        long long val = parse_unary(a);
+        if (!a->name)
+        {
+            arith_error(a, "++/-- needs a variable");
+            return 0;
+        }
+        val = apply(a, op, val, 1);
+        write_var(a, a->name, a->name_len, val);
+        a->name = NULL;
+        return val;
+    }
+
+    long long val;
+    switch (*a->p)
+    {
+    case '!':
+        a->p++;
+        val = !parse_unary(a);
+        break;
+    case '~':
+        a->p++;
+        val = ~parse_unary(a);
+        break;
+    case '-':
+        a->p++;
+        val = (long long)(0ULL - (unsigned long long)parse_unary(a));
+        break;
+    case '+':
+        a->p++;
+        val = parse_unary(a);
+        break;
+    default:
+        return parse_operand(a);
+    }
+    a->name = NULL;
+    return val;
+}
+
+static const struct arith_op_s *next_op(struct arith_s *a)
+{
+    skip_blanks(a);
+    for (size_t i = 0; i < sizeof(arith_ops) / sizeof(arith_ops[0]); i++)
+    {
+        size_t len = strlen(arith_ops[i].text);
+        if (strncmp(a->p, arith_ops[i].text, len) == 0)
+        {
+            return &arith_ops[i];
+        }
+    }
+    return NULL;
+}
+
+static long long parse_expr(struct arith_s *a, int min_prec)
+{
+    long long lhs = parse_unary(a);
+
+    const struct arith_op_s *op;
+    while (!a->failed && (op = next_op(a)) && op->prec >= min_prec)
+    {
+        const char *name = a->name;
+        size_t name_len = a->name_len;
+        a->p += strlen(op->text);
+
+        if (op->op == OP_COND)
+        {
+            // only the branch that is taken counts
+            a->skip += !lhs;
+            long long yes = parse_expr(a, 1);
+            a->skip -= !lhs;
+            if (!accept(a, ":"))
+            {
+                arith_error(a, "missing `:'");
+                return 0;
+            }
+            a->skip += !!lhs;
+            long long no = parse_expr(a, op->prec);
+            a->skip -= !!lhs;
+            lhs = lhs ? yes : no;
+        }
+        else if (op->op == OP_LAND || op->op == OP_LOR)
+        {
+            int decided = op->op == OP_LAND ? !lhs : !!lhs;
+            a->skip += decided;
+            long long rhs = parse_expr(a, op->prec + 1);
+            a->skip -= decided;
+            lhs = decided ? op->op == OP_LOR : !!rhs;
+        }
+        else if (op->prec == 1) // = += -= ...
+        {
+            long long rhs = parse_expr(a, op->prec);
+            if (!name)
+            {
+                arith_error(a, "assignment to a non-variable");
+                return 0;
+            }
+            lhs = apply(a, op->base, lhs, rhs);
+            write_var(a, name, name_len, lhs);
+        }
+        else
+        {
+            long long rhs = parse_expr(a, op->right ? op->prec : op->prec + 1);
+            lhs = apply(a, op->op, lhs, rhs);
+        }
+        a->name = NULL; // the result is a value, not a variable any more
+    }
+    return lhs;
+}
+
+int arith_eval(const char *expr, long long *result)
+{
+    struct arith_s a = {expr, expr, 0, 0, NULL, 0};
+
+    skip_blanks(&a);
+    if (!*a.p)
+    {
+        *result = 0; // $(( )) is 0
+        return 0;
+    }
+
+    long long val = parse_expr(&a, 1);
+    skip_blanks(&a);
+    if (*a.p && !a.failed)
+    {
+        arith_error(&a, "syntax error");
+    }
+    if (a.failed)
+    {
+        return -1;
+    }
+    *result = val;
+    return 0;
+}
@@ -0,0 +1,10 @@
+#ifndef ARITH_H
+#define ARITH_H
+
+// evaluates an arithmetic expression, the expr of $((expr)) or ((expr)),
+// with 64-bit signed integers. variables are read and assigned (=, +=,
+// ++...) as numbers. returns 0 and sets *result, or -1 after printing an
+// error (bad syntax, division by zero, a variable that isn't a number)
+int arith_eval(const char *expr, long long *result);
+
+#endif
@@ -1,85 +1,337 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
 #include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include "shell.h"
 #include "node.h"
 #include "executor.h"
+#include "symtab.h"
+#include "arith.h"
+#include "read.h"
 
-char *search_path(char *file)
+/*
+ * executable lookup cache
+ *
+ * every PATH directory gets a hash set with the names of the regular files
+ * inside it, built with a single readdir pass the first time we need it.
+ * a lookup is then just one hash probe per directory instead of building
+ * a candidate string and calling stat() on it. a directory is reloaded when
+ * its mtime changes (something was installed/removed there), and the whole
+ * index is dropped when $PATH itself changes.
+ */
+
+#define PATHDIR_RECHECK_NSEC 1000000000L // how often (at most) we stat a dir
+
+struct path_dir_s
 {
-    char *PATH = getenv("PATH");
-    char *p = PATH;
-    char *p2;
+    char *dir;              // directory as written in $PATH
+    int loaded;             // names[] reflects mtime below
+    struct timespec mtime;  // dir mtime when names[] was built
+    struct timespec checked; // last time we compared the mtime
+    char *pool;             // all the names, '\0' separated
+    size_t pool_len, pool_cap;
+    size_t *slots;          // open addressing, pool offset + 1 (0 = empty)
+    size_t nslots, count;
+};
+
+static char *index_path = NULL; // copy of the $PATH the index was built for
+static struct path_dir_s *path_dirs = NULL;
+static int path_dir_count = 0;
+
+static size_t hash_name(const char *s, size_t len)
+{
+    size_t h = 14695981039346656037UL; // FNV-1a
+    while (len--)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h;
+}
+
+static void clear_dir(struct path_dir_s *d)
+{
+    free(d->pool);
+    free(d->slots);
+    d->pool = NULL;
+    d->slots = NULL;
+    d->pool_len = d->pool_cap = 0;
+    d->nslots = d->count = 0;
+    d->loaded = 0;
+}
 
-    while (p && *p)
+static void free_path_index(void)
+{
+    for (int i = 0; i < path_dir_count; i++)
     {
-        p2 = p;
+        clear_dir(&path_dirs[i]);
+        free(path_dirs[i].dir);
+    }
+    free(path_dirs);
+    free(index_path);
+    path_dirs = NULL;
+    index_path = NULL;
+    path_dir_count = 0;
+}
 
-        while (*p2 && *p2 != ':') // iteration through rhe chars in PATH
+static int insert_name(struct path_dir_s *d, const char *name, size_t len)
+{
+    if ((d->count + 1) * 2 > d->nslots) // keep the load factor under 1/2
+    {
+        size_t nslots = d->nslots ? d->nslots * 2 : 64;
+        size_t *slots = calloc(nslots, sizeof(size_t));
+        if (!slots)
         {
-            p2++;
+            return 0;
         }
-
-        int plen = p2 - p;
-        if (!plen) // ensures there is always at least one byte for buildiing the path
+        for (size_t i = 0; i < d->nslots; i++)
         {
-            plen = 1;
+            if (!d->slots[i])
+            {
+                continue;
+            }
+            char *old = d->pool + d->slots[i] - 1;
+            size_t j = hash_name(old, strlen(old)) & (nslots - 1);
+            while (slots[j])
+            {
+                j = (j + 1) & (nslots - 1);
+            }
+            slots[j] = d->slots[i];
         }
+        free(d->slots);
+        d->slots = slots;
+        d->nslots = nslots;
+    }
 
-        int alen = strlen(file);
-        char path[plen + 1 + alen + 1]; // holds the full path
+    if (d->pool_len + len + 1 > d->pool_cap)
+    {
+        size_t cap = d->pool_cap ? d->pool_cap : 4096;
+        while (cap < d->pool_len + len + 1)
+        {
+            cap *= 2;
+        }
+        char *pool = realloc(d->pool, cap);
+        if (!pool)
+        {
+            return 0;
+        }
+        d->pool = pool;
+        d->pool_cap = cap;
+    }
+    memcpy(d->pool + d->pool_len, name, len + 1);
 
-        strncpy(path, p, p2 - p); // dir name is copied
-        path[p2 - p] = '\0';      // to ensure the string is null-terminated
+    size_t j = hash_name(name, len) & (d->nslots - 1);
+    while (d->slots[j])
+    {
+        j = (j + 1) & (d->nslots - 1);
+    }
+    d->slots[j] = d->pool_len + 1;
+    d->pool_len += len + 1;
+    d->count++;
+    return 1;
+}
 
-        if (p2[-1] != '/')
+static int has_name(struct path_dir_s *d, const char *name, size_t len)
+{
+    if (!d->count)
+    {
+        return 0;
+    }
+    size_t j = hash_name(name, len) & (d->nslots - 1);
+    while (d->slots[j])
+    {
+        if (strcmp(d->pool + d->slots[j] - 1, name) == 0)
         {
-            strcat(path, "/");
+            return 1;
         }
+        j = (j + 1) & (d->nslots - 1);
+    }
+    return 0;
+}
 
-        strcat(path, file);
+static void load_dir(struct path_dir_s *d)
+{
+    clear_dir(d);
+    d->loaded = 1; // a missing or unreadable dir is simply empty
 
-        struct stat st;
-        if (stat(path, &st) == 0)
+    DIR *dp = opendir(d->dir);
+    if (!dp)
+    {
+        return;
+    }
+
+    struct dirent *ent;
+    while ((ent = readdir(dp)))
+    {
+        // only regular files (or symlinks to them) can be executed
+        if (ent->d_type != DT_REG)
         {
-            if (!S_ISREG(st.st_mode)) // checks if it is a special file (like a directory)
+            struct stat st;
+            if (ent->d_type != DT_LNK && ent->d_type != DT_UNKNOWN)
             {
-                errno = ENOENT;
-                p = p2;
-                if (*p2 == ':')
-                {
-                    p++;
-                }
                 continue;
             }
-
-            p = malloc(strlen(path) + 1);
-            if (!p)
+            if (fstatat(dirfd(dp), ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
             {
-                return NULL;
+                continue;
             }
+        }
+        if (!insert_name(d, ent->d_name, strlen(ent->d_name)))
+        {
+            break;
+        }
+    }
+    closedir(dp);
+}
 
-            strcpy(p, path);
-            return p;
+// reload the dir if it changed on disk, statting it at most once per interval
+static void revalidate_dir(struct path_dir_s *d, const struct timespec *now, int force)
+{
+    if (d->loaded && !force)
+    {
+        long elapsed = (now->tv_sec - d->checked.tv_sec) * 1000000000L +
+                       (now->tv_nsec - d->checked.tv_nsec);
+        if (elapsed < PATHDIR_RECHECK_NSEC)
+        {
+            return;
         }
-        else // move to the next directory if the file still hasnt been found
+    }
+    d->checked = *now;
+
+    struct stat st;
+    if (stat(d->dir, &st) != 0)
+    {
+        clear_dir(d);
+        d->loaded = 1;
+        d->mtime.tv_sec = d->mtime.tv_nsec = 0;
+        return;
+    }
+
+    if (!d->loaded || st.st_mtim.tv_sec != d->mtime.tv_sec ||
+        st.st_mtim.tv_nsec != d->mtime.tv_nsec)
+    {
+        load_dir(d);
+        d->mtime = st.st_mtim;
+    }
+}
+
+// split $PATH into directories, keeping the indexes when nothing changed
+static int build_path_index(const char *PATH)
+{
+    if (index_path && strcmp(index_path, PATH) == 0)
+    {
+        return 1;
+    }
+    free_path_index();
+
+    index_path = strdup(PATH);
+    if (!index_path)
+    {
+        return 0;
+    }
+
+    int n = 1;
+    for (const char *p = PATH; *p; p++)
+    {
+        if (*p == ':')
         {
-            p = p2;
-            if (*p2 == ':')
-            {
-                p++;
-            }
+            n++;
         }
     }
 
-    errno = ENOENT;
+    path_dirs = calloc(n, sizeof(struct path_dir_s));
+    if (!path_dirs)
+    {
+        free_path_index();
+        return 0;
+    }
+
+    const char *p = PATH;
+    while (1)
+    {
+        const char *p2 = strchrnul(p, ':');
+        size_t plen = p2 - p;
+
+        // an empty entry means the current directory
+        char *dir = plen ? strndup(p, plen) : strdup(".");
+        if (!dir)
+        {
+            free_path_index();
+            return 0;
+        }
+        path_dirs[path_dir_count++].dir = dir;
+
+        if (!*p2)
+        {
+            break;
+        }
+        p = p2 + 1;
+    }
+    return 1;
+}
+
+static char *find_in_index(const char *file, size_t flen, const struct timespec *now, int force)
+{
+    for (int i = 0; i < path_dir_count; i++)
+    {
+        struct path_dir_s *d = &path_dirs[i];
+        revalidate_dir(d, now, force);
+        if (!has_name(d, file, flen))
+        {
+            continue;
+        }
+
+        size_t dlen = strlen(d->dir);
+        int slash = d->dir[dlen - 1] != '/';
+        char *path = malloc(dlen + slash + flen + 1);
+        if (!path)
+        {
+            return NULL;
+        }
+        memcpy(path, d->dir, dlen);
+        if (slash)
+        {
+            path[dlen] = '/';
+        }
+        memcpy(path + dlen + slash, file, flen + 1);
+        return path;
+    }
     return NULL;
 }
 
+char *search_path(char *file)
+{
+    char *PATH = getenv("PATH");
+    if (!PATH || !*PATH || !build_path_index(PATH))
+    {
+        errno = ENOENT;
+        return NULL;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    size_t flen = strlen(file);
+    char *path = find_in_index(file, flen, &now, 0);
+    if (!path)
+    {
+        // before reporting a miss make sure no dir was skipped as recently checked
+        path = find_in_index(file, flen, &now, 1);
+    }
+    if (!path)
+    {
+        errno = ENOENT;
+    }
+    return path;
+}
+
 int do_exec_cmd(int argc, char **argv)
 {
     if (strchr(argv[0], '/')) // here the user provided a specific path to the command
@@ -99,86 +351,715 @@ int do_exec_cmd(int argc, char **argv)
     return 0;
 }
 
-static inline void free_argv(int argc, char **argv)
+/*
+ * the tree-walking evaluator
+ *
+ * do_command runs any node and returns its exit status, 0 being true, so
+ * if/while/until/&&/|| just look at what their children returned. loops
+ * run here in the shell process: only the simple commands inside them are
+ * forked, never a new shell per iteration.
+ */
+
+static int last_status = 0;  // $?
+static int loop_depth = 0;   // loops we are inside of
+static int breaking = 0;     // levels of loops still to leave for break N
+static int continuing = 0;   // same for continue N: the last one continues
+
+// length of the expr in "expr))", up to the "))" that closes $(( or ((;
+// -1 if there is none
+static ssize_t arith_len(const char *s)
 {
-    if (!argc)
+    int depth = 0;
+    for (ssize_t i = 0; s[i]; i++)
     {
-        return;
+        if (s[i] == '(')
+        {
+            depth++;
+        }
+        else if (s[i] == ')' && depth > 0)
+        {
+            depth--;
+        }
+        else if (s[i] == ')' && s[i + 1] == ')')
+        {
+            return i;
+        }
     }
+    return -1;
+}
+
+static char *expand_word(char *word);
 
-    while (argc--)
+// the value of the len characters of expr, after the variables written as
+// $NAME in it are expanded. -1 after printing an error
+static int eval_arith(char *expr, size_t len, long long *result)
+{
+    char saved = expr[len];
+    expr[len] = '\0';
+    char *expanded = expand_word(expr);
+    int status = expanded ? arith_eval(expanded, result) : -1;
+    if (expanded && expanded != expr)
     {
-        free(argv[argc]);
+        free(expanded);
     }
+    expr[len] = saved;
+    return status;
 }
 
-int do_simple_command(struct node_s *node)
+static int append(char **out, size_t *len, size_t *cap, const char *s, size_t n)
 {
-    if (!node)
+    if (*len + n + 1 > *cap)
     {
-        return 0;
+        size_t cap2 = (*len + n + 1) * 2;
+        char *out2 = realloc(*out, cap2);
+        if (!out2)
+        {
+            fprintf(stderr, "error: failed to expand word: %s\n", strerror(errno));
+            return 0;
+        }
+        *out = out2;
+        *cap = cap2;
     }
+    memcpy(*out + *len, s, n);
+    *len += n;
+    return 1;
+}
 
-    struct node_s *child = node->first_child;
-    if (!child)
+// $NAME, ${NAME}, $?, $$ and $((expr)) in word, in a new string; word
+// itself if there is nothing to expand, NULL after printing an error
+static char *expand_word(char *word)
+{
+    if (!strchr(word, '$'))
     {
-        return 0;
+        return word;
     }
 
-    // keep track of the number of arguments
-    int argc = 0;
-    long max_args = 255;
-    char *argv[max_args + 1];
-    char *str;
+    size_t len = 0, cap = strlen(word) + 64;
+    char *out = malloc(cap);
+    if (!out)
+    {
+        fprintf(stderr, "error: failed to expand word: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    int ok = 1;
+    for (char *p = word; ok && *p;)
+    {
+        char num[24];
+        const char *val = p; // a plain character, or a lone $
+        size_t vlen = 1, skip = 1, name_len;
+        ssize_t expr_len;
+        if (p[0] != '$')
+        {
+            // as is
+        }
+        else if (p[1] == '?' || p[1] == '$')
+        {
+            vlen = snprintf(num, sizeof(num), "%d", p[1] == '?' ? last_status : (int)getpid());
+            val = num;
+            skip = 2;
+        }
+        else if (p[1] == '(' && p[2] == '(')
+        {
+            long long result;
+            expr_len = arith_len(p + 3);
+            if (expr_len < 0)
+            {
+                fprintf(stderr, "error: missing `))': %s\n", word);
+                ok = 0;
+                break;
+            }
+            if (eval_arith(p + 3, expr_len, &result) < 0)
+            {
+                ok = 0;
+                break;
+            }
+            vlen = snprintf(num, sizeof(num), "%lld", result);
+            val = num;
+            skip = expr_len + 5;
+        }
+        else if (p[1] == '{' && (name_len = var_name_len(p + 2)) && p[2 + name_len] == '}')
+        {
+            p[2 + name_len] = '\0';
+            val = get_var(p + 2);
+            p[2 + name_len] = '}';
+            vlen = val ? strlen(val) : 0;
+            skip = name_len + 3;
+        }
+        else if ((name_len = var_name_len(p + 1)))
+        {
+            char saved = p[1 + name_len];
+            p[1 + name_len] = '\0';
+            val = get_var(p + 1);
+            p[1 + name_len] = saved;
+            vlen = val ? strlen(val) : 0;
+            skip = name_len + 1;
+        }
 
-    while (child)
+        ok = append(&out, &len, &cap, val ? val : "", vlen);
+        p += skip;
+    }
+    if (!ok)
     {
-        str = child->val.str; // extract the actual command
-        argv[argc] = malloc(strlen(str) + 1);
+        free(out);
+        return NULL;
+    }
+    out[len] = '\0';
+    return out;
+}
 
-        if (!argv[argc])
+// frees the words expand_args had to build; the rest belong to the tree
+static void free_args(struct node_s *node, char **argv)
+{
+    struct node_s *child = node->first_child;
+    for (int i = 0; child; i++, child = child->next_sibling)
+    {
+        if (argv[i] != child->val.str)
         {
-            free_argv(argc, argv);
-            return 0;
+            free(argv[i]);
         }
-        
-        // copy the string into the allocated space
-        strcpy(argv[argc], str);
-        if (++argc >= max_args)
+    }
+    free(argv);
+}
+
+// argv only points at the strings the parser already stored in the tree,
+// except for words with a $ in them, so one array sized from the child
+// count is the only allocation most commands need
+static char **expand_args(struct node_s *node)
+{
+    char **argv = calloc(node->children + 1, sizeof(char *));
+    if (!argv)
+    {
+        fprintf(stderr, "error: failed to alloc argv: %s\n", strerror(errno));
+        return NULL;
+    }
+
+    int argc = 0;
+    for (struct node_s *child = node->first_child; child; child = child->next_sibling)
+    {
+        argv[argc] = expand_word(child->val.str);
+        if (!argv[argc])
         {
-            break;
+            argv[argc] = child->val.str; // so free_args can tell it apart
+            free_args(node, argv);
+            return NULL;
         }
-        child = child->next_sibling;
+        argc++;
     }
     argv[argc] = NULL;
+    return argv;
+}
 
-    pid_t child_pid = 0;
-    if ((child_pid = fork()) == 0)
+// NAME=value words at the start of the command. they are told apart as
+// written, before expansion
+static int count_assignments(struct node_s *node)
+{
+    int n = 0;
+    for (struct node_s *child = node->first_child; child; child = child->next_sibling)
     {
-        do_exec_cmd(argc, argv);
-        fprintf(stderr, "error: failed to execute command: %s\n", strerror(errno));
-        if (errno == ENOEXEC)
+        size_t len = var_name_len(child->val.str);
+        if (!len || child->val.str[len] != '=')
         {
-            exit(126);
+            break;
         }
-        else if (errno == ENOENT)
+        n++;
+    }
+    return n;
+}
+
+// a command made of nothing but assignments sets shell variables. a value
+// that is all one $((expr)) is stored as the number itself
+static int do_assignments(struct node_s *node)
+{
+    for (struct node_s *child = node->first_child; child; child = child->next_sibling)
+    {
+        char *word = child->val.str;
+        size_t name_len = var_name_len(word);
+        char *value = word + name_len + 1;
+        size_t value_len = strlen(value);
+        long long num;
+        int ok;
+
+        word[name_len] = '\0';
+        if (strncmp(value, "$((", 3) == 0 && arith_len(value + 3) == (ssize_t)value_len - 5)
         {
-            exit(127);
+            ok = eval_arith(value + 3, value_len - 5, &num) == 0 && set_var_int(word, num);
         }
         else
         {
-            exit(EXIT_FAILURE);
+            char *expanded = expand_word(value);
+            ok = expanded && set_var(word, expanded);
+            if (expanded && expanded != value)
+            {
+                free(expanded);
+            }
+        }
+        word[name_len] = '=';
+        if (!ok)
+        {
+            return 1;
         }
     }
+    return 0;
+}
+
+// ((expr)): true when expr isn't 0. NULL if node is something else
+static char *arith_command(struct node_s *node, ssize_t *len)
+{
+    char *word = node->first_child->val.str;
+    if (node->children != 1 || strncmp(word, "((", 2) != 0)
+    {
+        return NULL;
+    }
+    *len = arith_len(word + 2);
+    return *len >= 0 && word[*len + 4] == '\0' ? word + 2 : NULL;
+}
+
+// the commands that never leave the shell: assignments on their own and
+// ((expr)). the status, or -1 for anything else
+static int do_in_shell(struct node_s *node)
+{
+    ssize_t len;
+    char *expr;
+    long long result;
+    if (count_assignments(node) == node->children)
+    {
+        return do_assignments(node);
+    }
+    if ((expr = arith_command(node, &len)))
+    {
+        return eval_arith(expr, len, &result) < 0 || result == 0;
+    }
+    return -1;
+}
+
+// break [N] / continue [N]
+static int do_loop_control(char **argv, int *counter)
+{
+    int levels = argv[1] ? atoi(argv[1]) : 1;
+    if (levels < 1)
+    {
+        fprintf(stderr, "error: %s: loop count out of range\n", argv[0]);
+        return 1;
+    }
+    if (!loop_depth)
+    {
+        fprintf(stderr, "error: %s: only meaningful in a loop\n", argv[0]);
+        return 0;
+    }
+    *counter = levels < loop_depth ? levels : loop_depth;
+    return 0;
+}
+
+// the end of a simple command in a child: FOO=bar before the command goes
+// into its environment, then it is exec'd. path is its lookup, if done
+static void exec_args(char **argv, int assignments, char *path)
+{
+    for (int i = 0; i < assignments; i++)
+    {
+        char *eq = strchr(argv[i], '=');
+        *eq = '\0';
+        setenv(argv[i], eq + 1, 1);
+    }
+    argv += assignments;
+
+    if (path)
+    {
+        execv(path, argv);
+    }
+    else
+    {
+        do_exec_cmd(0, argv);
+    }
+    // _exit, not exit: exit() would sync the shell's stdin buffer with the
+    // fd we share, seeking a script being read from stdin back
+    fprintf(stderr, "error: failed to execute command: %s\n", strerror(errno));
+    if (errno == ENOEXEC)
+    {
+        _exit(126);
+    }
+    else if (errno == ENOENT)
+    {
+        _exit(127);
+    }
+    else
+    {
+        _exit(EXIT_FAILURE);
+    }
+}
+
+// break, continue and read: the status, or -1 when argv is a program to run
+static int do_builtin(char **argv)
+{
+    if (strcmp(argv[0], "read") == 0)
+    {
+        return do_read(argv);
+    }
+    if (strcmp(argv[0], "break") == 0)
+    {
+        return do_loop_control(argv, &breaking);
+    }
+    if (strcmp(argv[0], "continue") == 0)
+    {
+        return do_loop_control(argv, &continuing);
+    }
+    return -1;
+}
+
+static int wait_status(pid_t pid)
+{
+    int status = 0;
+    if (waitpid(pid, &status, 0) < 0) // suspends the parent process until the child's is completed
+    {
+        return 1;
+    }
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+}
+
+int do_simple_command(struct node_s *node)
+{
+    if (!node || !node->first_child)
+    {
+        return 0;
+    }
+
+    int status = do_in_shell(node);
+    if (status >= 0)
+    {
+        return status;
+    }
+
+    char **argv = expand_args(node);
+    if (!argv)
+    {
+        return 1;
+    }
+    int assignments = count_assignments(node);
+    status = do_builtin(argv + assignments);
+    if (status >= 0)
+    {
+        free_args(node, argv);
+        return status;
+    }
+
+    // resolve in the parent so the lookup cache survives between commands
+    char *cmd = argv[assignments];
+    char *path = strchr(cmd, '/') ? NULL : search_path(cmd);
+
+    read_sync(); // the child may read our stdin too
+    pid_t child_pid = 0;
+    if ((child_pid = fork()) == 0)
+    {
+        exec_args(argv, assignments, path);
+    }
     else if (child_pid < 0)
     {
         fprintf(stderr, "error: failed to fork command: %s\n", strerror(errno));
-        return 0;
+        free(path);
+        free_args(node, argv);
+        return 1;
+    }
+
+    status = wait_status(child_pid);
+    free(path);
+    free_args(node, argv);
+
+    return status;
+}
+
+// a pipeline stage, in its own process: simple commands are exec'd right
+// there, anything else (a loop, an if) runs in this copy of the shell
+static void exec_stage(struct node_s *node)
+{
+    int status;
+    if (node->type != NODE_COMMAND || (status = do_in_shell(node)) >= 0)
+    {
+        status = node->type != NODE_COMMAND ? do_command(node) : status;
+        fflush(stdout);
+        read_sync(); // the fd may be shared with whoever runs after us
+        _exit(status);
+    }
+    char **argv = expand_args(node);
+    if (!argv)
+    {
+        _exit(1);
+    }
+    int assignments = count_assignments(node);
+    status = do_builtin(argv + assignments);
+    if (status >= 0)
+    {
+        _exit(status);
+    }
+    exec_args(argv, assignments, NULL);
+}
+
+static int do_pipeline(struct node_s *node)
+{
+    pid_t *pids = malloc(node->children * sizeof(pid_t));
+    if (!pids)
+    {
+        fprintf(stderr, "error: failed to alloc pipeline: %s\n", strerror(errno));
+        return 1;
+    }
+
+    read_sync();
+    int count = 0;
+    int in_fd = -1; // read end of the previous stage's pipe
+    for (struct node_s *stage = node->first_child; stage; stage = stage->next_sibling)
+    {
+        int fds[2] = {-1, -1};
+        if (stage->next_sibling && pipe(fds) < 0)
+        {
+            fprintf(stderr, "error: failed to create pipe: %s\n", strerror(errno));
+            break;
+        }
+
+        pid_t pid = fork();
+        if (pid == 0)
+        {
+            if (in_fd >= 0)
+            {
+                dup2(in_fd, STDIN_FILENO);
+                close(in_fd);
+            }
+            if (fds[1] >= 0)
+            {
+                dup2(fds[1], STDOUT_FILENO);
+                close(fds[0]);
+                close(fds[1]);
+            }
+            exec_stage(stage);
+        }
+
+        if (in_fd >= 0)
+        {
+            close(in_fd);
+        }
+        if (fds[1] >= 0)
+        {
+            close(fds[1]);
+        }
+        in_fd = fds[0];
+        if (pid < 0)
+        {
+            fprintf(stderr, "error: failed to fork command: %s\n", strerror(errno));
+            break;
+        }
+        pids[count++] = pid;
+    }
+    if (in_fd >= 0)
+    {
+        close(in_fd);
+    }
+
+    // the status of a pipeline is that of its last command
+    int status = count == node->children ? 0 : 1;
+    for (int i = 0; i < count; i++)
+    {
+        int stage_status = wait_status(pids[i]);
+        if (i == node->children - 1)
+        {
+            status = stage_status;
+        }
     }
+    free(pids);
 
+    if (node->val.sint) // "! pipeline"
+    {
+        status = !status;
+    }
+    return status;
+}
+
+// whether a loop should stop after its body ran (break, or continue for
+// an outer loop). a pending "continue" for this loop is used up here
+static int leave_loop(void)
+{
+    if (breaking)
+    {
+        breaking--;
+        return 1;
+    }
+    if (continuing)
+    {
+        return --continuing > 0;
+    }
+    return 0;
+}
+
+static int do_list(struct node_s *node)
+{
     int status = 0;
-    waitpid(child_pid, &status, 0); // suspends the parent process until the child's is completed
-    free_argv(argc, argv);
+    for (struct node_s *cmd = node->first_child; cmd && !breaking && !continuing; cmd = cmd->next_sibling)
+    {
+        status = do_command(cmd);
+    }
+    return status;
+}
 
-    return 1;
-}
\ No newline at end of file
+static int do_while(struct node_s *node, int until)
+{
+    struct node_s *cond = node->first_child;
+    struct node_s *body = cond->next_sibling;
+    int status = 0;
+
+    loop_depth++;
+    while (1)
+    {
+        int cond_status = do_command(cond);
+        if (breaking || continuing)
+        {
+            if (leave_loop())
+            {
+                break;
+            }
+            continue;
+        }
+        if ((cond_status == 0) == until)
+        {
+            break;
+        }
+        status = do_command(body);
+        if (leave_loop())
+        {
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+static int do_for(struct node_s *node)
+{
+    struct node_s *body = node->last_child;
+    int status = 0;
+
+    loop_depth++;
+    for (struct node_s *word = node->first_child; word != body; word = word->next_sibling)
+    {
+        char *val = expand_word(word->val.str);
+        int ok = val && set_var(node->val.str, val);
+        if (val && !ok)
+        {
+            fprintf(stderr, "error: failed to set %s: %s\n", node->val.str, strerror(errno));
+        }
+        if (val && val != word->val.str)
+        {
+            free(val);
+        }
+        if (!ok)
+        {
+            status = 1;
+            break;
+        }
+        status = do_command(body);
+        if (leave_loop())
+        {
+            break;
+        }
+    }
+    loop_depth--;
+    return status;
+}
+
+// command < file: stdin is the file while the command (or the whole loop)
+// runs, in the shell itself, so read and the builtins see it too
+static int do_redir_in(struct node_s *node)
+{
+    char *file = expand_word(node->val.str);
+    if (!file)
+    {
+        return 1;
+    }
+    int fd = open(file, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        fprintf(stderr, "error: %s: %s\n", file, strerror(errno));
+    }
+    if (file != node->val.str)
+    {
+        free(file);
+    }
+    if (fd < 0)
+    {
+        return 1;
+    }
+
+    read_reset();
+    int saved = fcntl(STDIN_FILENO, F_DUPFD_CLOEXEC, 10); // -1 if stdin was closed
+    dup2(fd, STDIN_FILENO);
+    close(fd);
+
+    int status = do_command(node->first_child);
+
+    read_reset();
+    if (saved >= 0)
+    {
+        dup2(saved, STDIN_FILENO);
+        close(saved);
+    }
+    else
+    {
+        close(STDIN_FILENO);
+    }
+    return status;
+}
+
+int do_command(struct node_s *node)
+{
+    int status = 0;
+    struct node_s *first = node->first_child;
+
+    switch (node->type)
+    {
+    case NODE_COMMAND:
+        status = do_simple_command(node);
+        break;
+    case NODE_LIST:
+        status = do_list(node);
+        break;
+    case NODE_PIPELINE:
+        status = do_pipeline(node);
+        break;
+    case NODE_AND:
+    case NODE_OR:
+        status = do_command(first);
+        if ((status == 0) == (node->type == NODE_AND) && !breaking && !continuing)
+        {
+            status = do_command(first->next_sibling);
+        }
+        break;
+    case NODE_IF:
+        status = do_command(first);
+        if (breaking || continuing)
+        {
+            break;
+        }
+        if (status == 0)
+        {
+            status = do_command(first->next_sibling);
+        }
+        else
+        {
+            // no else-part: the if's status is 0 when no condition was true
+            struct node_s *else_part = first->next_sibling->next_sibling;
+            status = else_part ? do_command(else_part) : 0;
+        }
+        break;
+    case NODE_WHILE:
+    case NODE_UNTIL:
+        status = do_while(node, node->type == NODE_UNTIL);
+        break;
+    case NODE_FOR:
+        status = do_for(node);
+        break;
+    case NODE_REDIR_IN:
+        status = do_redir_in(node);
+        break;
+    default:
+        break;
+    }
+
+    last_status = status;
+    return status;
+}
@@ -7,4 +7,7 @@ char *search_path(char *file);
 int do_exec_cmd(int argc, char **argv);
 int do_simple_command(struct node_s *node);
 
+// runs any node of the tree and returns its exit status (0 = true)
+int do_command(struct node_s *node);
+
 #endif
\ No newline at end of file
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE
 #include <stdio.h> //io functions like printf
 #include <stdlib.h> // memory alloc, process control like exit
 #include <errno.h> // error handling 
@@ -6,16 +7,97 @@
 #include "source.h"
 #include "parser.h"
 #include "executor.h"
+#include <unistd.h>
+#include "../shell_official/lineedit.h" // the same line editor as wish
+#include "../shell_official/complete.h"
+
+#define HISTORY_FILE ".tutorial_history" // kept in $HOME
+
+// on a terminal: history (shared between sessions) and tab completion
+static void start_line_editor(void)
+{
+    const char *home = getenv("HOME");
+    if (home)
+    {
+        size_t len = strlen(home) + strlen(HISTORY_FILE) + 2;
+        char histfile[len];
+        snprintf(histfile, len, "%s/%s", home, HISTORY_FILE);
+        le_history_init(histfile);
+    }
+    le_set_completion(complete_line);
+}
+
+// lets the completer look for commands where the executor will: $PATH
+static void follow_path(void)
+{
+    char *PATH = getenv("PATH");
+    char *copy = strdup(PATH ? PATH : "");
+    if (!copy)
+    {
+        return;
+    }
+    char *dirs[256];
+    int count = 0;
+    for (char *dir = strtok(copy, ":"); dir && count < 256; dir = strtok(NULL, ":"))
+    {
+        dirs[count++] = dir;
+    }
+    complete_set_paths(dirs, count);
+    free(copy);
+}
+
+// one physical line, with its newline, into *line (getline's contract).
+// on a terminal it comes from the line editor, which shows the prompt
+// print_prompt1/print_prompt2 picked
+static ssize_t read_line(char **line, size_t *linecap)
+{
+    if (!isatty(STDIN_FILENO))
+    {
+        return getline(line, linecap, stdin);
+    }
+
+    follow_path();
+    char *edited = le_readline(current_prompt());
+    if (!edited)
+    {
+        return -1;
+    }
+    le_history_add(edited);
+
+    size_t len = strlen(edited);
+    if (len + 2 > *linecap)
+    {
+        char *line2 = realloc(*line, len + 2);
+        if (!line2)
+        {
+            free(edited);
+            return -1;
+        }
+        *line = line2;
+        *linecap = len + 2;
+    }
+    memcpy(*line, edited, len);
+    (*line)[len] = '\n';
+    (*line)[len + 1] = '\0';
+    free(edited);
+    return len + 1;
+}
 
 int main(int argc, char **argv)
 {
     char *cmd; // declare a pointer to hold the user's command
+    size_t cmdlen; // and its length, as counted by read_cmd
+
+    if (isatty(STDIN_FILENO))
+    {
+        start_line_editor();
+    }
 
     do
     {
         print_prompt1();
 
-        cmd = read_cmd();
+        cmd = read_cmd(&cmdlen);
 
         if (!cmd)
         {
@@ -36,9 +118,32 @@ int main(int argc, char **argv)
 
         struct source_s src;
         src.buffer   = cmd;
-        src.bufsize  = strlen(cmd);
+        src.bufsize  = cmdlen;
         src.curpos   = INIT_SRC_POS;
-        parse_and_execute(&src);
+
+        // an if/while/for can go on over several lines: keep appending them
+        // and parse the whole thing again until it is complete
+        while(parse_and_execute(&src) == PARSE_INCOMPLETE)
+        {
+            print_prompt2();
+            size_t morelen;
+            char *more = read_cmd(&morelen);
+            char *cmd2 = more ? realloc(cmd, cmdlen + morelen + 1) : NULL;
+            if(!cmd2)
+            {
+                fprintf(stderr, "error: unexpected end of input\n");
+                free(more);
+                break;
+            }
+            memcpy(cmd2 + cmdlen, more, morelen + 1);
+            free(more);
+            cmd = cmd2;
+            cmdlen += morelen;
+
+            src.buffer   = cmd;
+            src.bufsize  = cmdlen;
+            src.curpos   = INIT_SRC_POS;
+        }
 
         free(cmd);
 
@@ -47,59 +152,63 @@ int main(int argc, char **argv)
     exit(EXIT_SUCCESS);
 }
 
-// reads the user's command
-char *read_cmd(void)
+// reads the user's command, joining lines that end in a backslash.
+// the buffer grows geometrically and the length is tracked as we go, so even
+// a multi-megabyte continued input is read in linear time and the caller
+// gets the exact size back in *lenp (no strlen needed)
+char *read_cmd(size_t *lenp)
 {
-    char buf[1024]; // buffer to store chunks of input from the user (as it reads)
-    char *ptr = NULL; // pointer to dynamically allocate memory for the command
-    char ptrlen = 0; // current length of the data in the pointer (how much has been read so far)
+    char *line = NULL; // one physical line, as returned by read_line
+    size_t linecap = 0;
+    ssize_t linelen;
 
-    while(fgets(buf, 1024, stdin))
-    {
-        int buflen = strlen(buf); // 
+    char *ptr = NULL; // the whole (possibly continued) command
+    size_t ptrlen = 0; // how much of ptr is used, not counting the \0
+    size_t ptrcap = 0;
 
-        if(!ptr)
-        {
-            ptr = malloc(buflen+1); // extra byte for \0 that was not counted in buflen
-        }
-        else
+    while((linelen = read_line(&line, &linecap)) > 0)
+    {
+        if(ptrlen + linelen + 1 > ptrcap)
         {
-            char *ptr2 = realloc(ptr, ptrlen+buflen+1); // (resizing) reallocating memory for when there's already info on ptr
-
-            if(ptr2)
+            size_t newcap = ptrcap ? ptrcap : 1024;
+            while(newcap < ptrlen + linelen + 1)
             {
-                ptr = ptr2; // update ptr so we have it pointing to the new memory block
+                newcap *= 2;
             }
-            else
+
+            char *ptr2 = realloc(ptr, newcap);
+            if(!ptr2)
             {
+                fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
                 free(ptr);
-                ptr = NULL;
+                free(line);
+                return NULL;
             }
+            ptr = ptr2;
+            ptrcap = newcap;
         }
 
-        if(!ptr)
-        {
-            fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
-            return NULL;
-        }
-
-        strcpy(ptr+ptrlen, buf);
+        memcpy(ptr+ptrlen, line, linelen+1);
+        ptrlen += linelen;
 
-        if(buf[buflen-1] == '\n') // checks if user pressed enter
+        if(line[linelen-1] == '\n') // checks if user pressed enter
         {
-            if(buflen == 1 || buf[buflen-2] != '\\') // checks for (not) line continuation
+            if(linelen == 1 || line[linelen-2] != '\\') // checks for (not) line continuation
             {
-                return ptr;
+                break;
             }
 
-            ptr[ptrlen+buflen-2] = '\0';
-            buflen -= 2;
+            ptrlen -= 2; // drop the "\\\n" and keep reading
+            ptr[ptrlen] = '\0';
             print_prompt2();
         }
-
-        ptrlen += buflen; 
     }
 
+    free(line);
+    if(ptr)
+    {
+        *lenp = ptrlen;
+    }
     return ptr;
 }
 
@@ -114,19 +223,17 @@ int parse_and_execute(struct source_s *src)
         return 0;
     }
 
-    while(tok && tok != &eof_token)
+    // the whole input becomes one tree first, so nothing runs before we
+    // know the last line didn't leave an if or a loop open
+    int incomplete;
+    struct node_s *list = parse_program(tok, &incomplete);
+    if(!list)
     {
-        struct node_s *cmd = parse_simple_command(tok);
-
-        if(!cmd)
-        {
-            break;
-        }
-
-        do_simple_command(cmd);
-        free_node_tree(cmd);
-        tok = tokenize(src);
+        return incomplete ? PARSE_INCOMPLETE : 0;
     }
 
+    do_command(list);
+    free_node_tree(list);
+
     return 1;
 }
@@ -36,16 +36,12 @@ void add_child_node(struct node_s *parent, struct node_s *child)
     }
     else
     {
-        struct node_s *sibling = parent->first_child;
-    
-    	while(sibling->next_sibling) // iteration to find the last child
-        {
-            sibling = sibling->next_sibling;
-        }
+        struct node_s *sibling = parent->last_child; // no need to walk the list
     
     	sibling->next_sibling = child;
         child->prev_sibling = sibling;
     }
+    parent->last_child = child;
     parent->children++;
 }
 
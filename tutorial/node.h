@@ -5,6 +5,15 @@ enum node_type_e
 {
     NODE_COMMAND,           /* simple command */
     NODE_VAR,               /* variable name (or simply, a word) */
+    NODE_LIST,              /* commands run one after the other */
+    NODE_PIPELINE,          /* commands joined by pipes, val.sint = 1 for "! ..." */
+    NODE_AND,               /* cmd1 && cmd2 */
+    NODE_OR,                /* cmd1 || cmd2 */
+    NODE_IF,                /* condition, then-part, optional else-part (elif is a nested NODE_IF) */
+    NODE_WHILE,             /* condition, body */
+    NODE_UNTIL,             /* condition, body */
+    NODE_FOR,               /* val.str = variable; the words, then the body */
+    NODE_REDIR_IN,          /* val.str = file; the command whose stdin it is */
 };
 
 enum val_type_e
@@ -38,6 +47,7 @@ struct node_s
     union  symval_u val;        /* value of this node */
     int    children;            /* number of child nodes */
     struct node_s *first_child; /* first child node */
+    struct node_s *last_child;  /* last child node (so appending is O(1)) */
     struct node_s *next_sibling, *prev_sibling; /*
                                                  * if this is a child node, keep
                                                  * pointers to prev/next siblings
@@ -1,9 +1,12 @@
 #include <unistd.h>
+#include <stdio.h>
+#include <string.h>
 #include "shell.h"
 #include "parser.h"
 #include "scanner.h"
 #include "node.h"
 #include "source.h"
+#include "symtab.h"
 
 // builds a tree and each token is a child of the main node
 struct node_s *parse_simple_command(struct token_s *tok)
@@ -47,3 +50,379 @@ struct node_s *parse_simple_command(struct token_s *tok)
 
     return cmd; // returns the root node (what a terrible name "cmd")
 }
+
+
+/*
+ * the grammar on top of simple commands, one function per rule:
+ *
+ *   list     := and_or ((';' | '\n') and_or)*
+ *   and_or   := pipeline (('&&' | '||') pipeline)*
+ *   pipeline := ['!'] command ('|' command)*
+ *   command  := (if | while | until | for | simple command) ['<' word]
+ *
+ * reserved words (if, then, do, done...) only count as such where a
+ * command starts, so "echo done" is still an echo.
+ */
+
+struct parser_s
+{
+    struct source_s *src;
+    struct token_s *tok;    // the token we are looking at
+    int incomplete;         // ran out of input inside a construct
+    int failed;
+};
+
+static void advance(struct parser_s *p)
+{
+    if(p->tok != &eof_token)
+    {
+        free_token(p->tok);
+    }
+    p->tok = tokenize(p->src);
+}
+
+static int at(struct parser_s *p, const char *text)
+{
+    return p->tok != &eof_token && strcmp(p->tok->text, text) == 0;
+}
+
+static int at_operator(struct parser_s *p)
+{
+    return at(p, ";") || at(p, "|") || at(p, "||") || at(p, "&") || at(p, "&&") || at(p, "<") ||
+           at(p, "\n");
+}
+
+// a word that ends the list before it: "then" after an if condition and so on
+static int at_terminator(struct parser_s *p)
+{
+    return p->tok == &eof_token || at(p, "then") || at(p, "elif") || at(p, "else") ||
+           at(p, "fi") || at(p, "do") || at(p, "done");
+}
+
+static void skip_newlines(struct parser_s *p)
+{
+    while(at(p, "\n"))
+    {
+        advance(p);
+    }
+}
+
+static void syntax_error(struct parser_s *p)
+{
+    if(p->failed || p->incomplete)
+    {
+        return; // only the first problem is reported
+    }
+    if(p->tok == &eof_token)
+    {
+        p->incomplete = 1; // more input could still complete it
+        return;
+    }
+    p->failed = 1;
+    fprintf(stderr, "error: syntax error near unexpected token `%s'\n",
+            strcmp(p->tok->text, "\n") == 0 ? "newline" : p->tok->text);
+}
+
+static int expect(struct parser_s *p, const char *text)
+{
+    if(!at(p, text))
+    {
+        syntax_error(p);
+        return 0;
+    }
+    advance(p);
+    return 1;
+}
+
+// a node with the given children (NULL ones are skipped), or NULL if the
+// parse failed somewhere inside it
+static struct node_s *make_node(struct parser_s *p, enum node_type_e type,
+                                struct node_s *a, struct node_s *b, struct node_s *c)
+{
+    struct node_s *node = p->failed || p->incomplete ? NULL : new_node(type);
+    if(!node)
+    {
+        free_node_tree(a);
+        free_node_tree(b);
+        free_node_tree(c);
+        p->failed = 1;
+        return NULL;
+    }
+    add_child_node(node, a);
+    add_child_node(node, b);
+    add_child_node(node, c);
+    return node;
+}
+
+static struct node_s *parse_list(struct parser_s *p);
+
+static struct node_s *parse_words(struct parser_s *p)
+{
+    struct node_s *cmd = new_node(NODE_COMMAND);
+    if(!cmd)
+    {
+        p->failed = 1;
+        return NULL;
+    }
+    while(p->tok != &eof_token && !at_operator(p))
+    {
+        struct node_s *word = new_node(NODE_VAR);
+        if(!word)
+        {
+            free_node_tree(cmd);
+            p->failed = 1;
+            return NULL;
+        }
+        set_node_val_str(word, p->tok->text);
+        add_child_node(cmd, word);
+        advance(p);
+    }
+    if(!cmd->children)
+    {
+        free_node_tree(cmd);
+        syntax_error(p);
+        return NULL;
+    }
+    return cmd;
+}
+
+// after "if" or "elif": an elif is the else-part, as an if of its own
+static struct node_s *parse_if(struct parser_s *p)
+{
+    advance(p);
+    struct node_s *cond = parse_list(p);
+    struct node_s *then_part = expect(p, "then") ? parse_list(p) : NULL;
+    struct node_s *else_part = NULL;
+    if(at(p, "elif"))
+    {
+        else_part = parse_if(p);
+    }
+    else
+    {
+        if(at(p, "else"))
+        {
+            advance(p);
+            else_part = parse_list(p);
+        }
+        expect(p, "fi");
+    }
+    return make_node(p, NODE_IF, cond, then_part, else_part);
+}
+
+static struct node_s *parse_while(struct parser_s *p, enum node_type_e type)
+{
+    advance(p);
+    struct node_s *cond = parse_list(p);
+    struct node_s *body = expect(p, "do") ? parse_list(p) : NULL;
+    expect(p, "done");
+    return make_node(p, type, cond, body, NULL);
+}
+
+// for NAME [in WORD...] ; do LIST done
+static struct node_s *parse_for(struct parser_s *p)
+{
+    advance(p);
+    if(p->tok == &eof_token || at_operator(p) || var_name_len(p->tok->text) != strlen(p->tok->text))
+    {
+        syntax_error(p);
+        return NULL;
+    }
+    struct node_s *loop = new_node(NODE_FOR);
+    if(!loop)
+    {
+        p->failed = 1;
+        return NULL;
+    }
+    set_node_val_str(loop, p->tok->text);
+    advance(p);
+
+    skip_newlines(p);
+    if(at(p, "in"))
+    {
+        advance(p);
+        while(p->tok != &eof_token && !at_operator(p))
+        {
+            struct node_s *word = new_node(NODE_VAR);
+            if(!word)
+            {
+                p->failed = 1;
+                break;
+            }
+            set_node_val_str(word, p->tok->text);
+            add_child_node(loop, word);
+            advance(p);
+        }
+        if(!at(p, ";") && !at(p, "\n"))
+        {
+            syntax_error(p);
+        }
+        advance(p);
+    }
+    else if(at(p, ";"))
+    {
+        advance(p);
+    }
+    skip_newlines(p);
+
+    struct node_s *body = expect(p, "do") ? parse_list(p) : NULL;
+    expect(p, "done");
+    if(p->failed || p->incomplete || !body)
+    {
+        free_node_tree(body);
+        free_node_tree(loop);
+        return NULL;
+    }
+    add_child_node(loop, body);
+    return loop;
+}
+
+static struct node_s *parse_command(struct parser_s *p)
+{
+    struct node_s *cmd;
+    if(at(p, "if"))
+    {
+        cmd = parse_if(p);
+    }
+    else if(at(p, "while"))
+    {
+        cmd = parse_while(p, NODE_WHILE);
+    }
+    else if(at(p, "until"))
+    {
+        cmd = parse_while(p, NODE_UNTIL);
+    }
+    else if(at(p, "for"))
+    {
+        cmd = parse_for(p);
+    }
+    else
+    {
+        cmd = parse_words(p);
+    }
+
+    // "< file" wraps the command, a whole loop included
+    if(cmd && at(p, "<"))
+    {
+        advance(p);
+        if(p->tok == &eof_token || at_operator(p))
+        {
+            syntax_error(p);
+            free_node_tree(cmd);
+            return NULL;
+        }
+        struct node_s *redir = make_node(p, NODE_REDIR_IN, cmd, NULL, NULL);
+        if(redir)
+        {
+            set_node_val_str(redir, p->tok->text);
+        }
+        advance(p);
+        cmd = redir;
+    }
+    return cmd;
+}
+
+static struct node_s *parse_pipeline(struct parser_s *p)
+{
+    int negate = at(p, "!");
+    if(negate)
+    {
+        advance(p);
+    }
+
+    struct node_s *cmd = parse_command(p);
+    if(!cmd || (!negate && !at(p, "|")))
+    {
+        return cmd; // a single command needs no pipeline node
+    }
+
+    struct node_s *pipeline = make_node(p, NODE_PIPELINE, cmd, NULL, NULL);
+    while(pipeline && at(p, "|"))
+    {
+        advance(p);
+        skip_newlines(p);
+        struct node_s *next = parse_command(p);
+        if(!next)
+        {
+            free_node_tree(pipeline);
+            return NULL;
+        }
+        add_child_node(pipeline, next);
+    }
+    if(pipeline)
+    {
+        pipeline->val_type = VAL_SINT;
+        pipeline->val.sint = negate;
+    }
+    return pipeline;
+}
+
+static struct node_s *parse_and_or(struct parser_s *p)
+{
+    struct node_s *left = parse_pipeline(p);
+    while(left && (at(p, "&&") || at(p, "||")))
+    {
+        enum node_type_e type = at(p, "&&") ? NODE_AND : NODE_OR;
+        advance(p);
+        skip_newlines(p);
+        struct node_s *right = parse_pipeline(p);
+        left = right ? make_node(p, type, left, right, NULL) : (free_node_tree(left), NULL);
+    }
+    return left;
+}
+
+static struct node_s *parse_list(struct parser_s *p)
+{
+    struct node_s *list = new_node(NODE_LIST);
+    if(!list)
+    {
+        p->failed = 1;
+        return NULL;
+    }
+
+    while(1)
+    {
+        skip_newlines(p);
+        if(at_terminator(p))
+        {
+            break;
+        }
+        struct node_s *cmd = parse_and_or(p);
+        if(!cmd)
+        {
+            free_node_tree(list);
+            return NULL;
+        }
+        add_child_node(list, cmd);
+        if(!at(p, ";") && !at(p, "\n"))
+        {
+            break;
+        }
+        advance(p);
+    }
+
+    if(!list->children)
+    {
+        syntax_error(p); // "if then", "do done" and the like
+        free_node_tree(list);
+        return NULL;
+    }
+    return list;
+}
+
+struct node_s *parse_program(struct token_s *tok, int *incomplete)
+{
+    struct parser_s p = {tok->src, tok, 0, 0};
+    struct node_s *list = parse_list(&p);
+    if(list && p.tok != &eof_token)
+    {
+        syntax_error(&p); // a stray "fi", "done", "&"...
+        free_node_tree(list);
+        list = NULL;
+    }
+    if(p.tok != &eof_token)
+    {
+        free_token(p.tok);
+    }
+    *incomplete = p.incomplete;
+    return list;
+}
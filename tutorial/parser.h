@@ -6,4 +6,9 @@
 
 struct node_s *parse_simple_command(struct token_s *tok);
 
+// parses everything from tok to the end of the input into a NODE_LIST.
+// NULL on a syntax error, or with *incomplete set when the input stops
+// inside an if/while/for or after a | && ||, so more lines can be read
+struct node_s *parse_program(struct token_s *tok, int *incomplete);
+
 #endif
\ No newline at end of file
@@ -1,12 +1,30 @@
 #include <stdio.h>
+#include <unistd.h>
 #include "shell.h"
 
+// on a terminal the line editor draws the prompt (and redraws it with the
+// line), so there the prompt is only picked here and read_cmd hands it over
+static const char *prompt = "$ ";
+
 void print_prompt1(void) // 1st prompt string PS1 (when the shell waits for u to enter a command)
 {
-    fprintf(stderr, "$ ");
+    prompt = "$ ";
+    if (!isatty(STDIN_FILENO))
+    {
+        fprintf(stderr, "%s", prompt);
+    }
 }
 
 void print_prompt2(void) // PS2 (when u enter a multi-line command)
 {
-    fprintf(stderr, "> ");
-}
\ No newline at end of file
+    prompt = "> ";
+    if (!isatty(STDIN_FILENO))
+    {
+        fprintf(stderr, "%s", prompt);
+    }
+}
+
+const char *current_prompt(void)
+{
+    return prompt;
+}
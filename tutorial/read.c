@@ -0,0 +1,317 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "read.h"
+#include "symtab.h"
+
+/*
+ * the read builtin
+ *
+ * read may not take more than one line from its input: whatever comes after
+ * belongs to the next command that reads the same fd. shells usually get
+ * there by reading one byte at a time, which is a system call per byte.
+ * we only do that when stdin can't be seeked (a pipe, a terminal). from a
+ * file, read takes 64K at a time, hands out the lines from that buffer and
+ * moves the fd offset back to where the next line starts. the move back is
+ * lazy: as long as no other process could look at the fd, nobody can tell
+ * the offset is ahead, so a "while read" loop with no commands in it runs
+ * on one read() per 64K. the executor calls read_sync before it forks and
+ * read_reset when it points fd 0 somewhere else.
+ */
+
+#define READ_BUF_SIZE 65536
+
+static struct
+{
+    int valid;      // buf[start..end) is the file from pos on
+    int owned;      // the fd offset is at pos + (end - start), not pos
+    off_t pos;      // file offset of buf[start]: where the next line starts
+    size_t start, end;
+    char buf[READ_BUF_SIZE];
+} ahead;
+
+// the line being read, and the same with backslashes taken out
+static char *line, *text, *escaped;
+static size_t line_len, line_cap, text_cap;
+
+void read_sync(void)
+{
+    if (ahead.owned)
+    {
+        lseek(STDIN_FILENO, ahead.pos, SEEK_SET);
+        ahead.owned = 0;
+    }
+}
+
+void read_reset(void)
+{
+    read_sync();
+    ahead.valid = 0;
+}
+
+static int append(const char *s, size_t n)
+{
+    if (line_len + n + 1 > line_cap)
+    {
+        size_t cap = line_cap ? line_cap : 256;
+        while (cap < line_len + n + 1)
+        {
+            cap *= 2;
+        }
+        char *line2 = realloc(line, cap);
+        if (!line2)
+        {
+            return 0;
+        }
+        line = line2;
+        line_cap = cap;
+    }
+    memcpy(line + line_len, s, n);
+    line_len += n;
+    return 1;
+}
+
+// takes the fd offset back from whoever had it last. 0 if stdin can't be
+// seeked, which leaves us reading it a byte at a time
+static int own_offset(void)
+{
+    if (ahead.owned)
+    {
+        return 1;
+    }
+    off_t cur = lseek(STDIN_FILENO, 0, SEEK_CUR);
+    if (cur < 0)
+    {
+        ahead.valid = 0;
+        return 0;
+    }
+    if (ahead.valid && cur == ahead.pos && ahead.end > ahead.start)
+    {
+        // nobody moved it: what we have is still next, skip over it again
+        if (lseek(STDIN_FILENO, ahead.pos + (off_t)(ahead.end - ahead.start), SEEK_SET) < 0)
+        {
+            return 0;
+        }
+    }
+    else
+    {
+        ahead.pos = cur;
+        ahead.start = ahead.end = 0;
+    }
+    ahead.valid = 1;
+    ahead.owned = 1;
+    return 1;
+}
+
+// appends the next line (without its '\n') to line. 1 if it ended in a
+// newline, 0 at the end of the input, -1 on an error
+static int read_line(void)
+{
+    if (!own_offset())
+    {
+        char c;
+        ssize_t got;
+        while ((got = read(STDIN_FILENO, &c, 1)) == 1 || (got < 0 && errno == EINTR))
+        {
+            if (got < 0)
+            {
+                continue;
+            }
+            if (c == '\n')
+            {
+                return 1;
+            }
+            if (!append(&c, 1))
+            {
+                return -1;
+            }
+        }
+        return got < 0 ? -1 : 0;
+    }
+
+    while (1)
+    {
+        char *start = ahead.buf + ahead.start;
+        char *nl = memchr(start, '\n', ahead.end - ahead.start);
+        size_t n = nl ? (size_t)(nl - start) : ahead.end - ahead.start;
+        if (!append(start, n))
+        {
+            return -1;
+        }
+        ahead.start += n;
+        ahead.pos += n;
+        if (nl)
+        {
+            ahead.start++;
+            ahead.pos++;
+            return 1;
+        }
+
+        ssize_t got = read(STDIN_FILENO, ahead.buf, READ_BUF_SIZE);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (got <= 0)
+        {
+            return got < 0 ? -1 : 0;
+        }
+        ahead.start = 0;
+        ahead.end = got;
+    }
+}
+
+// copies line into text, taking out the backslashes (unless raw) and the
+// NUL bytes; escaped[i] says text[i] came after a backslash
+static size_t unescape(int raw)
+{
+    if (line_len + 1 > text_cap)
+    {
+        char *text2 = realloc(text, line_len + 1);
+        char *escaped2 = text2 ? realloc(escaped, line_len + 1) : NULL;
+        text = text2 ? text2 : text;
+        if (!escaped2)
+        {
+            return (size_t)-1;
+        }
+        escaped = escaped2;
+        text_cap = line_len + 1;
+    }
+
+    size_t n = 0;
+    for (size_t i = 0; i < line_len; i++)
+    {
+        int esc = !raw && line[i] == '\\' && i + 1 < line_len;
+        i += esc;
+        if (line[i] == '\0')
+        {
+            continue;
+        }
+        text[n] = line[i];
+        escaped[n++] = esc;
+    }
+    text[n] = '\0';
+    return n;
+}
+
+static int is_ifs(const char *ifs, size_t i)
+{
+    return !escaped[i] && text[i] && strchr(ifs, text[i]);
+}
+
+static int is_ifs_white(const char *ifs, size_t i)
+{
+    return is_ifs(ifs, i) && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n');
+}
+
+int do_read(char **argv)
+{
+    static char *reply[] = {"REPLY", NULL};
+    int raw = 0;
+    argv++;
+    if (*argv && strcmp(*argv, "-r") == 0)
+    {
+        raw = 1;
+        argv++;
+    }
+    if (*argv && (*argv)[0] == '-')
+    {
+        fprintf(stderr, "error: read: usage: read [-r] [name ...]\n");
+        return 2;
+    }
+    char **names = *argv ? argv : reply;
+    for (char **name = names; *name; name++)
+    {
+        if (var_name_len(*name) != strlen(*name))
+        {
+            fprintf(stderr, "error: read: `%s': not a valid identifier\n", *name);
+            return 1;
+        }
+    }
+
+    // a backslash at the end of the line continues it on the next one
+    line_len = 0;
+    int status;
+    while ((status = read_line()) == 1 && !raw && line_len && line[line_len - 1] == '\\')
+    {
+        size_t slashes = 0;
+        while (slashes < line_len && line[line_len - 1 - slashes] == '\\')
+        {
+            slashes++;
+        }
+        if (slashes % 2 == 0)
+        {
+            break;
+        }
+        line_len--;
+    }
+    if (status < 0)
+    {
+        fprintf(stderr, "error: read: %s\n", strerror(errno ? errno : ENOMEM));
+        return 1;
+    }
+
+    size_t n = unescape(raw);
+    if (n == (size_t)-1)
+    {
+        fprintf(stderr, "error: read: %s\n", strerror(ENOMEM));
+        return 1;
+    }
+
+    const char *ifs = get_var("IFS");
+    if (!ifs)
+    {
+        ifs = " \t\n";
+    }
+
+    // IFS whitespace around a field is dropped; any other IFS character
+    // ends a field by itself. the last name gets the rest of the line
+    size_t i = 0;
+    while (i < n && is_ifs_white(ifs, i))
+    {
+        i++;
+    }
+    for (char **name = names; *name; name++)
+    {
+        size_t field = i;
+        if (!name[1])
+        {
+            size_t end = n;
+            while (end > i && is_ifs_white(ifs, end - 1))
+            {
+                end--;
+            }
+            text[end] = '\0';
+            i = n;
+        }
+        else
+        {
+            while (i < n && !is_ifs(ifs, i))
+            {
+                i++;
+            }
+            size_t end = i;
+            while (i < n && is_ifs_white(ifs, i))
+            {
+                i++;
+            }
+            if (i < n && is_ifs(ifs, i)) // at most one non-white delimiter
+            {
+                i++;
+                while (i < n && is_ifs_white(ifs, i))
+                {
+                    i++;
+                }
+            }
+            text[end] = '\0';
+        }
+        if (!set_var(*name, text + field))
+        {
+            fprintf(stderr, "error: read: failed to set %s: %s\n", *name, strerror(errno));
+            return 1;
+        }
+    }
+    return status == 1 ? 0 : 1;
+}
@@ -0,0 +1,16 @@
+#ifndef READ_H
+#define READ_H
+
+// read [-r] [NAME...]: a line from stdin, split by $IFS into the NAMEs
+// (REPLY if none, the last one gets the rest of the line). 0 if a line was
+// read, 1 at the end of the input
+int do_read(char **argv);
+
+// read keeps what it read ahead of the line it returned when stdin is
+// seekable, and moves the fd offset back lazily. read_sync puts the offset
+// where the next line starts: call it before anything else can use the fd
+// (a fork). read_reset also forgets the data, for when fd 0 is replaced
+void read_sync(void);
+void read_reset(void);
+
+#endif
@@ -7,18 +7,6 @@
 #include "scanner.h"
 #include "source.h"
 
-struct token_s {
-    char *text;
-    size_t text_len;
-    struct source_s *src;
-};
-
-struct source_s {
-    char *buffer;
-    size_t bufsize;
-    size_t curpos;
-};
-
 // to signal the end of the input
 struct token_s eof_token =
     {
@@ -50,52 +38,122 @@ void free_token(struct token_s *tok)
     free(tok);
 }
 
-struct token_s *tokenize(struct source_s *src)
+// grows the token buffer when a word doesn't fit
+static int add_to_buf(char **buf, size_t *bufsize, size_t *index, char c)
 {
-    static char *line = NULL;
-    static size_t len = 0;
-    static ssize_t read = 0;
-    static size_t pos = 0;
-
-    // Read a new line if we've reached the end of the current one
-    if (pos >= read || !line) {
-        pos = 0;
-        read = getline(&line, &len, stdin);
-        if (read == -1) {
-            free(line);
-            line = NULL;
-            return &eof_token;
+    if (*index + 1 >= *bufsize) {
+        size_t newsize = *bufsize ? *bufsize * 2 : 1024;
+        char *tmp = realloc(*buf, newsize);
+        if (!tmp) {
+            return 0;
         }
+        *buf = tmp;
+        *bufsize = newsize;
     }
+    (*buf)[(*index)++] = c;
+    return 1;
+}
 
-    // Skip leading whitespace
-    while (pos < read && isspace(line[pos])) {
-        pos++;
+// the rest of a $((expr)) or ((expr)) once its "((" is in the buffer, up
+// to the "))" that closes it: blanks and operators inside are part of it
+static int add_arith(struct source_s *src, char **buf, size_t *bufsize, size_t *index)
+{
+    int depth = 0;
+    char c;
+    while ((c = next_char(src)) != EOF) {
+        if (!add_to_buf(buf, bufsize, index, c)) {
+            return 0;
+        }
+        if (c == '(') {
+            depth++;
+        } else if (c == ')' && depth > 0) {
+            depth--;
+        } else if (c == ')' && peek_char(src) == ')') {
+            return add_to_buf(buf, bufsize, index, next_char(src));
+        }
     }
+    return 1; // unterminated: the expansion reports it
+}
 
-    // Check if we've reached the end of the line
-    if (pos >= read) {
-        struct token_s *tok = create_token("\n");
-        if (!tok) {
-            fprintf(stderr, "error: failed to allocate token: %s\n", strerror(errno));
-            return &eof_token;
-        }
-        tok->src = src;
-        pos++; // Move past the newline
-        return tok;
+// returns the next word or operator of src (or a "\n" token at the end of a line)
+struct token_s *tokenize(struct source_s *src)
+{
+    static char *tok_buf = NULL;
+    static size_t tok_bufsize = 0;
+    size_t tok_bufindex = 0;
+
+    if (!src || !src->buffer || !src->bufsize) {
+        errno = ENODATA;
+        return &eof_token;
     }
 
-    // Find the end of the token
-    size_t start = pos;
-    while (pos < read && !isspace(line[pos])) {
-        pos++;
+    char nc = next_char(src);
+    if (nc == ERRCHAR || nc == EOF) {
+        return &eof_token;
     }
 
-    // Create the token
-    char *token_text = strndup(line + start, pos - start);
-    struct token_s *tok = create_token(token_text);
-    free(token_text);
+    do {
+        if (nc == ' ' || nc == '\t') {
+            if (tok_bufindex > 0) {
+                break;
+            }
+            continue;
+        }
+
+        if (nc == '\n') {
+            if (tok_bufindex > 0) {
+                unget_char(src); // the newline becomes its own token next time
+            } else if (!add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, nc)) {
+                fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+                return &eof_token;
+            }
+            break;
+        }
+
+        // $((expr)) anywhere in a word, or a whole ((expr)) command
+        if ((nc == '$' || (nc == '(' && tok_bufindex == 0)) && peek_char(src) == '(') {
+            int ok = add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, nc);
+            if (nc == '$') {
+                ok = ok && add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, next_char(src));
+            }
+            if (ok && peek_char(src) == '(') {
+                ok = add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, next_char(src)) &&
+                     add_arith(src, &tok_buf, &tok_bufsize, &tok_bufindex);
+            }
+            if (!ok) {
+                fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+                return &eof_token;
+            }
+            continue;
+        }
+
+        // ; | & || && < are tokens of their own, even with no blanks around them
+        if (nc == ';' || nc == '|' || nc == '&' || nc == '<') {
+            if (tok_bufindex > 0) {
+                unget_char(src);
+                break;
+            }
+            if (!add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, nc) ||
+                (nc != ';' && peek_char(src) == nc &&
+                 !add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, next_char(src)))) {
+                fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+                return &eof_token;
+            }
+            break;
+        }
+
+        if (!add_to_buf(&tok_buf, &tok_bufsize, &tok_bufindex, nc)) {
+            fprintf(stderr, "error: failed to alloc buffer: %s\n", strerror(errno));
+            return &eof_token;
+        }
+    } while ((nc = next_char(src)) != EOF);
+
+    if (tok_bufindex == 0) {
+        return &eof_token;
+    }
+    tok_buf[tok_bufindex] = '\0';
 
+    struct token_s *tok = create_token(tok_buf);
     if (!tok) {
         fprintf(stderr, "error: failed to allocate token: %s\n", strerror(errno));
         return &eof_token;
@@ -3,10 +3,13 @@
 
 void print_prompt1(void);
 void print_prompt2(void);
+const char *current_prompt(void); // what the line editor shows
 
-char *read_cmd(void);
+#include <stddef.h>
+char *read_cmd(size_t *lenp);
 
 #include "source.h"
+#define PARSE_INCOMPLETE (-1) // the input stops in the middle of a command
 int  parse_and_execute(struct source_s *src);
 
 #endif
\ No newline at end of file
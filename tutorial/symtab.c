@@ -0,0 +1,159 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "symtab.h"
+
+/*
+ * shell variables live in a fixed-size hash table with chained buckets.
+ * a loop sets its variable once per iteration, so a lookup is a hash and a
+ * short chain walk instead of a scan over every variable. numbers (set by
+ * arithmetic) are kept as long long in the entry's symval_u and only turned
+ * into text when a word needs them. names that are also in the environment
+ * are updated there too, so commands see the new value the way they would
+ * in a real shell.
+ */
+
+#define SYMTAB_BUCKETS 256 // a power of two
+
+static struct symtab_entry_s *buckets[SYMTAB_BUCKETS];
+
+static size_t hash_var(const char *s)
+{
+    size_t h = 14695981039346656037UL; // FNV-1a
+    while (*s)
+    {
+        h ^= (unsigned char)*s++;
+        h *= 1099511628211UL;
+    }
+    return h & (SYMTAB_BUCKETS - 1);
+}
+
+struct symtab_entry_s *get_symtab_entry(const char *name)
+{
+    struct symtab_entry_s *entry = buckets[hash_var(name)];
+    while (entry)
+    {
+        if (strcmp(entry->name, name) == 0)
+        {
+            return entry;
+        }
+        entry = entry->next;
+    }
+    return NULL;
+}
+
+struct symtab_entry_s *add_to_symtab(const char *name)
+{
+    struct symtab_entry_s *entry = get_symtab_entry(name);
+    if (entry)
+    {
+        return entry;
+    }
+
+    entry = calloc(1, sizeof(struct symtab_entry_s));
+    if (!entry)
+    {
+        return NULL;
+    }
+    entry->name = strdup(name);
+    if (!entry->name)
+    {
+        free(entry);
+        return NULL;
+    }
+
+    size_t bucket = hash_var(name);
+    entry->next = buckets[bucket];
+    buckets[bucket] = entry;
+    return entry;
+}
+
+int symtab_entry_setval(struct symtab_entry_s *entry, const char *val)
+{
+    char *copy = strdup(val ? val : "");
+    if (!copy)
+    {
+        return 0;
+    }
+    if (entry->val_type == VAL_STR)
+    {
+        free(entry->val.str);
+    }
+    entry->val_type = VAL_STR;
+    entry->val.str = copy;
+    return 1;
+}
+
+int symtab_entry_setint(struct symtab_entry_s *entry, long long val)
+{
+    if (entry->val_type == VAL_STR)
+    {
+        free(entry->val.str);
+    }
+    entry->val_type = VAL_SLLONG;
+    entry->val.sllong = val;
+    return 1;
+}
+
+const char *get_var(const char *name)
+{
+    static char num[24]; // a number, formatted for this caller only
+
+    struct symtab_entry_s *entry = get_symtab_entry(name);
+    if (entry && entry->val_type == VAL_STR)
+    {
+        return entry->val.str;
+    }
+    if (entry && entry->val_type == VAL_SLLONG)
+    {
+        snprintf(num, sizeof(num), "%lld", entry->val.sllong);
+        return num;
+    }
+    return getenv(name);
+}
+
+int set_var(const char *name, const char *val)
+{
+    struct symtab_entry_s *entry = add_to_symtab(name);
+    if (!entry || !symtab_entry_setval(entry, val))
+    {
+        return 0;
+    }
+    if (getenv(name)) // exported already: keep the environment in step
+    {
+        setenv(name, entry->val.str, 1);
+    }
+    return 1;
+}
+
+int set_var_int(const char *name, long long val)
+{
+    struct symtab_entry_s *entry = add_to_symtab(name);
+    if (!entry)
+    {
+        return 0;
+    }
+    symtab_entry_setint(entry, val);
+    if (getenv(name))
+    {
+        char num[24];
+        snprintf(num, sizeof(num), "%lld", val);
+        setenv(name, num, 1);
+    }
+    return 1;
+}
+
+size_t var_name_len(const char *s)
+{
+    if (!isalpha((unsigned char)*s) && *s != '_')
+    {
+        return 0;
+    }
+    size_t len = 1;
+    while (isalnum((unsigned char)s[len]) || s[len] == '_')
+    {
+        len++;
+    }
+    return len;
+}
@@ -0,0 +1,30 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "node.h"
+
+// a shell variable. the value uses the same typed union as the AST nodes
+struct symtab_entry_s
+{
+    char  *name;
+    enum   val_type_e val_type;     /* type of val */
+    union  symval_u val;
+    struct symtab_entry_s *next;    /* next entry in the same bucket */
+};
+
+struct symtab_entry_s *get_symtab_entry(const char *name);
+struct symtab_entry_s *add_to_symtab(const char *name);
+int    symtab_entry_setval(struct symtab_entry_s *entry, const char *val);
+int    symtab_entry_setint(struct symtab_entry_s *entry, long long val);
+
+// the value of a shell variable, or of the environment variable with that
+// name when the shell has none (NULL if neither is set). a number comes
+// back as text in a buffer that the next call reuses
+const char *get_var(const char *name);
+int    set_var(const char *name, const char *val);
+int    set_var_int(const char *name, long long val);   /* stored as VAL_SLLONG */
+
+// length of the variable name at the start of s (0 if there is none)
+size_t var_name_len(const char *s);
+
+#endif